@@ -0,0 +1,30 @@
+#-------------------------------------------------
+#
+# Benchmark of DownloadDAO against a temporary SQLite database,
+# compares journal and transaction profiles and prints ops/s and
+# latency percentiles as JSON
+#
+#-------------------------------------------------
+
+QT       = core network sql
+
+TARGET = daobench
+TEMPLATE = app
+CONFIG   += console
+CONFIG   -= app_bundle
+
+include(../../downloadmanager.pri)
+
+# Tag the results with the version of the tree
+APP_VERSION = $$system(git --git-dir=$$PWD/../../.git describe --always --dirty)
+isEmpty(APP_VERSION): APP_VERSION = unknown
+DEFINES += APP_VERSION=\\\"$$APP_VERSION\\\"
+
+SOURCES += main.cpp \
+    daobenchmark.cpp
+
+HEADERS  += daobenchmark.h
+
+MOC_DIR += build/moc
+OBJECTS_DIR += build/obj
+DESTDIR += bin
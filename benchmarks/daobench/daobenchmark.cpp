@@ -0,0 +1,235 @@
+/*!
+ * \file daobenchmark.cpp
+ * \brief measures DownloadDAO throughput under several SQLite profiles
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#include "daobenchmark.h"
+#include "dbconnection.h"
+#include "downloaddao.h"
+#include "download.h"
+#include "contact.h"
+#include <QDir>
+#include <QFile>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QDebug>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+
+#ifndef APP_VERSION
+#define APP_VERSION "unknown"
+#endif
+
+static const int TRANSACTION_BATCH_SIZE = 100; // operations per transaction of the transactional profiles
+static const int LOOKUP_STRIDE = 7919; // prime stride spreading the lookups over the table
+
+// Monotonic time calculated by nanosecond
+static qint64 getNanoseconds()
+{
+    struct timespec now;
+    ::clock_gettime(CLOCK_MONOTONIC, &now);
+    return (qint64)now.tv_sec*1000000000 + now.tv_nsec;
+}
+
+DaoBenchmark::DaoBenchmark()
+{
+}
+
+QList<DaoProfile> DaoBenchmark::getProfiles()
+{
+    QList<DaoProfile> profiles;
+
+    // What the download manager does today
+    DaoProfile defaultProfile;
+    defaultProfile.name = "default";
+    defaultProfile.wal = false;
+    defaultProfile.batchSize = 1;
+    profiles << defaultProfile;
+
+    DaoProfile walProfile;
+    walProfile.name = "wal";
+    walProfile.wal = true;
+    walProfile.batchSize = 1;
+    profiles << walProfile;
+
+    DaoProfile transactionalProfile;
+    transactionalProfile.name = "transactional";
+    transactionalProfile.wal = false;
+    transactionalProfile.batchSize = TRANSACTION_BATCH_SIZE;
+    profiles << transactionalProfile;
+
+    DaoProfile batchedProfile;
+    batchedProfile.name = "batched";
+    batchedProfile.wal = true;
+    batchedProfile.batchSize = TRANSACTION_BATCH_SIZE;
+    profiles << batchedProfile;
+
+    return profiles;
+}
+
+void DaoBenchmark::removeDatabase(const QString &path)
+{
+    QFile::remove(path);
+    QFile::remove(path + "-journal");
+    QFile::remove(path + "-wal");
+    QFile::remove(path + "-shm");
+}
+
+void DaoBenchmark::configure(DBConnection *dbConnection, const DaoProfile &profile)
+{
+    if (!profile.wal)
+        return;
+
+    QSqlQuery query(dbConnection->getSqlDatabase());
+    if (!query.exec("PRAGMA journal_mode=WAL"))
+        qDebug() << __PRETTY_FUNCTION__ << query.lastError().text();
+    if (!query.exec("PRAGMA synchronous=NORMAL"))
+        qDebug() << __PRETTY_FUNCTION__ << query.lastError().text();
+}
+
+QList<QVariantMap> DaoBenchmark::run(const DaoProfile &profile, int rowCount)
+{
+    QList<QVariantMap> results;
+
+    QString path = QDir::temp().absoluteFilePath(QString("daobench-%1-%2-%3.sqlite")
+                                                 .arg(::getpid()).arg(profile.name).arg(rowCount));
+    removeDatabase(path);
+
+    DBConnection *dbConnection = new DBConnection();
+    Q_ASSERT(dbConnection != 0);
+    if (!dbConnection->open(path)) {
+        qDebug() << __PRETTY_FUNCTION__ << "Could not open " << path;
+        delete dbConnection;
+        return results;
+    }
+    configure(dbConnection, profile);
+
+    // The order matters: each operation works on the rows left by the previous one
+    results << runOperation(AddOperation, dbConnection, profile, rowCount);
+    results << runOperation(UpdateOperation, dbConnection, profile, rowCount);
+    results << runOperation(LookupOperation, dbConnection, profile, rowCount);
+    results << runOperation(DeleteOperation, dbConnection, profile, rowCount);
+
+    dbConnection->close();
+    delete dbConnection;
+    removeDatabase(path);
+
+    return results;
+}
+
+QVariantMap DaoBenchmark::runOperation(Operation operation, DBConnection *dbConnection, const DaoProfile &profile, int rowCount)
+{
+    static const char *operationNames[] = { "addDownload", "updateDownload", "getDownloadByContactId", "deleteDownloadContact" };
+
+    DownloadDAO dao(dbConnection);
+    dao.createTable();
+    QSqlDatabase db = dbConnection->getSqlDatabase();
+
+    Download download;
+    Contact *contact = new Contact;
+    Q_ASSERT(contact != 0);
+    download.setContact(contact);
+    download.setUrlType(DownloadManager::Music);
+
+    m_latencies.resize(rowCount);
+    int failedCount = 0;
+
+    qint64 operationStart = getNanoseconds();
+    for (int i = 0; i < rowCount; i++) {
+        int contactId = i + 1;
+        if (operation == LookupOperation && rowCount % LOOKUP_STRIDE != 0)
+            contactId = (int)(((qint64)i*LOOKUP_STRIDE) % rowCount) + 1;
+
+        qint64 start = getNanoseconds();
+
+        if (profile.batchSize > 1 && i % profile.batchSize == 0)
+            db.transaction();
+
+        bool succeeded = false;
+        switch (operation) {
+        case AddOperation:
+            contact->setId(contactId);
+            download.setUrl(QString("http://127.0.0.1/music-%1.mp3").arg(contactId));
+            download.setDownloadStatus(DownloadManager::Queueing);
+            succeeded = dao.addDownload(&download) != -1;
+            break;
+        case UpdateOperation:
+            contact->setId(contactId);
+            download.setUrl(QString("http://127.0.0.1/music-%1.mp3").arg(contactId));
+            download.setDownloadStatus(DownloadManager::Downloading);
+            succeeded = dao.updateDownload(&download);
+            break;
+        case LookupOperation: {
+            DownloadRecord record;
+            succeeded = dao.getDownloadByContactId(contactId, record);
+            break;
+        }
+        case DeleteOperation:
+            succeeded = dao.deleteDownloadContact(contactId);
+            break;
+        }
+
+        if (profile.batchSize > 1 && (i % profile.batchSize == profile.batchSize - 1 || i == rowCount - 1))
+            db.commit();
+
+        m_latencies[i] = getNanoseconds() - start;
+        if (!succeeded)
+            failedCount++;
+    }
+    double seconds = (getNanoseconds() - operationStart)/1e9;
+
+    std::sort(m_latencies.begin(), m_latencies.end());
+
+    QVariantMap result;
+    result["profile"] = profile.name;
+    result["rows"] = rowCount;
+    result["operation"] = QString(operationNames[operation]);
+    result["ops"] = rowCount;
+    result["failed"] = failedCount;
+    result["seconds"] = seconds;
+    result["opsPerSecond"] = seconds > 0 ? rowCount/seconds : 0.0;
+    result["p50Us"] = getPercentile(m_latencies, 0.50);
+    result["p99Us"] = getPercentile(m_latencies, 0.99);
+    return result;
+}
+
+double DaoBenchmark::getPercentile(const QVector<qint64> &latencies, double percentile)
+{
+    if (latencies.isEmpty())
+        return 0;
+
+    int index = (int)(percentile*(latencies.count() - 1) + 0.5);
+    return latencies.at(index)/1e3;
+}
+
+QByteArray DaoBenchmark::toJson(const QList<QVariantMap> &results)
+{
+    QByteArray json = "{\n  \"version\": \"" + QByteArray(APP_VERSION) + "\",\n  \"results\": [";
+    for (int i = 0; i < results.count(); i++) {
+        json += (i == 0) ? "\n    {" : ",\n    {";
+
+        const QVariantMap &result = results.at(i);
+        QVariantMap::const_iterator it;
+        for (it = result.constBegin(); it != result.constEnd(); ++it) {
+            if (it != result.constBegin())
+                json += ", ";
+            json += "\"" + it.key().toUtf8() + "\": ";
+            if (it.value().type() == QVariant::String)
+                json += "\"" + it.value().toString().toUtf8() + "\"";
+            else
+                json += it.value().toString().toUtf8();
+        }
+
+        json += "}";
+    }
+    json += "\n  ]\n}\n";
+    return json;
+}
@@ -0,0 +1,89 @@
+/*!
+ * \file daobenchmark.h
+ * \brief measures DownloadDAO throughput under several SQLite profiles
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#ifndef DAOBENCHMARK_H
+#define DAOBENCHMARK_H
+
+#include <QString>
+#include <QList>
+#include <QVector>
+#include <QVariantMap>
+
+class DBConnection;
+
+/*!
+ * \brief How the database is configured while the operations run
+ */
+struct DaoProfile
+{
+    QString name;
+    bool wal; // journal_mode=WAL and synchronous=NORMAL instead of the SQLite defaults
+    int batchSize; // number of operations per explicit transaction, 1 to leave every statement in autocommit
+};
+
+/*!
+ * \brief Runs addDownload, updateDownload, getDownloadByContactId and
+ * deleteDownloadContact over a fresh temporary database.
+ *
+ * Every operation is timed on its own. In the transactional profiles the
+ * commit is charged to the operation closing the batch, so the tail latency
+ * shows the cost of the fsync where the callers would see it.
+ */
+class DaoBenchmark
+{
+public:
+    DaoBenchmark();
+
+    /*!
+     * \brief Get the built-in profiles: default, wal, transactional and batched
+     */
+    static QList<DaoProfile> getProfiles();
+
+    /*!
+     * \brief Run every operation of a profile
+     * \param profile: the database configuration
+     * \param rowCount: number of rows added, updated, looked up and deleted
+     * \returns one result per operation: profile, rows, operation, ops, failed, seconds,
+     * opsPerSecond, p50Us and p99Us
+     */
+    QList<QVariantMap> run(const DaoProfile &profile, int rowCount);
+
+    /*!
+     * \brief Format results as a JSON document
+     */
+    static QByteArray toJson(const QList<QVariantMap> &results);
+
+protected:
+
+    enum Operation {
+        AddOperation,
+        UpdateOperation,
+        LookupOperation,
+        DeleteOperation
+    };
+
+    // Run one operation rowCount times and summarize the latencies
+    QVariantMap runOperation(Operation operation, DBConnection *dbConnection, const DaoProfile &profile, int rowCount);
+
+    // Apply the pragmas of a profile
+    void configure(DBConnection *dbConnection, const DaoProfile &profile);
+
+    // Remove the database file and its journals
+    static void removeDatabase(const QString &path);
+
+    // Latency at the given percentile calculated by microsecond, latencies must be sorted
+    static double getPercentile(const QVector<qint64> &latencies, double percentile);
+
+private:
+    QVector<qint64> m_latencies; // latencies of the current operation calculated by nanosecond
+};
+
+#endif // DAOBENCHMARK_H
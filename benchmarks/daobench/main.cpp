@@ -0,0 +1,58 @@
+#include <QCoreApplication>
+#include <QStringList>
+#include <QFile>
+#include <QDebug>
+#include <stdio.h>
+#include "daobenchmark.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QStringList profileNames;
+    QList<int> rowCounts;
+    QString outputPath;
+
+    QStringList arguments = QCoreApplication::arguments();
+    for (int i = 1; i < arguments.count(); i++) {
+        if (arguments.at(i) == "--profile" && i + 1 < arguments.count()) {
+            profileNames << arguments.at(++i);
+        } else if (arguments.at(i) == "--rows" && i + 1 < arguments.count() && arguments.at(i + 1).toInt() > 0) {
+            rowCounts << arguments.at(++i).toInt();
+        } else if (arguments.at(i) == "--output" && i + 1 < arguments.count()) {
+            outputPath = arguments.at(++i);
+        } else {
+            qDebug() << "Usage: daobench [--profile default|wal|transactional|batched]... [--rows <count>]... [--output <json file>]";
+            return 1;
+        }
+    }
+
+    // A day of playlist imports, then a large backlog
+    if (rowCounts.isEmpty())
+        rowCounts << 1000 << 10000;
+
+    DaoBenchmark benchmark;
+    QList<QVariantMap> results;
+
+    QList<DaoProfile> profiles = DaoBenchmark::getProfiles();
+    for (int i = 0; i < profiles.count(); i++) {
+        if (!profileNames.isEmpty() && !profileNames.contains(profiles.at(i).name))
+            continue;
+        for (int j = 0; j < rowCounts.count(); j++)
+            results << benchmark.run(profiles.at(i), rowCounts.at(j));
+    }
+
+    QByteArray json = DaoBenchmark::toJson(results);
+    if (outputPath.isEmpty()) {
+        fwrite(json.constData(), 1, json.size(), stdout);
+        return 0;
+    }
+
+    QFile output(outputPath);
+    if (!output.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qDebug() << "Could not write " << outputPath;
+        return 1;
+    }
+    output.write(json);
+    return 0;
+}
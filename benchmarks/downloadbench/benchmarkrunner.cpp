@@ -0,0 +1,275 @@
+/*!
+ * \file benchmarkrunner.cpp
+ * \brief runs download scenarios against the loopback server
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#include "benchmarkrunner.h"
+#include "downloadmanager.h"
+#include "common.h"
+#include <QCoreApplication>
+#include <QEventLoop>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QDir>
+#include <QTimer>
+#include <QProcess>
+#include <QDebug>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#ifndef APP_VERSION
+#define APP_VERSION "unknown"
+#endif
+
+static const int SCENARIO_TIMEOUT = 30*60; // give up a scenario after this delay calculated by second
+static const int SERVER_START_TIMEOUT = 10; // delay for the server process to give its port calculated by second
+
+// Remove a directory and its content
+static void removeDirectory(const QString &path)
+{
+    QDir dir(path);
+    foreach(QFileInfo info, dir.entryInfoList(QDir::NoDotAndDotDot | QDir::AllEntries | QDir::Hidden)) {
+        if (info.isDir())
+            removeDirectory(info.absoluteFilePath());
+        else
+            QFile::remove(info.absoluteFilePath());
+    }
+    dir.rmdir(path);
+}
+
+// User plus system cpu time of the process calculated by second
+static double getCpuSeconds(const struct rusage &usage)
+{
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec/1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec/1e6;
+}
+
+BenchmarkRunner::BenchmarkRunner(QObject *parent) :
+    QObject(parent)
+{
+    m_eventLoop = 0;
+    m_remainingCount = 0;
+    m_failedCount = 0;
+    m_bytesDownloaded = 0;
+
+    m_serverProcess = 0;
+    m_serverPort = 0;
+}
+
+BenchmarkRunner::~BenchmarkRunner()
+{
+    stopServer();
+}
+
+bool BenchmarkRunner::startServer(const LoopbackSettings &settings)
+{
+    stopServer();
+
+    m_serverProcess = new QProcess(this);
+    Q_ASSERT(m_serverProcess != 0);
+    m_serverProcess->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+    m_serverProcess->start(QCoreApplication::applicationFilePath(), QStringList() << "--serve" << settings.toArguments());
+
+    // The server writes its port on the first line
+    while (!m_serverProcess->canReadLine()) {
+        if (!m_serverProcess->waitForReadyRead(SERVER_START_TIMEOUT*1000)) {
+            qDebug() << __PRETTY_FUNCTION__ << " Could not start the loopback server: " << m_serverProcess->errorString();
+            stopServer();
+            return false;
+        }
+    }
+
+    m_serverPort = m_serverProcess->readLine().trimmed().toUShort();
+    return m_serverPort != 0;
+}
+
+void BenchmarkRunner::stopServer()
+{
+    if (m_serverProcess == 0)
+        return;
+
+    m_serverProcess->kill();
+    m_serverProcess->waitForFinished();
+    delete m_serverProcess;
+    m_serverProcess = 0;
+    m_serverPort = 0;
+}
+
+QList<BenchmarkScenario> BenchmarkRunner::getScenarios()
+{
+    QList<BenchmarkScenario> scenarios;
+
+    BenchmarkScenario small;
+    small.name = "small";
+    small.fileCount = 500;
+    small.sizes << 16*1024;
+    small.settings.latency = 5;
+    scenarios << small;
+
+    BenchmarkScenario huge;
+    huge.name = "huge";
+    huge.fileCount = 3;
+    huge.sizes << 128*1024*1024;
+    scenarios << huge;
+
+    BenchmarkScenario mixed;
+    mixed.name = "mixed";
+    mixed.fileCount = 200;
+    mixed.sizes << 16*1024 << 256*1024 << 4*1024*1024;
+    mixed.settings.latency = 5;
+    mixed.settings.bandwidth = 32*1024*1024;
+    scenarios << mixed;
+
+    BenchmarkScenario flaky;
+    flaky.name = "flaky";
+    flaky.fileCount = 100;
+    flaky.sizes << 256*1024;
+    flaky.settings.latency = 20;
+    flaky.settings.errorRate = 0.2;
+    scenarios << flaky;
+
+    return scenarios;
+}
+
+QVariantMap BenchmarkRunner::run(const BenchmarkScenario &scenario)
+{
+    // Downloads are saved under HOME
+    QString workDirectory = QString("%1/downloadbench-%2-%3").arg(QDir::tempPath()).arg(::getpid()).arg(scenario.name);
+    removeDirectory(workDirectory);
+    QDir().mkpath(workDirectory);
+    qputenv("HOME", QFile::encodeName(workDirectory));
+
+    m_remainingCount = scenario.fileCount;
+    m_failedCount = 0;
+    m_bytesDownloaded = 0;
+
+    QVariantMap result;
+    result.insert("name", scenario.name);
+
+    struct rusage serverUsageBefore;
+    ::getrusage(RUSAGE_CHILDREN, &serverUsageBefore);
+    if (!startServer(scenario.settings)) {
+        removeDirectory(workDirectory);
+        result.insert("error", "could not start the loopback server");
+        return result;
+    }
+
+    struct rusage usageBefore;
+    ::getrusage(RUSAGE_SELF, &usageBefore);
+    QElapsedTimer elapsedTimer;
+    elapsedTimer.start();
+
+    {
+        DownloadManager downloadManager;
+        downloadManager.setDBStoragePath(workDirectory + "/downloadbench.sqlite");
+        downloadManager.setRetryPolicy(DOWNLOAD_MAX_RETRIES, 1, 2);
+
+        // The manager emits from its own thread, the results are queued to this thread
+        connect(&downloadManager, SIGNAL(downloadFinished(int,int,QString,int)), this, SLOT(onDownloadFinished(int,int,QString,int)));
+        connect(&downloadManager, SIGNAL(downloadError(int,int)), this, SLOT(onDownloadError(int,int)));
+        connect(&downloadManager, SIGNAL(contactDownloadError(int,int)), this, SLOT(onContactDownloadError(int,int)));
+
+        for (int i = 0; i < scenario.fileCount; i++) {
+            qint64 size = scenario.sizes.at(i % scenario.sizes.count());
+            downloadManager.addUrl(LoopbackHttpServer::getUrl(m_serverPort, QString("file%1").arg(i), size), i + 1);
+        }
+
+        QEventLoop eventLoop;
+        m_eventLoop = &eventLoop;
+        QTimer::singleShot(SCENARIO_TIMEOUT*1000, &eventLoop, SLOT(quit()));
+        if (m_remainingCount > 0)
+            eventLoop.exec();
+        m_eventLoop = 0;
+    }
+
+    double seconds = qMax(elapsedTimer.elapsed(), (qint64)1)/1000.0;
+    struct rusage usageAfter;
+    ::getrusage(RUSAGE_SELF, &usageAfter);
+
+    stopServer();
+    struct rusage serverUsageAfter;
+    ::getrusage(RUSAGE_CHILDREN, &serverUsageAfter);
+
+    removeDirectory(workDirectory);
+
+    int files = scenario.fileCount - m_remainingCount - m_failedCount;
+
+    result.insert("files", files);
+    result.insert("failed", m_failedCount);
+    result.insert("timedOut", m_remainingCount);
+    result.insert("bytes", m_bytesDownloaded);
+    result.insert("seconds", seconds);
+    result.insert("filesPerSecond", files/seconds);
+    result.insert("megabytesPerSecond", m_bytesDownloaded/seconds/(1024*1024));
+    result.insert("cpuSeconds", getCpuSeconds(usageAfter) - getCpuSeconds(usageBefore));
+    // High water mark of the whole process, it never goes down between scenarios
+    result.insert("peakRssKb", (qint64)usageAfter.ru_maxrss);
+    // Cost of the loopback server, measured apart from the engine
+    result.insert("serverCpuSeconds", getCpuSeconds(serverUsageAfter) - getCpuSeconds(serverUsageBefore));
+
+    qDebug() << __PRETTY_FUNCTION__ << scenario.name << ": " << files << " files in " << seconds << " s";
+    return result;
+}
+
+void BenchmarkRunner::onDownloadFinished(int contactId, int downloadId, const QString &filePath, int urlType)
+{
+    Q_UNUSED(contactId);
+    Q_UNUSED(downloadId);
+    Q_UNUSED(urlType);
+
+    m_bytesDownloaded += QFileInfo(filePath).size();
+    completeFile(true);
+}
+
+void BenchmarkRunner::onDownloadError(int downloadId, int errorCode)
+{
+    qDebug() << __PRETTY_FUNCTION__ << "downloadId = " << downloadId << ", errorCode = " << errorCode;
+    completeFile(false);
+}
+
+void BenchmarkRunner::onContactDownloadError(int contactId, int errorCode)
+{
+    qDebug() << __PRETTY_FUNCTION__ << "contactId = " << contactId << ", errorCode = " << errorCode;
+    completeFile(false);
+}
+
+void BenchmarkRunner::completeFile(bool succeeded)
+{
+    if (m_eventLoop == 0 || m_remainingCount == 0)
+        return;
+
+    if (!succeeded)
+        m_failedCount++;
+
+    if (--m_remainingCount == 0)
+        m_eventLoop->quit();
+}
+
+QByteArray BenchmarkRunner::toJson(const QList<QVariantMap> &results)
+{
+    QByteArray json = "{\n  \"version\": \"" + QByteArray(APP_VERSION) + "\",\n  \"scenarios\": [";
+    for (int i = 0; i < results.count(); i++) {
+        json += (i == 0) ? "\n    {" : ",\n    {";
+
+        const QVariantMap &result = results.at(i);
+        QVariantMap::const_iterator it;
+        for (it = result.constBegin(); it != result.constEnd(); ++it) {
+            if (it != result.constBegin())
+                json += ", ";
+            json += "\"" + it.key().toUtf8() + "\": ";
+            if (it.value().type() == QVariant::String)
+                json += "\"" + it.value().toString().toUtf8() + "\"";
+            else
+                json += it.value().toString().toUtf8();
+        }
+
+        json += "}";
+    }
+    json += "\n  ]\n}\n";
+    return json;
+}
@@ -0,0 +1,94 @@
+/*!
+ * \file benchmarkrunner.h
+ * \brief runs download scenarios against the loopback server
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#ifndef BENCHMARKRUNNER_H
+#define BENCHMARKRUNNER_H
+
+#include <QObject>
+#include <QList>
+#include <QVariantMap>
+#include "loopbackhttpserver.h"
+
+class QEventLoop;
+class QProcess;
+
+/*!
+ * \brief A set of files downloaded in one run
+ */
+struct BenchmarkScenario
+{
+    QString name;
+    int fileCount;
+    QList<qint64> sizes; // sizes of the files, used in turn
+    LoopbackSettings settings;
+};
+
+/*!
+ * \brief Drives a DownloadManager through scenarios and measures them.
+ *
+ * Every scenario runs with its own HOME, database, DownloadManager and
+ * loopback server, so files and queues of a previous run do not interfere.
+ * The server runs in a child process: the CPU time and peak RSS of the
+ * benchmark process are the ones of the engine, the server reports its own.
+ */
+class BenchmarkRunner : public QObject
+{
+    Q_OBJECT
+public:
+    explicit BenchmarkRunner(QObject *parent = 0);
+    ~BenchmarkRunner();
+
+    /*!
+     * \brief Get the built-in scenarios: small, huge, mixed and flaky
+     */
+    static QList<BenchmarkScenario> getScenarios();
+
+    /*!
+     * \brief Run a scenario
+     * \returns the measures: files, failed, bytes, seconds, filesPerSecond, megabytesPerSecond,
+     * cpuSeconds, peakRssKb and serverCpuSeconds
+     */
+    QVariantMap run(const BenchmarkScenario &scenario);
+
+    /*!
+     * \brief Format results as a JSON document
+     */
+    static QByteArray toJson(const QList<QVariantMap> &results);
+
+protected slots:
+
+    void onDownloadFinished(int contactId, int downloadId, const QString &filePath, int urlType);
+
+    void onDownloadError(int downloadId, int errorCode);
+
+    void onContactDownloadError(int contactId, int errorCode);
+
+protected:
+    // Count a completed file, leave the event loop after the last one
+    void completeFile(bool succeeded);
+
+    // Start the loopback server process of a scenario, returns false if it does not listen
+    bool startServer(const LoopbackSettings &settings);
+
+    // Stop the loopback server process and wait for it, so its cpu time is counted in RUSAGE_CHILDREN
+    void stopServer();
+
+private:
+    QProcess *m_serverProcess;
+    quint16 m_serverPort;
+
+    QEventLoop *m_eventLoop;
+    int m_remainingCount;
+    int m_failedCount;
+    qint64 m_bytesDownloaded;
+};
+
+#endif // BENCHMARKRUNNER_H
@@ -0,0 +1,31 @@
+#-------------------------------------------------
+#
+# Benchmark of the download engine against a loopback http server,
+# prints files/s, MB/s, cpu time and peak rss as JSON
+#
+#-------------------------------------------------
+
+QT       = core network sql
+
+TARGET = downloadbench
+TEMPLATE = app
+CONFIG   += console
+CONFIG   -= app_bundle
+
+include(../../downloadmanager.pri)
+
+# Tag the results with the version of the tree
+APP_VERSION = $$system(git --git-dir=$$PWD/../../.git describe --always --dirty)
+isEmpty(APP_VERSION): APP_VERSION = unknown
+DEFINES += APP_VERSION=\\\"$$APP_VERSION\\\"
+
+SOURCES += main.cpp \
+    loopbackhttpserver.cpp \
+    benchmarkrunner.cpp
+
+HEADERS  += loopbackhttpserver.h \
+    benchmarkrunner.h
+
+MOC_DIR += build/moc
+OBJECTS_DIR += build/obj
+DESTDIR += bin
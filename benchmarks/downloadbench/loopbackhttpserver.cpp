@@ -0,0 +1,272 @@
+/*!
+ * \file loopbackhttpserver.cpp
+ * \brief local http server serving generated files to the benchmarks
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#include "loopbackhttpserver.h"
+#include <QTcpSocket>
+#include <QHostAddress>
+#include <QTimer>
+#include <QList>
+#include <QDebug>
+#include <stdlib.h>
+
+static const qint64 CHUNK_SIZE = 64*1024; // bytes written per write
+static const int CONTENT_SIZE = 1024*1024 + 1; // size of the repeated pattern, odd so it does not align with the ranges
+static const qint64 MAX_PENDING_BYTES = 256*1024; // bytes queued in the socket before waiting
+static const int REFILL_INTERVAL = 10; // bandwidth refill period calculated by milisecond
+
+LoopbackSettings::LoopbackSettings()
+{
+    latency = 0;
+    bandwidth = 0;
+    rangeSupport = true;
+    errorRate = 0;
+}
+
+QStringList LoopbackSettings::toArguments() const
+{
+    QStringList arguments;
+    arguments << "--latency" << QString::number(latency)
+              << "--bandwidth" << QString::number(bandwidth)
+              << "--error-rate" << QString::number(errorRate, 'g', 17);
+    if (!rangeSupport)
+        arguments << "--no-range";
+    return arguments;
+}
+
+bool LoopbackSettings::parseArguments(const QStringList &arguments)
+{
+    for (int i = 0; i < arguments.count(); i++) {
+        if (arguments.at(i) == "--latency" && i + 1 < arguments.count())
+            latency = arguments.at(++i).toInt();
+        else if (arguments.at(i) == "--bandwidth" && i + 1 < arguments.count())
+            bandwidth = arguments.at(++i).toLongLong();
+        else if (arguments.at(i) == "--error-rate" && i + 1 < arguments.count())
+            errorRate = arguments.at(++i).toDouble();
+        else if (arguments.at(i) == "--no-range")
+            rangeSupport = false;
+        else
+            return false;
+    }
+
+    return true;
+}
+
+LoopbackHttpServer::LoopbackHttpServer(QObject *parent) :
+    QTcpServer(parent)
+{
+}
+
+bool LoopbackHttpServer::start()
+{
+    return listen(QHostAddress::LocalHost, 0);
+}
+
+void LoopbackHttpServer::setSettings(const LoopbackSettings &settings)
+{
+    m_settings = settings;
+}
+
+QString LoopbackHttpServer::getUrl(quint16 port, const QString &name, qint64 size, const QString &extension)
+{
+    return QString("http://127.0.0.1:%1/%2-%3%4").arg(port).arg(name).arg(size).arg(extension);
+}
+
+const QByteArray &LoopbackHttpServer::getContent()
+{
+    static QByteArray content;
+    if (content.isEmpty()) {
+        content.resize(CONTENT_SIZE);
+        char *data = content.data();
+        for (int i = 0; i < CONTENT_SIZE; i++)
+            data[i] = (char)((i*31) ^ (i >> 11));
+    }
+
+    return content;
+}
+
+void LoopbackHttpServer::incomingConnection(int socketDescriptor)
+{
+    new LoopbackHttpConnection(socketDescriptor, m_settings, this);
+}
+
+LoopbackHttpConnection::LoopbackHttpConnection(int socketDescriptor, const LoopbackSettings &settings, QObject *parent) :
+    QObject(parent)
+{
+    m_settings = settings;
+    m_busy = false;
+    m_position = 0;
+    m_end = 0;
+    m_failAt = -1;
+    m_budget = 0;
+
+    m_content = LoopbackHttpServer::getContent();
+
+    m_socket = new QTcpSocket(this);
+    Q_ASSERT(m_socket != 0);
+    m_socket->setSocketDescriptor(socketDescriptor);
+    connect(m_socket, SIGNAL(readyRead()), this, SLOT(slotReadyRead()));
+    connect(m_socket, SIGNAL(bytesWritten(qint64)), this, SLOT(slotPump()));
+    connect(m_socket, SIGNAL(disconnected()), this, SLOT(slotDisconnected()));
+
+    m_refillTimer = new QTimer(this);
+    Q_ASSERT(m_refillTimer != 0);
+    m_refillTimer->setInterval(REFILL_INTERVAL);
+    connect(m_refillTimer, SIGNAL(timeout()), this, SLOT(slotRefill()));
+    if (m_settings.bandwidth > 0)
+        m_refillTimer->start();
+}
+
+void LoopbackHttpConnection::slotReadyRead()
+{
+    m_buffer.append(m_socket->readAll());
+    if (!m_busy && parseRequest()) {
+        m_busy = true;
+        QTimer::singleShot(m_settings.latency, this, SLOT(slotRespond()));
+    }
+}
+
+bool LoopbackHttpConnection::parseRequest()
+{
+    int headerEnd = m_buffer.indexOf("\r\n\r\n");
+    if (headerEnd < 0)
+        return false;
+
+    QList<QByteArray> lines = m_buffer.left(headerEnd).split('\n');
+    m_buffer.remove(0, headerEnd + 4);
+
+    // GET /path HTTP/1.1
+    QList<QByteArray> requestLine = lines.value(0).trimmed().split(' ');
+    m_path = requestLine.value(1);
+    m_range.clear();
+
+    for (int i = 1; i < lines.count(); i++) {
+        QByteArray line = lines.at(i).trimmed();
+        if (line.toLower().startsWith("range:"))
+            m_range = line.mid(6).trimmed();
+    }
+
+    return true;
+}
+
+void LoopbackHttpConnection::writeStatus(int statusCode, const QByteArray &reason)
+{
+    m_socket->write("HTTP/1.1 " + QByteArray::number(statusCode) + " " + reason + "\r\n"
+                    "Content-Length: 0\r\nConnection: keep-alive\r\n\r\n");
+}
+
+void LoopbackHttpConnection::slotRespond()
+{
+    // The size is the number after the last dash of the name
+    int dash = m_path.lastIndexOf('-');
+    int dot = m_path.lastIndexOf('.');
+    bool ok = false;
+    qint64 size = (dash >= 0 && dot > dash) ? m_path.mid(dash + 1, dot - dash - 1).toLongLong(&ok) : -1;
+    if (!ok || size < 0) {
+        writeStatus(404, "Not Found");
+        m_busy = false;
+        slotReadyRead();
+        return;
+    }
+
+    m_failAt = -1;
+    if (m_settings.errorRate > 0 && qrand() < m_settings.errorRate*RAND_MAX) {
+        if (qrand() % 2 == 0) {
+            writeStatus(503, "Service Unavailable");
+            m_busy = false;
+            slotReadyRead();
+            return;
+        }
+        m_failAt = size/2;
+    }
+
+    m_position = 0;
+    m_end = size;
+    int statusCode = 200;
+
+    // Range: bytes=first-[last]
+    if (m_settings.rangeSupport && m_range.startsWith("bytes=")) {
+        QList<QByteArray> bounds = m_range.mid(6).split('-');
+        qint64 first = bounds.value(0).toLongLong();
+        qint64 last = bounds.value(1).isEmpty() ? size - 1 : bounds.value(1).toLongLong();
+        if (first >= size || last < first) {
+            writeStatus(416, "Requested Range Not Satisfiable");
+            m_busy = false;
+            slotReadyRead();
+            return;
+        }
+        m_position = first;
+        m_end = qMin(last + 1, size);
+        statusCode = 206;
+    }
+
+    QByteArray header = "HTTP/1.1 " + QByteArray::number(statusCode) + (statusCode == 206 ? " Partial Content" : " OK") + "\r\n";
+    header += "Content-Type: application/octet-stream\r\n";
+    header += "Content-Length: " + QByteArray::number(m_end - m_position) + "\r\n";
+    if (statusCode == 206)
+        header += "Content-Range: bytes " + QByteArray::number(m_position) + "-" + QByteArray::number(m_end - 1)
+                + "/" + QByteArray::number(size) + "\r\n";
+    if (m_settings.rangeSupport)
+        header += "Accept-Ranges: bytes\r\n";
+    header += "Connection: keep-alive\r\n\r\n";
+    m_socket->write(header);
+
+    slotPump();
+}
+
+void LoopbackHttpConnection::slotPump()
+{
+    if (!m_busy)
+        return;
+
+    while (m_position < m_end && m_socket->bytesToWrite() < MAX_PENDING_BYTES) {
+        if (m_failAt >= 0 && m_position >= m_failAt) {
+            m_socket->abort();
+            return;
+        }
+
+        qint64 size = qMin(CHUNK_SIZE, m_end - m_position);
+        if (m_failAt >= 0)
+            size = qMin(size, qMax(m_failAt - m_position, (qint64)1));
+        if (m_settings.bandwidth > 0) {
+            size = qMin(size, m_budget);
+            if (size <= 0)
+                return; // wait for the next refill
+        }
+
+        // Write straight from the pattern, a write does not wrap around its end
+        int offset = (int)(m_position % m_content.size());
+        size = qMin(size, (qint64)(m_content.size() - offset));
+        if (m_settings.bandwidth > 0)
+            m_budget -= size;
+
+        m_socket->write(m_content.constData() + offset, size);
+        m_position += size;
+    }
+
+    if (m_position >= m_end) {
+        // Ready for the next request of the connection
+        m_busy = false;
+        if (!m_buffer.isEmpty() || m_socket->bytesAvailable() > 0)
+            slotReadyRead();
+    }
+}
+
+void LoopbackHttpConnection::slotRefill()
+{
+    m_budget = m_settings.bandwidth*REFILL_INTERVAL/1000;
+    slotPump();
+}
+
+void LoopbackHttpConnection::slotDisconnected()
+{
+    m_busy = false;
+    deleteLater();
+}
@@ -0,0 +1,145 @@
+/*!
+ * \file loopbackhttpserver.h
+ * \brief local http server serving generated files to the benchmarks
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#ifndef LOOPBACKHTTPSERVER_H
+#define LOOPBACKHTTPSERVER_H
+
+#include <QTcpServer>
+#include <QByteArray>
+#include <QStringList>
+
+class QTcpSocket;
+class QTimer;
+
+/*!
+ * \brief Behaviour of the loopback server
+ */
+struct LoopbackSettings
+{
+    LoopbackSettings();
+
+    int latency; // delay before each response calculated by milisecond
+    qint64 bandwidth; // cap per connection calculated by byte/s, 0 for no cap
+    bool rangeSupport; // true to honour Range requests and advertise Accept-Ranges
+    double errorRate; // probability to fail a request, half with a 503 and half by closing the connection mid-body
+
+    /*!
+     * \brief Get the command line options of the server process for these settings
+     */
+    QStringList toArguments() const;
+
+    /*!
+     * \brief Read the settings from the command line options of the server process
+     * \returns true if every option is known, otherwise returns false
+     */
+    bool parseArguments(const QStringList &arguments);
+};
+
+/*!
+ * \brief HTTP/1.1 server on 127.0.0.1 serving generated content.
+ *
+ * The size of a file is part of its name: /<name>-<size>.<extension>, e.g.
+ * /file12-65536.ogg. The content repeats a pattern generated once, so any
+ * range is served from memory without storing the files.
+ * \note the benchmark runs it in a child process, see BenchmarkRunner, so its
+ * cost is not counted as the one of the engine
+ */
+class LoopbackHttpServer : public QTcpServer
+{
+    Q_OBJECT
+public:
+    explicit LoopbackHttpServer(QObject *parent = 0);
+
+    /*!
+     * \brief Start listening on a free loopback port
+     * \returns true if the server listens, otherwise returns false
+     */
+    bool start();
+
+    /*!
+     * \brief Set the behaviour for the next requests
+     */
+    void setSettings(const LoopbackSettings &settings);
+
+    /*!
+     * \brief Get the url of a generated file
+     * \param port: port of the server
+     * \param name: unique name of the file
+     * \param size: size of the file calculated by byte
+     * \param extension: extension including the dot, it selects the url type
+     */
+    static QString getUrl(quint16 port, const QString &name, qint64 size, const QString &extension = ".ogg");
+
+    /*!
+     * \brief Get the pattern repeated by every generated file, the byte at offset is at offset % its size
+     */
+    static const QByteArray &getContent();
+
+protected:
+    void incomingConnection(int socketDescriptor);
+
+private:
+    LoopbackSettings m_settings;
+};
+
+/*!
+ * \brief One client connection of the loopback server, handles keep-alive requests in sequence
+ */
+class LoopbackHttpConnection : public QObject
+{
+    Q_OBJECT
+public:
+    LoopbackHttpConnection(int socketDescriptor, const LoopbackSettings &settings, QObject *parent = 0);
+
+protected slots:
+    // Slot when the client sent data
+    void slotReadyRead();
+
+    // Send the status line and headers once the latency elapsed
+    void slotRespond();
+
+    // Write more of the body
+    void slotPump();
+
+    // Refill the bandwidth budget
+    void slotRefill();
+
+    // Slot when the client closed the connection
+    void slotDisconnected();
+
+protected:
+    // Parse a complete request from the buffer, returns false if there is none yet
+    bool parseRequest();
+
+    // Write a response without body
+    void writeStatus(int statusCode, const QByteArray &reason);
+
+private:
+    QTcpSocket *m_socket;
+    LoopbackSettings m_settings;
+
+    QByteArray m_buffer; // received bytes not parsed yet
+    bool m_busy; // true while a request is being answered
+
+    QByteArray m_path;
+    QByteArray m_range;
+
+    qint64 m_position; // next byte of the body to write
+    qint64 m_end; // byte following the body
+    qint64 m_failAt; // offset where the connection is closed, -1 to serve the whole body
+
+    QTimer *m_refillTimer;
+    qint64 m_budget; // bytes allowed until the next refill
+
+    QByteArray m_content; // shared copy of the generated pattern
+};
+
+#endif // LOOPBACKHTTPSERVER_H
@@ -0,0 +1,76 @@
+#include <QCoreApplication>
+#include <QStringList>
+#include <QFile>
+#include <QDebug>
+#include <stdio.h>
+#include "benchmarkrunner.h"
+#include "loopbackhttpserver.h"
+
+// Serve the generated files until killed, BenchmarkRunner starts this mode in a child process
+static int serve(const QStringList &arguments)
+{
+    LoopbackSettings settings;
+    if (!settings.parseArguments(arguments)) {
+        qDebug() << "Usage: downloadbench --serve [--latency <ms>] [--bandwidth <byte/s>] [--error-rate <0..1>] [--no-range]";
+        return 1;
+    }
+
+    LoopbackHttpServer server;
+    server.setSettings(settings);
+    if (!server.start()) {
+        qDebug() << "Could not listen: " << server.errorString();
+        return 1;
+    }
+
+    // The parent reads the port on the first line
+    printf("%d\n", server.serverPort());
+    fflush(stdout);
+
+    return QCoreApplication::exec();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QStringList scenarioNames;
+    QString outputPath;
+
+    QStringList arguments = QCoreApplication::arguments();
+    if (arguments.value(1) == "--serve")
+        return serve(arguments.mid(2));
+
+    for (int i = 1; i < arguments.count(); i++) {
+        if (arguments.at(i) == "--scenario" && i + 1 < arguments.count()) {
+            scenarioNames << arguments.at(++i);
+        } else if (arguments.at(i) == "--output" && i + 1 < arguments.count()) {
+            outputPath = arguments.at(++i);
+        } else {
+            qDebug() << "Usage: downloadbench [--scenario small|huge|mixed|flaky]... [--output <json file>]";
+            return 1;
+        }
+    }
+
+    BenchmarkRunner runner;
+    QList<QVariantMap> results;
+
+    QList<BenchmarkScenario> scenarios = BenchmarkRunner::getScenarios();
+    for (int i = 0; i < scenarios.count(); i++) {
+        if (scenarioNames.isEmpty() || scenarioNames.contains(scenarios.at(i).name))
+            results << runner.run(scenarios.at(i));
+    }
+
+    QByteArray json = BenchmarkRunner::toJson(results);
+    if (outputPath.isEmpty()) {
+        fwrite(json.constData(), 1, json.size(), stdout);
+        return 0;
+    }
+
+    QFile output(outputPath);
+    if (!output.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qDebug() << "Could not write " << outputPath;
+        return 1;
+    }
+    output.write(json);
+    return 0;
+}
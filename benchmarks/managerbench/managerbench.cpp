@@ -0,0 +1,261 @@
+/*!
+ * \file managerbench.cpp
+ * \brief microbenchmarks of the scheduler and lookups of DownloadManagerImpl
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#include <QtTest/QtTest>
+#include <QElapsedTimer>
+#include "downloadmanagerimpl.h"
+#include "download.h"
+
+// Number of timed operations of the benchmarks that change the queue
+const int BENCH_ITERATIONS = 1000;
+
+/*!
+ * \brief Gives the benchmarks access to the protected lookups
+ */
+class BenchDownloadManagerImpl : public DownloadManagerImpl
+{
+public:
+    using DownloadManagerImpl::getDownloadByDownloadId;
+    using DownloadManagerImpl::removeDownloadById;
+    using DownloadManagerImpl::takeNextDownload;
+};
+
+/*!
+ * \brief Benchmarks at queue sizes from 10 to 1M downloads.
+ *
+ * The downloads are never started: the max number of running downloads is 0
+ * and the database lives in memory, so only the manager itself is measured.
+ * A benchmark changing the queue undoes every operation out of the measure, so
+ * the queue keeps its size. Set MANAGERBENCH_MAX_SIZE to skip the largest queues.
+ */
+class ManagerBenchmark : public QObject
+{
+    Q_OBJECT
+public:
+    ManagerBenchmark();
+
+private slots:
+    void addUrl_data();
+    void addUrl();
+
+    void getUrlTypeByContactId_data();
+    void getUrlTypeByContactId();
+
+    void getDownloadByDownloadId_data();
+    void getDownloadByDownloadId();
+
+    void removeDownloadById_data();
+    void removeDownloadById();
+
+    void takeNextDownload_data();
+    void takeNextDownload();
+
+    void getUrlTypeByUrl_data();
+    void getUrlTypeByUrl();
+
+    void cleanup();
+
+private:
+    // Add the queue sizes as data rows
+    void addSizes();
+
+    // Create a manager with a queue of count downloads
+    void populate(int count);
+
+    // Report the mean of the timed operations, QBENCHMARK cannot leave the undo out of the measure
+    void setResult(qint64 elapsed, int iterations);
+
+    BenchDownloadManagerImpl *m_manager;
+    int m_nextContactId;
+};
+
+ManagerBenchmark::ManagerBenchmark()
+{
+    m_manager = 0;
+    m_nextContactId = 1;
+}
+
+void ManagerBenchmark::addSizes()
+{
+    int maxSize = 1000000;
+    QByteArray maxSizeValue = qgetenv("MANAGERBENCH_MAX_SIZE");
+    if (!maxSizeValue.isEmpty())
+        maxSize = maxSizeValue.toInt();
+
+    QTest::addColumn<int>("size");
+    for (int size = 10; size <= maxSize; size *= 10)
+        QTest::newRow(QByteArray::number(size).constData()) << size;
+}
+
+void ManagerBenchmark::populate(int count)
+{
+    m_manager = new BenchDownloadManagerImpl();
+    QVERIFY(m_manager != 0);
+    m_manager->setDBStoragePath(":memory:");
+    m_manager->setMaxConcurrentDownloads(0);
+
+    for (m_nextContactId = 1; m_nextContactId <= count; m_nextContactId++)
+        m_manager->addUrl(QString("http://localhost/file%1.ogg").arg(m_nextContactId), m_nextContactId);
+}
+
+void ManagerBenchmark::setResult(qint64 elapsed, int iterations)
+{
+    QTest::setBenchmarkResult((qreal)elapsed/iterations/1000000, QTest::WalltimeMilliseconds);
+}
+
+void ManagerBenchmark::cleanup()
+{
+    delete m_manager;
+    m_manager = 0;
+
+    // Downloads removed by the benchmarks are deleted later
+    QCoreApplication::sendPostedEvents(0, QEvent::DeferredDelete);
+}
+
+void ManagerBenchmark::addUrl_data()
+{
+    addSizes();
+}
+
+void ManagerBenchmark::addUrl()
+{
+    QFETCH(int, size);
+    populate(size);
+
+    // Add one more download and remove it again, the fresh database gives the ids in order
+    QElapsedTimer timer;
+    qint64 elapsed = 0;
+    int downloadId = size + 1;
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        timer.start();
+        m_manager->addUrl(QString("http://localhost/file%1.ogg").arg(m_nextContactId), m_nextContactId);
+        elapsed += timer.nsecsElapsed();
+
+        QVERIFY(m_manager->removeDownloadById(downloadId));
+        downloadId++;
+        m_nextContactId++;
+    }
+    setResult(elapsed, BENCH_ITERATIONS);
+}
+
+void ManagerBenchmark::getUrlTypeByContactId_data()
+{
+    addSizes();
+}
+
+void ManagerBenchmark::getUrlTypeByContactId()
+{
+    QFETCH(int, size);
+    populate(size);
+
+    // The last download, answered by the queued table without the database. getDownloadByContactId()
+    // only scans the started downloads since the queue keeps its values in the table, this is the
+    // contact lookup that depends on the queue size
+    QBENCHMARK {
+        QVERIFY(m_manager->getUrlTypeByContactId(size) != DownloadManager::UnknownType);
+    }
+}
+
+void ManagerBenchmark::getDownloadByDownloadId_data()
+{
+    addSizes();
+}
+
+void ManagerBenchmark::getDownloadByDownloadId()
+{
+    QFETCH(int, size);
+    populate(size);
+
+    // The last download, the fresh database gives the ids in order
+    QBENCHMARK {
+        QVERIFY(m_manager->getDownloadByDownloadId(size) != 0);
+    }
+}
+
+void ManagerBenchmark::removeDownloadById_data()
+{
+    addSizes();
+}
+
+void ManagerBenchmark::removeDownloadById()
+{
+    QFETCH(int, size);
+    populate(size);
+
+    // Remove the last download and queue it again, its contact keeps the same download id
+    int downloadId = size;
+    QVERIFY(m_manager->getDownloadStatus(downloadId) == DownloadManager::Queueing);
+    QElapsedTimer timer;
+    qint64 elapsed = 0;
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        timer.start();
+        bool removed = m_manager->removeDownloadById(downloadId);
+        elapsed += timer.nsecsElapsed();
+
+        QVERIFY(removed);
+        m_manager->addUrl(QString("http://localhost/file%1.ogg").arg(size), size);
+    }
+    setResult(elapsed, BENCH_ITERATIONS);
+}
+
+void ManagerBenchmark::takeNextDownload_data()
+{
+    addSizes();
+}
+
+void ManagerBenchmark::takeNextDownload()
+{
+    QFETCH(int, size);
+    populate(size);
+
+    // The dequeue step of checkDownloadQueue(), starting the thread does not depend on the queue size.
+    // Nothing runs, the lists are only used by this thread. The download goes back at the end of the queue
+    QElapsedTimer timer;
+    qint64 elapsed = 0;
+    for (int i = 0; i < BENCH_ITERATIONS; i++) {
+        timer.start();
+        Download *download = m_manager->takeNextDownload();
+        elapsed += timer.nsecsElapsed();
+
+        QVERIFY(download != 0);
+        int contactId = download->getContact()->getId();
+        QString url = download->getUrl();
+        delete download;
+        m_manager->addUrl(url, contactId);
+    }
+    setResult(elapsed, BENCH_ITERATIONS);
+}
+
+void ManagerBenchmark::getUrlTypeByUrl_data()
+{
+    addSizes();
+}
+
+void ManagerBenchmark::getUrlTypeByUrl()
+{
+    QFETCH(int, size);
+    populate(size);
+
+    QStringList urls;
+    urls << "http://localhost/music/file.mp3" << "http://localhost/video/file.avi"
+         << "http://localhost/apps/file.wgt" << "http://localhost/lists/file.pls"
+         << "http://localhost/unknown/file.txt" << "http://localhost/music/FILE.MP3?token=a.b#t=10"
+         << "http://localhost/stream";
+
+    QBENCHMARK {
+        for (int i = 0; i < urls.count(); i++)
+            m_manager->getUrlTypeByUrl(urls.at(i));
+    }
+}
+
+QTEST_MAIN(ManagerBenchmark)
+
+#include "managerbench.moc"
@@ -0,0 +1,20 @@
+#-------------------------------------------------
+#
+# QTestLib microbenchmarks of the scheduler and lookups
+#
+#-------------------------------------------------
+
+QT       = core network sql testlib
+
+TARGET = managerbench
+TEMPLATE = app
+CONFIG   += console
+CONFIG   -= app_bundle
+
+include(../../downloadmanager.pri)
+
+SOURCES += managerbench.cpp
+
+MOC_DIR += build/moc
+OBJECTS_DIR += build/obj
+DESTDIR += bin
@@ -18,10 +18,72 @@ const int MAX_CONCURRENT_DOWNLOAD_THREADS = 3;
 
 const QString SAVED_DOWNLOAD_DIRECTORY = "/.picphone/Downloads/";
 
+const QString MEDIA_TYPES_FILE = "/.picphone/mediatypes.ini"; // supported types and their policies, inside the home directory
+
+const int SNIFF_MAX_BYTES = 4096; // bytes of content inspected to classify a download without a known extension
+
+const int PLAYLIST_INSERT_BATCH = 256; // entries of an expanded playlist inserted per database transaction
+
+const int PLAYLIST_MAX_LINE_LENGTH = 8192; // longer playlist lines are skipped, calculated by byte
+
+const QString CONTENT_STORE_DIRECTORY = ".store/"; // objects of the content store, inside SAVED_DOWNLOAD_DIRECTORY
+
 const QString DOWNLOAD_TABLE_NAME = "download";
 
+const QString DOWNLOAD_CACHE_TABLE_NAME = "download_cache";
+
 const int DOWNLOAD_PROGRESS_INTERVAL = 5; // interval to emit progress signal of a download thread calculated by second
 
 const int DOWNLOAD_TIMEOUT = 90; // download timeout of a download thread calculated by second
 
+const int SPEED_SAMPLE_INTERVAL = 500; // min interval between two speed samples calculated by milisecond
+
+const int SPEED_SMOOTHING_WINDOW = 3000; // time constant of the smoothed download speed calculated by milisecond
+
+const int DOWNLOAD_MAX_RETRIES = 5; // max number of retries of a download failed by a transient error
+
+const int DOWNLOAD_RETRY_BASE_DELAY = 2; // delay before the first retry calculated by second
+
+const int DOWNLOAD_RETRY_MAX_DELAY = 300; // upper bound of the delay between retries calculated by second
+
+const int MIRROR_RACE_BYTES = 256*1024; // bytes a mirror must deliver first to win the mirror race
+
+const int DOWNLOAD_SEGMENT_COUNT = 4; // max number of connections sharing one download
+
+const qint64 DOWNLOAD_SEGMENT_MIN_SIZE = 1024*1024; // min size of a range given to a connection calculated by byte
+
+const qint64 STREAMING_TAIL_SIZE = 1024*1024; // end of a streamed file fetched early, containers may keep their index there, calculated by byte
+
+const qint64 STREAMING_WATERMARK_STEP = 256*1024; // min growth of the playable bytes between two notifications calculated by byte
+
+const qint64 STREAMING_SEEK_THRESHOLD = 512*1024; // a seek closer than this to the running position waits for the data, calculated by byte
+
+const int TIMER_WHEEL_TICK = 1000; // resolution of the download timer wheel calculated by milisecond
+
+const int PROGRESS_TABLE_CAPACITY = 1024; // max number of running downloads tracked by the progress table
+
+const int DOWNLOAD_POOL_CAPACITY = 64; // max number of finished downloads kept with their thread and contact for reuse
+
+const int QUEUE_WINDOW_SIZE = 512; // max number of queued downloads held in memory by the lazy queue
+
+const int QUEUE_WINDOW_LOW_WATERMARK = 128; // number of queued downloads in memory below which the lazy queue reads the next ones
+
+const int CACHE_LINE_SIZE = 64; // size of a cpu cache line calculated by byte
+
+const QString CONTROL_SOCKET_NAME = "downloadmanagerd"; // name of the local control socket of the daemon
+
+const int CONTROL_EVENT_BATCH_INTERVAL = 100; // delay to batch the events sent to control clients calculated by milisecond
+
+const int CONTROL_MAX_FRAME_SIZE = 16*1024*1024; // max size of a control request calculated by byte
+
+const int MANIFEST_HIGH_WATERMARK = 512; // max number of pending downloads submitted from a manifest
+
+const int MANIFEST_LOW_WATERMARK = 256; // number of pending downloads below which the manifest is read again
+
+const int MANIFEST_READ_BATCH = 64; // max number of manifest lines read per event loop iteration
+
+const int METRICS_EXPORT_INTERVAL = 10; // interval to write the metrics file of the daemon calculated by second
+
+const int TRACE_HISTORY_SIZE = 1024; // number of completed downloads whose phase trace is kept
+
 #endif // COMMON_H
@@ -0,0 +1,105 @@
+/*!
+ * \file contentsniffer.cpp
+ * \brief classification of downloads by url, content type and magic bytes
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#include "contentsniffer.h"
+#include <string.h>
+
+struct ContentTypeMapping
+{
+    const char *mimeType;
+    DownloadManager::UrlType urlType;
+};
+
+// Types outside of the audio/ and video/ trees, or inside them but not media
+static const ContentTypeMapping CONTENT_TYPES[] = {
+    { "audio/x-scpls", DownloadManager::Playlist },
+    { "application/pls+xml", DownloadManager::Playlist },
+    { "application/ogg", DownloadManager::Music },
+    { "application/widget", DownloadManager::Application },
+    { "application/x-widget", DownloadManager::Application },
+    { 0, DownloadManager::UnknownType }
+};
+
+// Check for a signature at a fixed offset
+static bool hasBytes(const QByteArray &data, int offset, const char *bytes, int length)
+{
+    return data.size() >= offset + length && memcmp(data.constData() + offset, bytes, length) == 0;
+}
+
+DownloadManager::UrlType ContentSniffer::getUrlTypeByContentType(const QByteArray &contentType)
+{
+    // Parameters such as the charset do not matter
+    QByteArray mimeType = contentType;
+    int semicolon = mimeType.indexOf(';');
+    if (semicolon >= 0)
+        mimeType.truncate(semicolon);
+    mimeType = mimeType.trimmed().toLower();
+
+    for (int i = 0; CONTENT_TYPES[i].mimeType != 0; i++) {
+        if (mimeType == CONTENT_TYPES[i].mimeType)
+            return CONTENT_TYPES[i].urlType;
+    }
+
+    if (mimeType.startsWith("audio/"))
+        return DownloadManager::Music;
+
+    if (mimeType.startsWith("video/"))
+        return DownloadManager::Video;
+
+    // application/octet-stream and the like, the content tells more
+    return DownloadManager::UnknownType;
+}
+
+DownloadManager::UrlType ContentSniffer::getUrlTypeByMagic(const QByteArray &data)
+{
+    // Ogg names the codec of its first stream in the first page, a video starts with theora
+    if (hasBytes(data, 0, "OggS", 4))
+        return data.indexOf("\x80theora") >= 0 ? DownloadManager::Video : DownloadManager::Music;
+
+    if (hasBytes(data, 0, "RIFF", 4)) {
+        if (hasBytes(data, 8, "AVI ", 4))
+            return DownloadManager::Video;
+        if (hasBytes(data, 8, "WAVE", 4))
+            return DownloadManager::Music;
+        return DownloadManager::UnknownType;
+    }
+
+    if (hasBytes(data, 0, "ID3", 3) || hasBytes(data, 0, "fLaC", 4))
+        return DownloadManager::Music;
+
+    // MPEG audio and AAC frames start with an 11 bits frame sync
+    if (data.size() >= 2 && (uchar)data.at(0) == 0xFF && ((uchar)data.at(1) & 0xE0) == 0xE0)
+        return DownloadManager::Music;
+
+    // MP4 family, the major brand tells audio only files apart
+    if (hasBytes(data, 4, "ftyp", 4)) {
+        if (hasBytes(data, 8, "M4A ", 4) || hasBytes(data, 8, "M4B ", 4))
+            return DownloadManager::Music;
+        return DownloadManager::Video;
+    }
+
+    // Matroska and WebM
+    if (hasBytes(data, 0, "\x1A\x45\xDF\xA3", 4))
+        return DownloadManager::Video;
+
+    // Widgets are zip archives
+    if (hasBytes(data, 0, "PK\x03\x04", 4))
+        return DownloadManager::Application;
+
+    // A .pls playlist is text starting with its section, maybe after a byte order mark
+    QByteArray text = data.left(64);
+    if (text.startsWith("\xEF\xBB\xBF"))
+        text = text.mid(3);
+    if (text.trimmed().toLower().startsWith("[playlist]"))
+        return DownloadManager::Playlist;
+
+    return DownloadManager::UnknownType;
+}
@@ -0,0 +1,44 @@
+/*!
+ * \file contentsniffer.h
+ * \brief classification of downloads by url, content type and magic bytes
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#ifndef CONTENTSNIFFER_H
+#define CONTENTSNIFFER_H
+
+#include <QByteArray>
+#include "downloadmanager.h"
+
+/*!
+ * \brief Find the type of a download when its url does not tell it.
+ *
+ * Urls without a known extension are classified by the Content-Type of the
+ * answer, then by the first SNIFF_MAX_BYTES of the content, which the
+ * download writes anyway: no probe request is needed.
+ */
+class ContentSniffer
+{
+public:
+
+    /*!
+     * \brief Get the type of a download from its Content-Type header
+     * \param contentType: value of the header, may have parameters
+     * \returns UnknownType if the header is missing or too generic
+     */
+    static DownloadManager::UrlType getUrlTypeByContentType(const QByteArray &contentType);
+
+    /*!
+     * \brief Get the type of a download from the start of its content
+     * \param data: the first bytes of the file, SNIFF_MAX_BYTES are enough
+     * \returns UnknownType if no known signature matches
+     */
+    static DownloadManager::UrlType getUrlTypeByMagic(const QByteArray &data);
+};
+
+#endif // CONTENTSNIFFER_H
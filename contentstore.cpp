@@ -0,0 +1,195 @@
+/*!
+ * \file contentstore.cpp
+ * \brief content addressed store of the downloaded files
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#include "contentstore.h"
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QCryptographicHash>
+#include <QRunnable>
+#include <QDebug>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+
+static const int HASH_CHUNK_SIZE = 64*1024; // read size while hashing calculated by byte
+
+/*!
+ * \brief Adds one finished file to the store in the hashing thread
+ */
+class ContentStoreJob : public QRunnable
+{
+public:
+    ContentStoreJob(ContentStore *contentStore, const QString &filePath)
+    {
+        m_contentStore = contentStore;
+        m_filePath = filePath;
+    }
+
+    void run()
+    {
+        m_contentStore->add(m_filePath);
+    }
+
+private:
+    ContentStore *m_contentStore;
+    QString m_filePath;
+};
+
+// Check that a path still names the file that was hashed
+static bool isSameFile(const struct stat &before, const struct stat &after)
+{
+    return before.st_ino == after.st_ino && before.st_dev == after.st_dev
+            && before.st_size == after.st_size && before.st_mtime == after.st_mtime;
+}
+
+ContentStore::ContentStore(const QString &directory)
+{
+    m_directory = directory;
+    if (!m_directory.endsWith('/'))
+        m_directory += '/';
+
+    QDir().mkpath(m_directory);
+
+    m_linksUnsupported = 0;
+
+    // One file at a time, hashing is bound by the disk
+    m_hashingPool.setMaxThreadCount(1);
+}
+
+ContentStore::~ContentStore()
+{
+    m_hashingPool.waitForDone();
+}
+
+void ContentStore::addLater(const QString &filePath)
+{
+    if (m_linksUnsupported)
+        return;
+
+    m_hashingPool.start(new ContentStoreJob(this, filePath));
+}
+
+QString ContentStore::hashFile(const QString &filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly))
+        return QString();
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    while (!file.atEnd()) {
+        QByteArray data = file.read(HASH_CHUNK_SIZE);
+        if (data.isEmpty())
+            return QString();
+        hash.addData(data);
+    }
+
+    return QString::fromAscii(hash.result().toHex());
+}
+
+QString ContentStore::add(const QString &filePath)
+{
+    // A copy would only double the disk usage until prune() removes it
+    if (m_linksUnsupported)
+        return QString();
+
+    QByteArray file = QFile::encodeName(filePath);
+    struct stat hashedStat;
+    if (::stat(file.constData(), &hashedStat) != 0)
+        return QString();
+
+    QString hash = hashFile(filePath);
+    if (hash.isEmpty())
+        return QString();
+
+    // A new download of the contact may have replaced the file while it was hashed
+    struct stat currentStat;
+    if (::stat(file.constData(), &currentStat) != 0 || !isSameFile(hashedStat, currentStat)) {
+        qDebug() << __PRETTY_FUNCTION__ << filePath << " changed while it was hashed, it is not stored";
+        return QString();
+    }
+
+    QString objectPath = m_directory + hash;
+    QByteArray object = QFile::encodeName(objectPath);
+
+    // A new content becomes an object, link() fails if another thread stored it first
+    if (::link(file.constData(), object.constData()) == 0)
+        return objectPath;
+
+    if (errno == EXDEV || errno == EPERM || errno == EMLINK || errno == EOPNOTSUPP) {
+        qDebug() << __PRETTY_FUNCTION__ << "No hard links to " << m_directory << ": " << strerror(errno) << ", the content is not stored";
+        m_linksUnsupported = 1;
+        return QString();
+    }
+
+    if (errno != EEXIST) {
+        qDebug() << __PRETTY_FUNCTION__ << "Could not store " << filePath << ": " << strerror(errno);
+        return QString();
+    }
+
+    // Known content, keep the object and drop the copy
+    struct stat fileStat;
+    struct stat objectStat;
+    if (::stat(file.constData(), &fileStat) == 0 && ::stat(object.constData(), &objectStat) == 0
+            && fileStat.st_ino == objectStat.st_ino && fileStat.st_dev == objectStat.st_dev)
+        return objectPath; // already linked
+
+    if (!linkFile(objectPath, filePath))
+        return QString();
+
+    return objectPath;
+}
+
+bool ContentStore::linkFile(const QString &sourcePath, const QString &targetPath)
+{
+    QByteArray source = QFile::encodeName(sourcePath);
+    QByteArray target = QFile::encodeName(targetPath);
+    QByteArray temporary = QFile::encodeName(targetPath + ".link");
+
+    // Link next to the target then rename over it, the target never disappears on the way
+    ::unlink(temporary.constData());
+    if (::link(source.constData(), temporary.constData()) != 0) {
+        // No hard links on this file system
+        if (!QFile::copy(sourcePath, targetPath + ".link")) {
+            qDebug() << __PRETTY_FUNCTION__ << "Could not copy " << sourcePath << " to " << targetPath;
+            return false;
+        }
+    }
+
+    if (::rename(temporary.constData(), target.constData()) != 0) {
+        qDebug() << __PRETTY_FUNCTION__ << "Could not replace " << targetPath << ": " << strerror(errno);
+        ::unlink(temporary.constData());
+        return false;
+    }
+
+    return true;
+}
+
+int ContentStore::prune()
+{
+    int removedCount = 0;
+
+    QDir dir(m_directory);
+    foreach(QFileInfo info, dir.entryInfoList(QDir::Files | QDir::Hidden)) {
+        struct stat objectStat;
+        QByteArray object = QFile::encodeName(info.absoluteFilePath());
+        if (::stat(object.constData(), &objectStat) != 0)
+            continue;
+
+        // Only the store links to it
+        if (objectStat.st_nlink == 1 && ::unlink(object.constData()) == 0)
+            removedCount++;
+    }
+
+    return removedCount;
+}
@@ -0,0 +1,82 @@
+/*!
+ * \file contentstore.h
+ * \brief content addressed store of the downloaded files
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#ifndef CONTENTSTORE_H
+#define CONTENTSTORE_H
+
+#include <QString>
+#include <QAtomicInt>
+#include <QThreadPool>
+
+/*!
+ * \brief Keeps one copy of every distinct downloaded content.
+ *
+ * Objects are named by the SHA-1 of their content. The files of the contacts
+ * are hard links to the objects, so the same media downloaded for many
+ * contacts is stored once. If the store cannot link to the files, e.g. it is
+ * on another file system, nothing is stored: the files are left as they are
+ * and the store is not tried again.
+ * The methods only use the file system and can be called from any thread.
+ * addLater() hashes in a thread of the store, so a large file does not hold
+ * the thread that finished it.
+ */
+class ContentStore
+{
+public:
+    /*!
+     * \param directory: directory of the objects, created if needed
+     */
+    explicit ContentStore(const QString &directory);
+
+    /*!
+     * \brief Wait for the files being added
+     */
+    ~ContentStore();
+
+    /*!
+     * \brief Add a downloaded file to the store
+     * \param filePath: the file, replaced by a link to the existing object if the content is known
+     * \returns path of the object holding the content, empty if the file could not be stored
+     * or the store does not support hard links
+     */
+    QString add(const QString &filePath);
+
+    /*!
+     * \brief Add a downloaded file to the store in the hashing thread of the store, see add()
+     * \param filePath: the file, left as it is if it changes before it is hashed
+     */
+    void addLater(const QString &filePath);
+
+    /*!
+     * \brief Make a file with the content of another one
+     * \param sourcePath: file holding the content
+     * \param targetPath: file to create, replaced if it exists
+     * \returns true if successful, otherwise returns false
+     */
+    static bool linkFile(const QString &sourcePath, const QString &targetPath);
+
+    /*!
+     * \brief Remove the objects no file links to any more
+     * \returns number of objects removed
+     */
+    int prune();
+
+protected:
+    // Get the SHA-1 of a file as hex, empty if it cannot be read
+    static QString hashFile(const QString &filePath);
+
+private:
+    QString m_directory; // directory of the objects, ends with a slash
+    QAtomicInt m_linksUnsupported; // 1 once a link to the directory failed for lack of hard links
+    QThreadPool m_hashingPool; // thread of addLater()
+};
+
+#endif // CONTENTSTORE_H
@@ -0,0 +1,283 @@
+/*!
+ * \file controlserver.cpp
+ * \brief local socket control protocol of the download daemon
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#include "controlserver.h"
+#include "downloadmanager.h"
+#include "metricsregistry.h"
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QDataStream>
+#include <QStringList>
+#include <QTimer>
+#include <QDebug>
+
+ControlServer::ControlServer(DownloadManager *downloadManager, QObject *parent) :
+    QObject(parent)
+{
+    m_downloadManager = downloadManager;
+    Q_ASSERT(m_downloadManager != 0);
+    m_subscriberCount = 0;
+
+    m_server = new QLocalServer(this);
+    Q_ASSERT(m_server != 0);
+    connect(m_server, SIGNAL(newConnection()), this, SLOT(slotNewConnection()));
+
+    m_flushTimer = new QTimer(this);
+    Q_ASSERT(m_flushTimer != 0);
+    m_flushTimer->setSingleShot(true);
+    m_flushTimer->setInterval(CONTROL_EVENT_BATCH_INTERVAL);
+    connect(m_flushTimer, SIGNAL(timeout()), this, SLOT(slotFlushEvents()));
+
+    // The manager emits from its own thread, the events are queued to this thread
+    connect(m_downloadManager, SIGNAL(downloadStatusChanged(int,int,int)), this, SLOT(onDownloadStatusChanged(int,int,int)));
+    connect(m_downloadManager, SIGNAL(downloadFinished(int,int,QString,int)), this, SLOT(onDownloadFinished(int,int,QString,int)));
+    connect(m_downloadManager, SIGNAL(downloadError(int,int)), this, SLOT(onDownloadError(int,int)));
+    connect(m_downloadManager, SIGNAL(downloadTimeRemain(int,int)), this, SLOT(onDownloadTimeRemain(int,int)));
+}
+
+bool ControlServer::listen(const QString &name)
+{
+    // Remove the socket file left by a crashed daemon
+    QLocalServer::removeServer(name);
+
+    if (!m_server->listen(name)) {
+        qDebug() << __PRETTY_FUNCTION__ << " Could not listen on " << name << ": " << m_server->errorString();
+        return false;
+    }
+
+    qDebug() << __PRETTY_FUNCTION__ << " Listening on " << m_server->fullServerName();
+    return true;
+}
+
+void ControlServer::slotNewConnection()
+{
+    while (m_server->hasPendingConnections()) {
+        QLocalSocket *client = m_server->nextPendingConnection();
+        ClientState state;
+        state.frameSize = 0;
+        state.subscribed = false;
+        m_clients.insert(client, state);
+
+        connect(client, SIGNAL(readyRead()), this, SLOT(slotReadyRead()));
+        connect(client, SIGNAL(disconnected()), this, SLOT(slotDisconnected()));
+    }
+}
+
+void ControlServer::slotDisconnected()
+{
+    QLocalSocket *client = qobject_cast<QLocalSocket *>(sender());
+    if (client == 0 || !m_clients.contains(client))
+        return;
+
+    if (m_clients.value(client).subscribed)
+        m_subscriberCount--;
+    m_clients.remove(client);
+    client->deleteLater();
+}
+
+void ControlServer::slotReadyRead()
+{
+    QLocalSocket *client = qobject_cast<QLocalSocket *>(sender());
+    if (client == 0 || !m_clients.contains(client))
+        return;
+
+    // Handle every complete frame, a partial one waits for the next readyRead
+    forever {
+        ClientState &state = m_clients[client];
+        if (state.frameSize == 0) {
+            if (client->bytesAvailable() < (qint64)sizeof(quint32))
+                return;
+
+            QDataStream in(client);
+            in.setVersion(QDataStream::Qt_4_6);
+            in >> state.frameSize;
+
+            if (state.frameSize == 0 || state.frameSize > (quint32)CONTROL_MAX_FRAME_SIZE) {
+                qDebug() << __PRETTY_FUNCTION__ << " Invalid frame size " << state.frameSize << ", closing the client";
+                client->disconnectFromServer();
+                return;
+            }
+        }
+
+        if (client->bytesAvailable() < state.frameSize)
+            return;
+
+        QByteArray payload = client->read(state.frameSize);
+        state.frameSize = 0;
+        handleRequest(client, payload);
+
+        if (!m_clients.contains(client))
+            return;
+    }
+}
+
+void ControlServer::handleRequest(QLocalSocket *client, const QByteArray &payload)
+{
+    QDataStream in(payload);
+    in.setVersion(QDataStream::Qt_4_6);
+
+    quint32 serial = 0;
+    quint8 opcode = 0;
+    in >> serial >> opcode;
+
+    QByteArray response;
+    QDataStream out(&response, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_4_6);
+    out << serial << opcode;
+
+    qint32 downloadId = -1;
+    switch (opcode) {
+    case AddUrls: {
+        qint32 contactId = -1;
+        QStringList urls;
+        in >> contactId >> urls;
+        if (in.status() != QDataStream::Ok || urls.isEmpty())
+            break;
+        m_downloadManager->addUrls(urls, contactId);
+        out << (qint32)1;
+        writeFrame(client, response);
+        return;
+    }
+    case GetStatus:
+        in >> downloadId;
+        if (in.status() != QDataStream::Ok)
+            break;
+        out << (qint32)m_downloadManager->getDownloadStatus(downloadId);
+        writeFrame(client, response);
+        return;
+    case GetProgress:
+        in >> downloadId;
+        if (in.status() != QDataStream::Ok)
+            break;
+        out << (qint32)1
+            << (qint64)m_downloadManager->getBytesReceivedByDownload(downloadId)
+            << (qint64)m_downloadManager->getBytesTotalByDownload(downloadId)
+            << (qint32)m_downloadManager->getCurrentSpeedByDownload(downloadId)
+            << (qint32)m_downloadManager->getCurrentRemainTimeByDownload(downloadId);
+        writeFrame(client, response);
+        return;
+    case Pause:
+    case Resume:
+        in >> downloadId;
+        if (in.status() != QDataStream::Ok)
+            break;
+        // The engine only accepts them, nothing is paused or resumed
+        out << (qint32)UnsupportedRequest;
+        writeFrame(client, response);
+        return;
+    case Stop:
+        in >> downloadId;
+        if (in.status() != QDataStream::Ok)
+            break;
+        out << (qint32)(m_downloadManager->stopDownload(downloadId) ? 1 : 0);
+        writeFrame(client, response);
+        return;
+    case Subscribe: {
+        bool enabled = false;
+        in >> enabled;
+        if (in.status() != QDataStream::Ok)
+            break;
+        ClientState &state = m_clients[client];
+        if (state.subscribed != enabled)
+            m_subscriberCount += enabled ? 1 : -1;
+        state.subscribed = enabled;
+        out << (qint32)1;
+        writeFrame(client, response);
+        return;
+    }
+    case GetMetrics:
+        out << (qint32)1 << MetricsRegistry::instance()->exportText();
+        writeFrame(client, response);
+        return;
+    default:
+        break;
+    }
+
+    qDebug() << __PRETTY_FUNCTION__ << " Malformed request, opcode = " << opcode;
+    out << (qint32)MalformedRequest;
+    writeFrame(client, response);
+}
+
+void ControlServer::writeFrame(QLocalSocket *client, const QByteArray &payload)
+{
+    QByteArray frame;
+    QDataStream out(&frame, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_4_6);
+    out << (quint32)payload.size();
+    frame.append(payload);
+
+    client->write(frame);
+}
+
+void ControlServer::postEvent(quint8 type, int contactId, int downloadId, int value, const QString &filePath)
+{
+    if (m_subscriberCount == 0)
+        return;
+
+    Event event;
+    event.type = type;
+    event.contactId = contactId;
+    event.downloadId = downloadId;
+    event.value = value;
+    event.filePath = filePath;
+    m_pendingEvents.append(event);
+
+    if (!m_flushTimer->isActive())
+        m_flushTimer->start();
+}
+
+void ControlServer::slotFlushEvents()
+{
+    if (m_pendingEvents.isEmpty())
+        return;
+
+    // Encode the batch once for all the subscribers
+    QByteArray payload;
+    QDataStream out(&payload, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_4_6);
+    out << (quint32)0 << (quint8)Events << (quint32)m_pendingEvents.count();
+    for (int i = 0; i < m_pendingEvents.count(); i++) {
+        const Event &event = m_pendingEvents.at(i);
+        out << event.type << event.contactId << event.downloadId << event.value << event.filePath;
+    }
+    m_pendingEvents.clear();
+
+    QHash<QLocalSocket *, ClientState>::const_iterator it;
+    for (it = m_clients.constBegin(); it != m_clients.constEnd(); ++it) {
+        if (it.value().subscribed)
+            writeFrame(it.key(), payload);
+    }
+}
+
+void ControlServer::onDownloadStatusChanged(int contactId, int downloadId, int downloadStatus)
+{
+    postEvent(StatusChanged, contactId, downloadId, downloadStatus);
+}
+
+void ControlServer::onDownloadFinished(int contactId, int downloadId, const QString &filePath, int urlType)
+{
+    postEvent(Finished, contactId, downloadId, urlType, filePath);
+}
+
+void ControlServer::onDownloadError(int downloadId, int errorCode)
+{
+    postEvent(Error, -1, downloadId, errorCode);
+}
+
+void ControlServer::onDownloadTimeRemain(int downloadId, int remainTime)
+{
+    postEvent(TimeRemain, -1, downloadId, remainTime);
+}
+
+ControlServer::~ControlServer()
+{
+    m_server->close();
+}
@@ -0,0 +1,150 @@
+/*!
+ * \file controlserver.h
+ * \brief local socket control protocol of the download daemon
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#ifndef CONTROLSERVER_H
+#define CONTROLSERVER_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QByteArray>
+#include "common.h"
+
+class QLocalServer;
+class QLocalSocket;
+class QTimer;
+class QDataStream;
+class DownloadManager;
+
+/*!
+ * \brief Lets other processes drive the DownloadManager through a local socket.
+ *
+ * Every message is a frame: a quint32 payload size followed by the payload,
+ * written with QDataStream (Qt_4_6, big endian).
+ *
+ * Request payload: quint32 serial, quint8 opcode, then the arguments:
+ *  - AddUrls: qint32 contactId, QStringList urls
+ *  - GetStatus, GetProgress, Pause, Resume, Stop: qint32 downloadId
+ *  - Subscribe: bool enabled
+ *  - GetMetrics: no argument
+ *
+ * Response payload: quint32 serial, quint8 opcode, qint32 result, then for
+ * GetProgress: qint64 bytesReceived, qint64 bytesTotal, qint32 speed, qint32 remainTime,
+ * for GetMetrics: QByteArray metrics in the prometheus text format.
+ * The result is the status for GetStatus, 1 or 0 for the other requests,
+ * -1 for a malformed request and -2 for Pause and Resume, which the engine
+ * does not support yet.
+ *
+ * Event payload, sent to subscribers: quint32 0, quint8 Events, quint32 count,
+ * then count times quint8 event type, qint32 contactId, qint32 downloadId,
+ * qint32 value, QString filePath. Events are batched every
+ * CONTROL_EVENT_BATCH_INTERVAL milisecond.
+ */
+class ControlServer : public QObject
+{
+    Q_OBJECT
+public:
+
+    enum Opcode {
+        AddUrls = 1,
+        GetStatus = 2,
+        GetProgress = 3,
+        Pause = 4,
+        Resume = 5,
+        Stop = 6,
+        Subscribe = 7,
+        GetMetrics = 8,
+        Events = 0x80
+    };
+
+    enum Result {
+        MalformedRequest = -1,
+        UnsupportedRequest = -2
+    };
+
+    enum EventType {
+        StatusChanged = 1, // value: the new status
+        Finished = 2, // value: the url type
+        Error = 3, // value: the error code
+        TimeRemain = 4 // value: remain time calculated by milisecond
+    };
+
+    explicit ControlServer(DownloadManager *downloadManager, QObject *parent = 0);
+    ~ControlServer();
+
+    /*!
+     * \brief Start listening
+     * \param name: name or full path of the local socket
+     * \returns true if the server listens, otherwise returns false
+     */
+    bool listen(const QString &name = CONTROL_SOCKET_NAME);
+
+protected slots:
+
+    // Slot when a client connects
+    void slotNewConnection();
+
+    // Slot when a client sent data
+    void slotReadyRead();
+
+    // Slot when a client disconnects
+    void slotDisconnected();
+
+    // Send the pending events to the subscribers
+    void slotFlushEvents();
+
+    void onDownloadStatusChanged(int contactId, int downloadId, int downloadStatus);
+
+    void onDownloadFinished(int contactId, int downloadId, const QString &filePath, int urlType);
+
+    void onDownloadError(int downloadId, int errorCode);
+
+    void onDownloadTimeRemain(int downloadId, int remainTime);
+
+protected:
+
+    struct ClientState
+    {
+        quint32 frameSize; // size of the frame being received, 0 while reading the size
+        bool subscribed;
+    };
+
+    struct Event
+    {
+        quint8 type;
+        qint32 contactId;
+        qint32 downloadId;
+        qint32 value;
+        QString filePath;
+    };
+
+    // Run one request and write its response
+    void handleRequest(QLocalSocket *client, const QByteArray &payload);
+
+    // Write a frame to a client
+    void writeFrame(QLocalSocket *client, const QByteArray &payload);
+
+    // Queue an event for the subscribers
+    void postEvent(quint8 type, int contactId, int downloadId, int value, const QString &filePath = QString());
+
+private:
+    DownloadManager *m_downloadManager;
+
+    QLocalServer *m_server;
+
+    QHash<QLocalSocket *, ClientState> m_clients;
+    int m_subscriberCount;
+
+    QList<Event> m_pendingEvents;
+    QTimer *m_flushTimer; // single shot, started by the first pending event
+};
+
+#endif // CONTROLSERVER_H
@@ -0,0 +1,53 @@
+#include <QCoreApplication>
+#include <QStringList>
+#include <QDebug>
+#include "downloaddaemon.h"
+#include "manifestloader.h"
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+
+    QString dbPath = QCoreApplication::applicationDirPath() + "/downloadmanager.sqlite";
+    QString socketName = CONTROL_SOCKET_NAME;
+    QString manifestPath;
+    QString metricsPath;
+
+    QStringList arguments = QCoreApplication::arguments();
+    for (int i = 1; i < arguments.count(); i++) {
+        if (arguments.at(i) == "--db" && i + 1 < arguments.count()) {
+            dbPath = arguments.at(++i);
+        } else if (arguments.at(i) == "--socket" && i + 1 < arguments.count()) {
+            socketName = arguments.at(++i);
+        } else if (arguments.at(i) == "--no-socket") {
+            socketName.clear();
+        } else if (arguments.at(i) == "--manifest" && i + 1 < arguments.count()) {
+            manifestPath = arguments.at(++i);
+        } else if (arguments.at(i) == "--metrics-file" && i + 1 < arguments.count()) {
+            metricsPath = arguments.at(++i);
+        } else {
+            qDebug() << "Usage: downloadmanagerd [--db <database file>] [--socket <name> | --no-socket] [--manifest <file>] [--metrics-file <file>]";
+            return 1;
+        }
+    }
+
+    DownloadDaemon daemon;
+    if (!daemon.initialize(dbPath, socketName))
+        return 1;
+    daemon.setMetricsFile(metricsPath);
+
+    // Batch mode, quits once every entry of the manifest is done
+    ManifestLoader manifestLoader(daemon.getDownloadManager());
+    if (!manifestPath.isEmpty()) {
+        QObject::connect(&manifestLoader, SIGNAL(finished()), &a, SLOT(quit()), Qt::QueuedConnection);
+        if (!manifestLoader.start(manifestPath))
+            return 1;
+    }
+
+    int result = a.exec();
+
+    if (!manifestPath.isEmpty())
+        qDebug() << manifestLoader.getSummary();
+
+    return result;
+}
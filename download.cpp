@@ -12,16 +12,31 @@
 #include "download.h"
 #include "downloadmanager.h"
 #include "downloadthread.h"
+#include "downloadtimerwheel.h"
+#include "contentstore.h"
 #include <QDir>
+#include <QUrl>
+#include <QCoreApplication>
 
 Download::Download(QObject *parent) :
     QObject(parent)
 {
     m_id = -1;
+    m_parentId = -1;
     m_url = "";
     m_savedFilePathName = "";
     m_contact = 0;
     m_downloadThread = 0;
+    m_progressTable = 0;
+    m_progressSlot = -1;
+    m_timerWheel = 0;
+    m_mediaTypes = 0;
+    m_retryCount = 0;
+    m_retryTimerId = -1;
+    m_resumeOffset = 0;
+    m_revalidated = false;
+    m_streaming = false;
+    m_prefetchTail = false;
 }
 
 void Download::setUrl(const QString &url)
@@ -34,6 +49,21 @@ QString Download::getUrl()
     return m_url;
 }
 
+void Download::setMirrorUrls(const QStringList &urls)
+{
+    m_mirrorUrls = urls;
+    if (!urls.isEmpty())
+        m_url = urls.first();
+}
+
+QStringList Download::getMirrorUrls()
+{
+    if (m_mirrorUrls.isEmpty())
+        return QStringList() << m_url;
+
+    return m_mirrorUrls;
+}
+
 void Download::setId(int id)
 {
     m_id = id;
@@ -44,6 +74,16 @@ int Download::getId()
     return m_id;
 }
 
+void Download::setParentId(int parentId)
+{
+    m_parentId = parentId;
+}
+
+int Download::getParentId()
+{
+    return m_parentId;
+}
+
 void Download::setContact(Contact *contact)
 {
     // Free the last memory
@@ -78,11 +118,118 @@ DownloadManager::UrlType Download::getUrlType()
     return m_urlType;
 }
 
+void Download::setRetryCount(int retryCount)
+{
+    m_retryCount = retryCount;
+}
+
+int Download::getRetryCount()
+{
+    return m_retryCount;
+}
+
+qint64 Download::getResumeOffset()
+{
+    return m_resumeOffset;
+}
+
+void Download::scheduleRetry(int delay)
+{
+    if (m_timerWheel == 0) {
+        emit retryReady(m_id);
+        return;
+    }
+
+    m_timerWheel->cancel(m_retryTimerId);
+    m_retryTimerId = m_timerWheel->schedule(this, "slotRetryTimeout", delay*1000/TIMER_WHEEL_TICK, false);
+}
+
+void Download::slotRetryTimeout()
+{
+    m_retryTimerId = -1;
+    emit retryReady(m_id);
+}
+
 QString Download::getSavedFilePathName()
 {
     return m_savedFilePathName;
 }
 
+void Download::setSavedFilePathName(const QString &savedFilePathName)
+{
+    m_savedFilePathName = savedFilePathName;
+}
+
+bool Download::completeFromFile(const QString &filePath)
+{
+    m_savedFilePathName = saveFileName(m_url);
+    if (filePath == m_savedFilePathName)
+        return true;
+
+    return ContentStore::linkFile(filePath, m_savedFilePathName);
+}
+
+void Download::setCachedCopy(const DownloadCacheEntry &entry)
+{
+    m_cachedCopy = entry;
+}
+
+DownloadCacheEntry Download::getCachedCopy()
+{
+    return m_cachedCopy;
+}
+
+void Download::setRevalidated()
+{
+    m_revalidated = true;
+}
+
+bool Download::isRevalidated()
+{
+    return m_revalidated;
+}
+
+void Download::setValidators(const QString &etag, const QString &lastModified)
+{
+    m_etag = etag;
+    m_lastModified = lastModified;
+}
+
+QString Download::getEtag()
+{
+    return m_etag;
+}
+
+QString Download::getLastModified()
+{
+    return m_lastModified;
+}
+
+void Download::setStreaming(bool streaming, bool prefetchTail)
+{
+    m_streaming = streaming;
+    m_prefetchTail = prefetchTail;
+}
+
+bool Download::isStreaming()
+{
+    return m_streaming;
+}
+
+bool Download::isTailPrefetched()
+{
+    return m_prefetchTail;
+}
+
+bool Download::seek(qint64 offset)
+{
+    if (m_downloadThread == 0 || !m_streaming)
+        return false;
+
+    m_downloadThread->seek(offset);
+    return true;
+}
+
 void Download::connectSignals()
 {
     if (m_downloadThread == 0)
@@ -93,6 +240,7 @@ void Download::connectSignals()
     connect(m_downloadThread, SIGNAL(downloadFinished()), this, SLOT(slotDownloadFinished()), Qt::DirectConnection);
     connect(m_downloadThread, SIGNAL(downloadError(int,DownloadManager::DownloadErrorCode)), this, SIGNAL(downloadError(int,DownloadManager::DownloadErrorCode)), Qt::DirectConnection);
     connect(m_downloadThread, SIGNAL(downloadSslErrors(QList<QSslError>)), this, SLOT(slotDownloadSslErrors(QList<QSslError>)), Qt::DirectConnection);
+    connect(m_downloadThread, SIGNAL(contiguousBytesAvailable(int,qint64)), this, SIGNAL(contiguousBytesAvailable(int,qint64)), Qt::DirectConnection);
 }
 
 void Download::disconnectSignals()
@@ -105,6 +253,7 @@ void Download::disconnectSignals()
     disconnect(m_downloadThread, SIGNAL(downloadFinished()), this, SLOT(slotDownloadFinished()));
     disconnect(m_downloadThread, SIGNAL(downloadError(int,DownloadManager::DownloadErrorCode)), this, SIGNAL(downloadError(int,DownloadManager::DownloadErrorCode)));
     disconnect(m_downloadThread, SIGNAL(downloadSslErrors(QList<QSslError>)), this, SLOT(slotDownloadSslErrors(QList<QSslError>)));
+    disconnect(m_downloadThread, SIGNAL(contiguousBytesAvailable(int,qint64)), this, SIGNAL(contiguousBytesAvailable(int,qint64)));
 }
 
 void Download::slotDownloadFinished()
@@ -131,7 +280,8 @@ QString Download::saveFileName(const QString &url)
     if (m_contact)
         contactIdStr = QString("%1").arg(m_contact->getId());
 
-    QString basename = QString("Contact%1_%2").arg(contactIdStr, QFileInfo(url).fileName());
+    // The query string and the fragment are not part of the file name
+    QString basename = QString("Contact%1_%2").arg(contactIdStr, QFileInfo(QUrl(url).path()).fileName());
     QString downloadFilePath = downloadDir + basename;
 
     return downloadFilePath;
@@ -139,20 +289,88 @@ QString Download::saveFileName(const QString &url)
 
 void Download::start()
 {
+    // A pooled download runs the same thread again once its last run is over, a retry already aborted it
     if (m_downloadThread != 0) {
         disconnectSignals();
         m_downloadThread->exit();
-        delete m_downloadThread;
+        m_downloadThread->wait();
+        m_downloadThread->reset();
+    } else {
+        m_downloadThread = new DownloadThread(this);
+        Q_ASSERT(m_downloadThread != 0);
     }
 
     // Set saved file path name
     m_savedFilePathName = saveFileName(m_url);
+    m_etag.clear();
+    m_lastModified.clear();
+    m_revalidated = false;
+
+    // A retry continues from the bytes the failed attempt already wrote
+    m_resumeOffset = 0;
+    if (m_retryCount > 0) {
+        QFileInfo savedFileInfo(m_savedFilePathName);
+        if (savedFileInfo.exists())
+            m_resumeOffset = savedFileInfo.size();
+    }
+
+    // Reserve a progress slot
+    if (m_progressTable && m_progressSlot < 0) {
+        int contactId = -1;
+        if (m_contact)
+            contactId = m_contact->getId();
+        m_progressSlot = m_progressTable->acquire(m_id, contactId);
+    }
 
-    m_downloadThread = new DownloadThread(this);
     connectSignals();
     m_downloadThread->start();
 }
 
+void Download::reset()
+{
+    stop();
+
+    if (m_timerWheel && m_retryTimerId >= 0) {
+        m_timerWheel->cancel(m_retryTimerId);
+        m_retryTimerId = -1;
+    }
+
+    disconnectSignals();
+    // The connections of the previous owner go too, the next one makes its own
+    disconnect();
+    QCoreApplication::removePostedEvents(this);
+
+    if (m_downloadThread != 0) {
+        m_downloadThread->exit();
+        m_downloadThread->wait();
+    }
+
+    if (m_contact != 0)
+        m_contact->setId(-1);
+
+    m_id = -1;
+    m_parentId = -1;
+    m_url.clear();
+    m_mirrorUrls.clear();
+    m_savedFilePathName.clear();
+    m_downloadStatus = DownloadManager::UnknownStatus;
+    m_urlType = DownloadManager::UnknownType;
+    m_progressTable = 0;
+    m_timerWheel = 0;
+    m_mediaTypes = 0;
+    m_retryCount = 0;
+    m_resumeOffset = 0;
+    m_cachedCopy = DownloadCacheEntry();
+    m_revalidated = false;
+    m_etag.clear();
+    m_lastModified.clear();
+    m_streaming = false;
+    m_prefetchTail = false;
+
+    QMutexLocker locker(&m_traceMutex);
+    m_trace = DownloadTrace();
+}
+
 void Download::pause()
 {
     // TODO
@@ -169,17 +387,93 @@ void Download::stop()
     if (m_downloadThread) {
         m_downloadThread->stop();
     }
+
+    // Free the progress slot
+    if (m_progressTable && m_progressSlot >= 0) {
+        m_progressTable->release(m_progressSlot, m_id);
+        m_progressSlot = -1;
+    }
 }
 
-int Download::getCurrentRemainTime()
+void Download::abort()
 {
-    return m_downloadThread->getCurrentRemainTime();
+    stop();
+
+    // The thread leaves its event loop, its cleanup aborts the replies and closes the file
+    if (m_downloadThread)
+        m_downloadThread->exit();
+}
+
+void Download::setProgressTable(DownloadProgressTable *progressTable)
+{
+    m_progressTable = progressTable;
+}
+
+bool Download::getProgress(DownloadProgressSnapshot &snapshot)
+{
+    if (m_progressTable == 0)
+        return false;
+
+    return m_progressTable->getSnapshotByDownload(m_id, snapshot);
+}
+
+void Download::setTimerWheel(DownloadTimerWheel *timerWheel)
+{
+    m_timerWheel = timerWheel;
+}
+
+DownloadTimerWheel *Download::getTimerWheel()
+{
+    return m_timerWheel;
+}
+
+void Download::setMediaTypes(const MediaTypeRegistry *mediaTypes)
+{
+    m_mediaTypes = mediaTypes;
+}
+
+const MediaTypeRegistry *Download::getMediaTypes()
+{
+    return m_mediaTypes;
+}
+
+void Download::publishProgress(const DownloadProgressSnapshot &snapshot)
+{
+    if (m_progressTable && m_progressSlot >= 0)
+        m_progressTable->publish(m_progressSlot, snapshot);
+}
+
+void Download::markTrace(DownloadTrace::Phase phase)
+{
+    QMutexLocker locker(&m_traceMutex);
+    m_trace.setIds(m_id, m_contact ? m_contact->getId() : -1);
+    m_trace.setAttempt(m_retryCount);
+    m_trace.mark(phase);
+}
+
+void Download::markTrace(DownloadTrace::Phase phase, qint64 timestamp)
+{
+    QMutexLocker locker(&m_traceMutex);
+    m_trace.setIds(m_id, m_contact ? m_contact->getId() : -1);
+    m_trace.setAttempt(m_retryCount);
+    m_trace.mark(phase, timestamp);
+}
+
+DownloadTrace Download::getTrace()
+{
+    QMutexLocker locker(&m_traceMutex);
+    return m_trace;
 }
 
 void Download::release()
 {
     stop();
 
+    if (m_timerWheel && m_retryTimerId >= 0) {
+        m_timerWheel->cancel(m_retryTimerId);
+        m_retryTimerId = -1;
+    }
+
     disconnectSignals();
 
     if (m_contact != 0) {
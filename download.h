@@ -16,8 +16,14 @@
 #include <QNetworkReply>
 #include "contact.h"
 #include "downloadmanager.h"
+#include "downloadprogresstable.h"
+#include "downloadtrace.h"
+#include "downloadcachedao.h"
+#include <QMutex>
 
 class DownloadThread;
+class DownloadTimerWheel;
+class MediaTypeRegistry;
 class Download : public QObject
 {
     Q_OBJECT
@@ -40,6 +46,18 @@ public:
      */
     QString getUrl();
 
+    /*!
+     * \brief Set the mirror urls of the download
+     * \param urls: urls serving the same file, the first one is the primary url
+     */
+    void setMirrorUrls(const QStringList &urls);
+
+    /*!
+     * \brief Get the mirror urls of the download
+     * \returns the mirror urls, at least the primary url
+     */
+    QStringList getMirrorUrls();
+
     /*!
      * \brief Set id of the download
      * \param id: the id of the download
@@ -52,6 +70,18 @@ public:
      */
     int getId();
 
+    /*!
+     * \brief Set the playlist download the download was expanded from
+     * \param parentId: id of the playlist download, -1 for a download added by the user
+     */
+    void setParentId(int parentId);
+
+    /*!
+     * \brief Get the playlist download the download was expanded from
+     * \returns id of the playlist download, -1 for a download added by the user
+     */
+    int getParentId();
+
     /*!
      * \brief Set contact linked of the download
      * \param contact: the linked contact
@@ -79,6 +109,7 @@ public:
     /*!
      * \brief Set url type of the download
      * \param urlType: url type of the download
+     * \note the download thread sets the type of an UnknownType download once its content is classified
      */
     void setUrlType(DownloadManager::UrlType urlType);
 
@@ -88,12 +119,116 @@ public:
      */
     DownloadManager::UrlType getUrlType();
 
+    /*!
+     * \brief Set the number of retries done so far
+     * \param retryCount: number of retries
+     */
+    void setRetryCount(int retryCount);
+
+    /*!
+     * \brief Get the number of retries done so far
+     * \returns number of retries
+     */
+    int getRetryCount();
+
+    /*!
+     * \brief Get the offset the current attempt resumes from
+     * \returns number of bytes already on the disk, 0 for a fresh download
+     */
+    qint64 getResumeOffset();
+
+    /*!
+     * \brief Schedule a retry of the download
+     * \param delay: delay before the retry calculated by second
+     * \note retryReady is emitted when the delay has elapsed
+     */
+    void scheduleRetry(int delay);
+
     /*!
      * \brief Get the saved file path name
      * \returns he saved file path name
      */
     QString getSavedFilePathName();
 
+    /*!
+     * \brief Point the download to another file
+     * \param savedFilePathName: full path of the file holding the content
+     * \note used when the server confirms that a cached copy is still valid
+     */
+    void setSavedFilePathName(const QString &savedFilePathName);
+
+    /*!
+     * \brief Finish the download with the file of another download of the same url
+     * \param filePath: file holding the content
+     * \returns true if the saved file of the download now holds the content
+     */
+    bool completeFromFile(const QString &filePath);
+
+    /*!
+     * \brief Set the copy of the url to revalidate instead of downloading it again
+     * \param entry: the cached copy, an invalid entry to download unconditionally
+     */
+    void setCachedCopy(const DownloadCacheEntry &entry);
+
+    /*!
+     * \brief Get the copy of the url to revalidate
+     */
+    DownloadCacheEntry getCachedCopy();
+
+    /*!
+     * \brief Mark the download as finished by the revalidation of its cached copy
+     * \note called from the download thread
+     */
+    void setRevalidated();
+
+    /*!
+     * \brief Check whether the current attempt was finished by the revalidation of the cached copy
+     */
+    bool isRevalidated();
+
+    /*!
+     * \brief Set the validators the server sent with the content
+     * \param etag: value of the ETag header, may be empty
+     * \param lastModified: value of the Last-Modified header, may be empty
+     * \note called from the download thread
+     */
+    void setValidators(const QString &etag, const QString &lastModified);
+
+    /*!
+     * \brief Get the ETag of the downloaded content
+     */
+    QString getEtag();
+
+    /*!
+     * \brief Get the Last-Modified date of the downloaded content
+     */
+    QString getLastModified();
+
+    /*!
+     * \brief Fetch the file in playback order if the policy of its type allows it
+     * \param streaming: true to keep the start of the file sequential
+     * \param prefetchTail: true to fetch the last STREAMING_TAIL_SIZE bytes early
+     * \note applies to the next attempt
+     */
+    void setStreaming(bool streaming, bool prefetchTail);
+
+    /*!
+     * \brief Check whether the file is fetched in playback order
+     */
+    bool isStreaming();
+
+    /*!
+     * \brief Check whether the end of a streamed file is fetched early
+     */
+    bool isTailPrefetched();
+
+    /*!
+     * \brief Fetch the file from an offset before the rest of it
+     * \param offset: position the reader moved to
+     * \returns true if the request was passed to the running attempt, otherwise returns false
+     */
+    bool seek(qint64 offset);
+
     /*!
      * \brief start download
      */
@@ -115,10 +250,80 @@ public:
     void stop();
 
     /*!
-     * \brief get current remain time
-     * \returns current remain time
+     * \brief Stop the running attempt and let its thread finish, its replies are aborted
+     * and the file keeps the bytes a retry can resume from
+     * \note does not wait for the thread, can be called from any thread
+     */
+    void abort();
+
+    /*!
+     * \brief Bring the download back to the state of a new one, keeping its contact and its thread
+     * \note waits for the last run of the thread, call it from the thread owning the download
+     */
+    void reset();
+
+    /*!
+     * \brief Set the table the download publishes its progress to
+     * \param progressTable: the shared progress table
+     */
+    void setProgressTable(DownloadProgressTable *progressTable);
+
+    /*!
+     * \brief Read the published progress of the download
+     * \param snapshot: receives the progress values
+     * \returns true if the download has published progress, otherwise returns false
+     */
+    bool getProgress(DownloadProgressSnapshot &snapshot);
+
+    /*!
+     * \brief Set the timer wheel driving the download timers
+     * \param timerWheel: the shared timer wheel
+     */
+    void setTimerWheel(DownloadTimerWheel *timerWheel);
+
+    /*!
+     * \brief Get the timer wheel driving the download timers
+     * \returns the shared timer wheel
+     */
+    DownloadTimerWheel *getTimerWheel();
+
+    /*!
+     * \brief Set the registry giving the policy of each type
+     * \param mediaTypes: the shared registry
+     */
+    void setMediaTypes(const MediaTypeRegistry *mediaTypes);
+
+    /*!
+     * \brief Get the registry giving the policy of each type
+     * \returns the shared registry
      */
-    int getCurrentRemainTime();
+    const MediaTypeRegistry *getMediaTypes();
+
+    /*!
+     * \brief Publish progress values of the download
+     * \param snapshot: the progress values
+     * \note called from the download thread
+     */
+    void publishProgress(const DownloadProgressSnapshot &snapshot);
+
+    /*!
+     * \brief Record the time a phase of the download is reached
+     * \param phase: the phase reached
+     * \note can be called from the manager and the download threads
+     */
+    void markTrace(DownloadTrace::Phase phase);
+
+    /*!
+     * \brief Record the time a phase of the download was reached before the download existed
+     * \param phase: the phase reached
+     * \param timestamp: the time calculated by milisecond since the epoch
+     */
+    void markTrace(DownloadTrace::Phase phase, qint64 timestamp);
+
+    /*!
+     * \brief Get a copy of the phase timestamps of the download
+     */
+    DownloadTrace getTrace();
 
 signals:
     /*!
@@ -157,6 +362,19 @@ signals:
      */
     void downloadSslErrors(int downloadId, const QList<QSslError> &errors);
 
+    /*!
+     * \brief emitted when the delay of a scheduled retry has elapsed
+     * \param downloadId: id of download
+     */
+    void retryReady(int downloadId);
+
+    /*!
+     * \brief emitted in streaming mode when more of the start of the file can be read
+     * \param downloadId: id of download
+     * \param bytesAvailable: bytes written from the start of the file without any gap
+     */
+    void contiguousBytesAvailable(int downloadId, qint64 bytesAvailable);
+
 protected slots:
     // Slot when download finished
     void slotDownloadFinished();
@@ -164,6 +382,9 @@ protected slots:
     // Slot when getting ssl errors
     void slotDownloadSslErrors(const QList<QSslError> &errors);
 
+    // Slot when the retry delay elapsed, invoked by the timer wheel
+    void slotRetryTimeout();
+
 protected:
 
     // Connect signals
@@ -189,9 +410,32 @@ private:
     DownloadManager::UrlType m_urlType; // Url type
 
     QString m_url; // Download Url
+    QStringList m_mirrorUrls; // Other urls of the same file
     int m_id; // Download Id
+    int m_parentId; // Id of the playlist download the download was expanded from, -1 if none
     Contact *m_contact; // The link contact, the download will manage the contact time life
     QString m_savedFilePathName; // Saved full file path name
+
+    DownloadProgressTable *m_progressTable; // Shared progress table, not owned
+    int m_progressSlot; // Slot of the download in the progress table
+
+    DownloadTimerWheel *m_timerWheel; // Shared timer wheel, not owned
+    const MediaTypeRegistry *m_mediaTypes; // Shared type registry, not owned
+
+    int m_retryCount; // Number of retries done so far
+    int m_retryTimerId; // Pending retry in the timer wheel
+    qint64 m_resumeOffset; // Bytes kept from the previous attempt
+
+    DownloadCacheEntry m_cachedCopy; // Copy to revalidate, invalid if there is none
+    bool m_revalidated; // True if the server confirmed the cached copy
+    QString m_etag; // Validators of the downloaded content
+    QString m_lastModified;
+
+    bool m_streaming; // True to fetch the file in playback order
+    bool m_prefetchTail; // True to fetch the end of a streamed file early
+
+    DownloadTrace m_trace; // Phase timestamps of the latest attempt
+    QMutex m_traceMutex; // Guards m_trace
 };
 
 #endif // DOWNLOAD_H
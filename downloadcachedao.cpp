@@ -0,0 +1,128 @@
+/*!
+ * \file downloadcachedao.cpp
+ * \brief database helper for the http validators of downloaded files
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#include "downloadcachedao.h"
+#include "common.h"
+#include <QDebug>
+#include <QSqlQuery>
+#include <QSqlError>
+#include <QVariant>
+
+DownloadCacheEntry::DownloadCacheEntry()
+{
+    size = -1;
+}
+
+bool DownloadCacheEntry::isValid() const
+{
+    return !url.isEmpty() && !filePath.isEmpty() && (!etag.isEmpty() || !lastModified.isEmpty());
+}
+
+DownloadCacheDAO::DownloadCacheDAO(DBConnection *dbConnection, QObject *parent) :
+    QObject(parent), m_dbConnection(dbConnection)
+{
+}
+
+bool DownloadCacheDAO::checkDB()
+{
+    if (!m_dbConnection) {
+        qDebug() << __PRETTY_FUNCTION__ << ". Lost Database Connection";
+        return false;
+    }
+
+    return true;
+}
+
+bool DownloadCacheDAO::createTable()
+{
+    if (!checkDB()) {
+        qDebug() << __PRETTY_FUNCTION__ << ". Database Error";
+        return false;
+    }
+
+    QString createCacheTableString = QString(
+            "CREATE TABLE IF NOT EXISTS %1(url TEXT NOT NULL PRIMARY KEY, "
+            "file_path TEXT, etag TEXT, last_modified TEXT, size INTEGER)").arg(DOWNLOAD_CACHE_TABLE_NAME);
+    return m_dbConnection->createTable(createCacheTableString);
+}
+
+bool DownloadCacheDAO::getCacheEntry(const QString &url, DownloadCacheEntry &entry)
+{
+    if (!checkDB()) {
+        qDebug() << __PRETTY_FUNCTION__ << ". Database Error";
+        return false;
+    }
+
+    QString queryStr = QString("SELECT file_path, etag, last_modified, size FROM %1 WHERE url = :url").arg(DOWNLOAD_CACHE_TABLE_NAME);
+    QSqlQuery selectQuery(m_dbConnection->getSqlDatabase());
+    selectQuery.prepare(queryStr);
+    selectQuery.bindValue(":url", url);
+
+    if (!selectQuery.exec()) {
+        qDebug() << __PRETTY_FUNCTION__ << selectQuery.lastError();
+        return false;
+    }
+
+    if (!selectQuery.next())
+        return false;
+
+    entry.url = url;
+    entry.filePath = selectQuery.value(0).toString();
+    entry.etag = selectQuery.value(1).toString();
+    entry.lastModified = selectQuery.value(2).toString();
+    entry.size = selectQuery.value(3).toLongLong();
+    return true;
+}
+
+bool DownloadCacheDAO::saveCacheEntry(const DownloadCacheEntry &entry)
+{
+    if (!checkDB()) {
+        qDebug() << __PRETTY_FUNCTION__ << ". Database Error";
+        return false;
+    }
+
+    QString queryStr = QString("INSERT OR REPLACE INTO %1(url, file_path, etag, last_modified, size) "
+                               "VALUES(:url, :file_path, :etag, :last_modified, :size)").arg(DOWNLOAD_CACHE_TABLE_NAME);
+    QSqlQuery insertQuery(m_dbConnection->getSqlDatabase());
+    insertQuery.prepare(queryStr);
+    insertQuery.bindValue(":url", entry.url);
+    insertQuery.bindValue(":file_path", entry.filePath);
+    insertQuery.bindValue(":etag", entry.etag);
+    insertQuery.bindValue(":last_modified", entry.lastModified);
+    insertQuery.bindValue(":size", entry.size);
+
+    if (!insertQuery.exec()) {
+        qDebug() << __PRETTY_FUNCTION__ << insertQuery.lastError();
+        return false;
+    }
+
+    return true;
+}
+
+bool DownloadCacheDAO::deleteCacheEntry(const QString &url)
+{
+    if (!checkDB()) {
+        qDebug() << __PRETTY_FUNCTION__ << ". Database Error";
+        return false;
+    }
+
+    QString queryStr = QString("DELETE FROM %1 WHERE url = :url").arg(DOWNLOAD_CACHE_TABLE_NAME);
+    QSqlQuery deleteQuery(m_dbConnection->getSqlDatabase());
+    deleteQuery.prepare(queryStr);
+    deleteQuery.bindValue(":url", url);
+
+    if (!deleteQuery.exec()) {
+        qDebug() << __PRETTY_FUNCTION__ << deleteQuery.lastError();
+        return false;
+    }
+
+    return true;
+}
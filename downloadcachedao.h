@@ -0,0 +1,78 @@
+/*!
+ * \file downloadcachedao.h
+ * \brief database helper for the http validators of downloaded files
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#ifndef DOWNLOADCACHEDAO_H
+#define DOWNLOADCACHEDAO_H
+
+#include <QObject>
+#include "dbconnection.h"
+
+/*!
+ * \brief Copy of a url kept on the disk with the validators the server sent for it
+ */
+struct DownloadCacheEntry
+{
+    DownloadCacheEntry();
+
+    /*!
+     * \brief Check whether the entry holds a copy that can be revalidated
+     */
+    bool isValid() const;
+
+    QString url;
+    QString filePath; // file holding the copy
+    QString etag; // ETag of the copy, empty if the server sent none
+    QString lastModified; // Last-Modified of the copy, empty if the server sent none
+    qint64 size; // size of the file when it was stored
+};
+
+class DownloadCacheDAO : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DownloadCacheDAO(DBConnection *dbConnection, QObject *parent = 0);
+
+    /*!
+     * \brief Create the cache table if it does not exist yet
+     * \returns true if successful, otherwise returns false
+     */
+    bool createTable();
+
+    /*!
+     * \brief Get the cache entry of a url
+     * \param url: the url of the download
+     * \param entry: receives the entry
+     * \returns true if the url has an entry, otherwise returns false
+     */
+    bool getCacheEntry(const QString &url, DownloadCacheEntry &entry);
+
+    /*!
+     * \brief Add or replace the cache entry of a url
+     * \param entry: the entry to store
+     * \returns true if successful, otherwise returns false
+     */
+    bool saveCacheEntry(const DownloadCacheEntry &entry);
+
+    /*!
+     * \brief Delete the cache entry of a url
+     * \param url: the url of the download
+     * \returns true if successful, otherwise returns false
+     */
+    bool deleteCacheEntry(const QString &url);
+
+protected:
+    bool checkDB();
+
+private:
+    DBConnection *m_dbConnection; // Database connection
+};
+
+#endif // DOWNLOADCACHEDAO_H
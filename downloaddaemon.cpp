@@ -0,0 +1,185 @@
+/*!
+ * \file downloaddaemon.cpp
+ * \brief headless host of the download manager
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#include "downloaddaemon.h"
+#include "controlserver.h"
+#include "metricsregistry.h"
+#include <QTimer>
+#include <QCoreApplication>
+#include <QSocketNotifier>
+#include <QDebug>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+int DownloadDaemon::s_signalPipe[2] = { -1, -1 };
+
+DownloadDaemon::DownloadDaemon(QObject *parent) :
+    QObject(parent)
+{
+    m_signalNotifier = 0;
+    m_controlServer = 0;
+
+    m_metricsTimer = new QTimer(this);
+    Q_ASSERT(m_metricsTimer != 0);
+    m_metricsTimer->setInterval(METRICS_EXPORT_INTERVAL*1000);
+    connect(m_metricsTimer, SIGNAL(timeout()), this, SLOT(slotExportMetrics()));
+}
+
+bool DownloadDaemon::initialize(const QString &dbPath, const QString &socketName)
+{
+    if (!installSignalHandlers())
+        return false;
+
+    m_downloadManager.setDBStoragePath(dbPath);
+
+    connect(&m_downloadManager, SIGNAL(downloadError(int,int)), this, SLOT(onDownloadError(int,int)), Qt::DirectConnection);
+    connect(&m_downloadManager, SIGNAL(contactDownloadError(int,int)), this, SLOT(onContactDownloadError(int,int)), Qt::DirectConnection);
+    connect(&m_downloadManager, SIGNAL(downloadFinished(int,int,QString,int)), this, SLOT(onDownloadFinished(int,int,QString,int)), Qt::DirectConnection);
+    connect(&m_downloadManager, SIGNAL(downloadStatusChanged(int,int,int)), this, SLOT(onDownloadStatusChanged(int,int,int)), Qt::DirectConnection);
+    connect(&m_downloadManager, SIGNAL(downloadTimeRemain(int,int)), this, SLOT(onDownloadTimeRemain(int,int)), Qt::DirectConnection);
+    connect(&m_downloadManager, SIGNAL(noReceivedData(int)), this, SLOT(onNoReceivedData(int)), Qt::DirectConnection);
+
+    if (!socketName.isEmpty()) {
+        m_controlServer = new ControlServer(&m_downloadManager, this);
+        Q_ASSERT(m_controlServer != 0);
+        if (!m_controlServer->listen(socketName))
+            return false;
+    }
+
+    qDebug() << __PRETTY_FUNCTION__ << " Download daemon started, database = " << dbPath;
+    return true;
+}
+
+DownloadManager *DownloadDaemon::getDownloadManager()
+{
+    return &m_downloadManager;
+}
+
+void DownloadDaemon::setMetricsFile(const QString &filePath)
+{
+    m_metricsFilePath = filePath;
+
+    if (m_metricsFilePath.isEmpty()) {
+        m_metricsTimer->stop();
+        return;
+    }
+
+    slotExportMetrics();
+    m_metricsTimer->start();
+}
+
+void DownloadDaemon::slotExportMetrics()
+{
+    if (!m_metricsFilePath.isEmpty())
+        MetricsRegistry::instance()->exportToFile(m_metricsFilePath);
+}
+
+bool DownloadDaemon::installSignalHandlers()
+{
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, s_signalPipe) != 0) {
+        qDebug() << __PRETTY_FUNCTION__ << " Could not create the signal pipe";
+        return false;
+    }
+    ::fcntl(s_signalPipe[1], F_SETFL, O_NONBLOCK);
+
+    m_signalNotifier = new QSocketNotifier(s_signalPipe[0], QSocketNotifier::Read, this);
+    Q_ASSERT(m_signalNotifier != 0);
+    connect(m_signalNotifier, SIGNAL(activated(int)), this, SLOT(slotSignalReceived()));
+
+    struct sigaction action;
+    action.sa_handler = DownloadDaemon::signalHandler;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+
+    if (::sigaction(SIGTERM, &action, 0) != 0 || ::sigaction(SIGINT, &action, 0) != 0) {
+        qDebug() << __PRETTY_FUNCTION__ << " Could not install the signal handlers";
+        return false;
+    }
+
+    // A closed control client must not kill the daemon
+    ::signal(SIGPIPE, SIG_IGN);
+    return true;
+}
+
+void DownloadDaemon::signalHandler(int signalNumber)
+{
+    char value = (char)signalNumber;
+    ssize_t written = ::write(s_signalPipe[1], &value, sizeof(value));
+    Q_UNUSED(written);
+}
+
+void DownloadDaemon::slotSignalReceived()
+{
+    m_signalNotifier->setEnabled(false);
+    char value = 0;
+    ssize_t count = ::read(s_signalPipe[0], &value, sizeof(value));
+    Q_UNUSED(count);
+
+    qDebug() << __PRETTY_FUNCTION__ << " Received signal " << (int)value << ", quitting";
+    QCoreApplication::quit();
+}
+
+void DownloadDaemon::onDownloadTimeRemain(int downloadId, int remainTime)
+{
+    qDebug() << __PRETTY_FUNCTION__ << "downloadId = " << downloadId << ", remainTime = " << remainTime;
+}
+
+void DownloadDaemon::onNoReceivedData(int downloadId)
+{
+    qDebug() << __PRETTY_FUNCTION__ << "downloadId = " << downloadId;
+}
+
+void DownloadDaemon::onDownloadFinished(int contactId, int downloadId, const QString &filePath, int urlType)
+{
+    qDebug() << __PRETTY_FUNCTION__ << "downloadId = " << downloadId << ", contactId = " << contactId
+                << ", filePath = " << filePath << ", urlType = " << urlType;
+}
+
+void DownloadDaemon::onDownloadError(int downloadId, int errorCode)
+{
+    qDebug() << __PRETTY_FUNCTION__ << "downloadId = " << downloadId << ", errorCode = " << errorCode;
+}
+
+void DownloadDaemon::onContactDownloadError(int contactId, int errorCode)
+{
+    qDebug() << __PRETTY_FUNCTION__ << "contactId = " << contactId << ", errorCode = " << errorCode;
+}
+
+void DownloadDaemon::onDownloadStatusChanged(int contactId, int downloadId, int downloadStatus)
+{
+    qDebug() << __PRETTY_FUNCTION__ << "downloadId = " << downloadId << ", contactId = " << contactId
+                << ", downloadStatus = " << downloadStatus;
+}
+
+DownloadDaemon::~DownloadDaemon()
+{
+    ::signal(SIGTERM, SIG_DFL);
+    ::signal(SIGINT, SIG_DFL);
+
+    if (m_signalNotifier)
+        m_signalNotifier->setEnabled(false);
+
+    // Last values for the scrapers
+    slotExportMetrics();
+
+    // Stop serving before the download manager goes away
+    delete m_controlServer;
+    m_controlServer = 0;
+
+    if (s_signalPipe[0] >= 0) {
+        ::close(s_signalPipe[0]);
+        ::close(s_signalPipe[1]);
+        s_signalPipe[0] = -1;
+        s_signalPipe[1] = -1;
+    }
+}
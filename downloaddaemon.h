@@ -0,0 +1,96 @@
+/*!
+ * \file downloaddaemon.h
+ * \brief headless host of the download manager
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#ifndef DOWNLOADDAEMON_H
+#define DOWNLOADDAEMON_H
+
+#include <QObject>
+#include "downloadmanager.h"
+#include "common.h"
+
+class QSocketNotifier;
+class QTimer;
+class ControlServer;
+
+/*!
+ * \brief Runs the DownloadManager without any window.
+ *
+ * SIGTERM and SIGINT quit the event loop, the signal handler only writes to a
+ * pipe which is read back by a QSocketNotifier in the main thread.
+ */
+class DownloadDaemon : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DownloadDaemon(QObject *parent = 0);
+    ~DownloadDaemon();
+
+    /*!
+     * \brief Open the database, install the signal handlers and start the control server
+     * \param dbPath: full path of the sqlite database
+     * \param socketName: name of the local control socket, empty to run without it
+     * \returns true if the daemon is ready, otherwise returns false
+     */
+    bool initialize(const QString &dbPath, const QString &socketName = CONTROL_SOCKET_NAME);
+
+    /*!
+     * \brief Get the download manager run by the daemon
+     */
+    DownloadManager *getDownloadManager();
+
+    /*!
+     * \brief Export the metrics to a file every METRICS_EXPORT_INTERVAL
+     * \param filePath: full path of the file, empty to stop exporting
+     */
+    void setMetricsFile(const QString &filePath);
+
+protected slots:
+
+    // Write the metrics file
+    void slotExportMetrics();
+
+    // Slot when a termination signal arrived
+    void slotSignalReceived();
+
+    void onDownloadTimeRemain(int downloadId, int remainTime);
+
+    void onNoReceivedData(int downloadId);
+
+    void onDownloadFinished(int contactId, int downloadId, const QString &filePath, int urlType);
+
+    void onDownloadError(int downloadId, int errorCode);
+
+    void onContactDownloadError(int contactId, int errorCode);
+
+    void onDownloadStatusChanged(int contactId, int downloadId, int downloadStatus);
+
+protected:
+
+    // Install the SIGTERM and SIGINT handlers
+    bool installSignalHandlers();
+
+    // Async signal safe handler, writes the signal number to the pipe
+    static void signalHandler(int signalNumber);
+
+private:
+    DownloadManager m_downloadManager;
+
+    QSocketNotifier *m_signalNotifier;
+
+    ControlServer *m_controlServer; // serves the control clients
+
+    QString m_metricsFilePath;
+    QTimer *m_metricsTimer;
+
+    static int s_signalPipe[2]; // written by the signal handler, read by the notifier
+};
+
+#endif // DOWNLOADDAEMON_H
@@ -11,10 +11,20 @@
  */
 #include "downloaddao.h"
 #include "download.h"
+#include "queueddownloadtable.h"
 #include <QDebug>
 #include <QSqlQuery>
 #include <QSqlError>
 
+DownloadRecord::DownloadRecord()
+{
+    id = -1;
+    contactId = -1;
+    urlType = DownloadManager::UnknownType;
+    status = DownloadManager::UnknownStatus;
+    parentId = -1;
+}
+
 DownloadDAO::DownloadDAO(DBConnection *dbConnection, QObject *parent) :
     QObject(parent), m_dbConnection(dbConnection)
 {
@@ -25,6 +35,40 @@ void DownloadDAO::initialize()
 {
 }
 
+bool DownloadDAO::createTable()
+{
+    if (!checkDB()) {
+        qDebug() << __PRETTY_FUNCTION__ << ". Database Error";
+        return false;
+    }
+
+    QString createDownloadTableString = QString(
+            "CREATE TABLE IF NOT EXISTS %1(id INTEGER NOT NULL PRIMARY KEY AUTOINCREMENT, "
+            "contact_id INTEGER, url TEXT, url_type INTEGER, status INTEGER, parent_id INTEGER DEFAULT -1)").arg(DOWNLOAD_TABLE_NAME);
+    if (!m_dbConnection->createTable(createDownloadTableString))
+        return false;
+
+    // Databases created before playlists were expanded have no parent_id column
+    QSqlQuery columnQuery(m_dbConnection->getSqlDatabase());
+    if (!columnQuery.exec(QString("PRAGMA table_info(%1)").arg(DOWNLOAD_TABLE_NAME))) {
+        qDebug() << __PRETTY_FUNCTION__ << columnQuery.lastError();
+        return false;
+    }
+    bool hasParentId = false;
+    while (columnQuery.next()) {
+        if (columnQuery.value(1).toString() == "parent_id") {
+            hasParentId = true;
+            break;
+        }
+    }
+
+    if (!hasParentId && !m_dbConnection->createTable(QString("ALTER TABLE %1 ADD COLUMN parent_id INTEGER DEFAULT -1").arg(DOWNLOAD_TABLE_NAME)))
+        return false;
+
+    // The lazy queue reads the queued downloads in id order
+    return m_dbConnection->createTable(QString("CREATE INDEX IF NOT EXISTS %1_status_index ON %1(status, id)").arg(DOWNLOAD_TABLE_NAME));
+}
+
 bool DownloadDAO::checkDB()
 {
     if (!m_dbConnection) {
@@ -48,7 +92,7 @@ int DownloadDAO::checkExistingContactDownload(int contactId)
     }
 
     QSqlQuery q(m_dbConnection->getSqlDatabase());
-    QString queryStr = QString("SELECT id FROM %1 WHERE contact_id = :contact_id").arg(DOWNLOAD_TABLE_NAME);
+    QString queryStr = QString("SELECT id FROM %1 WHERE contact_id = :contact_id AND parent_id < 0").arg(DOWNLOAD_TABLE_NAME);
     QSqlDatabase db = m_dbConnection->getSqlDatabase();
     QSqlQuery selectQuery(db);
     selectQuery.prepare(queryStr);
@@ -67,15 +111,14 @@ int DownloadDAO::checkExistingContactDownload(int contactId)
     return -1;
 }
 
-Download *DownloadDAO::getDownloadByDownloadId(int downloadId)
+bool DownloadDAO::getDownloadByDownloadId(int downloadId, DownloadRecord &record)
 {
     if (!checkDB()) {
         qDebug() << __PRETTY_FUNCTION__ << ". Database Error";
-        return 0;
+        return false;
     }
 
-    QSqlQuery q(m_dbConnection->getSqlDatabase());
-    QString queryStr = QString("SELECT contact_id, url, url_type, status FROM %1 WHERE id = :id").arg(DOWNLOAD_TABLE_NAME);
+    QString queryStr = QString("SELECT contact_id, url, url_type, status, parent_id FROM %1 WHERE id = :id").arg(DOWNLOAD_TABLE_NAME);
     QSqlDatabase db = m_dbConnection->getSqlDatabase();
     QSqlQuery selectQuery(db);
     selectQuery.prepare(queryStr);
@@ -83,39 +126,29 @@ Download *DownloadDAO::getDownloadByDownloadId(int downloadId)
 
     if (!selectQuery.exec()) {
         qDebug() << __PRETTY_FUNCTION__ << selectQuery.lastError();
-        return 0;
+        return false;
     }
 
-    if(selectQuery.next()) {
-        Download *download = new Download;
-        Q_ASSERT(download != 0);
-        Contact *contact = new Contact;
-        Q_ASSERT(contact != 0);
-        int intVal = selectQuery.value(0).toInt();
-        contact->setId(intVal);
-        download->setContact(contact);
-        download->setId(downloadId);
-        QString strVal = selectQuery.value(1).toString();
-        download->setUrl(strVal);
-        intVal = selectQuery.value(2).toInt();
-        download->setUrlType((DownloadManager::UrlType)intVal);
-        intVal = selectQuery.value(3).toInt();
-        download->setDownloadStatus((DownloadManager::DownloadStatus)intVal);
-        return download;
-    }
+    if (!selectQuery.next())
+        return false;
 
-    return 0;
+    record.id = downloadId;
+    record.contactId = selectQuery.value(0).toInt();
+    record.url = selectQuery.value(1).toString();
+    record.urlType = (DownloadManager::UrlType)selectQuery.value(2).toInt();
+    record.status = (DownloadManager::DownloadStatus)selectQuery.value(3).toInt();
+    record.parentId = selectQuery.value(4).toInt();
+    return true;
 }
 
-Download *DownloadDAO::getDownloadByContactId(int contactId)
+bool DownloadDAO::getDownloadByContactId(int contactId, DownloadRecord &record)
 {
     if (!checkDB()) {
         qDebug() << __PRETTY_FUNCTION__ << ". Database Error";
-        return 0;
+        return false;
     }
 
-    QSqlQuery q(m_dbConnection->getSqlDatabase());
-    QString queryStr = QString("SELECT id, url, url_type, status FROM %1 WHERE contact_id = :contact_id").arg(DOWNLOAD_TABLE_NAME);
+    QString queryStr = QString("SELECT id, url, url_type, status, parent_id FROM %1 WHERE contact_id = :contact_id AND parent_id < 0").arg(DOWNLOAD_TABLE_NAME);
     QSqlDatabase db = m_dbConnection->getSqlDatabase();
     QSqlQuery selectQuery(db);
     selectQuery.prepare(queryStr);
@@ -123,28 +156,19 @@ Download *DownloadDAO::getDownloadByContactId(int contactId)
 
     if (!selectQuery.exec()) {
         qDebug() << __PRETTY_FUNCTION__ << selectQuery.lastError();
-        return 0;
+        return false;
     }
 
-    if(selectQuery.next()) {
-        Download *download = new Download;
-        Q_ASSERT(download != 0);
-        Contact *contact = new Contact;
-        Q_ASSERT(contact != 0);
-        contact->setId(contactId);
-        download->setContact(contact);
-        int intVal = selectQuery.value(0).toInt();
-        download->setId(intVal);
-        QString strVal = selectQuery.value(1).toString();
-        download->setUrl(strVal);
-        intVal = selectQuery.value(2).toInt();
-        download->setUrlType((DownloadManager::UrlType)intVal);
-        intVal = selectQuery.value(3).toInt();
-        download->setDownloadStatus((DownloadManager::DownloadStatus)intVal);
-        return download;
-    }
+    if (!selectQuery.next())
+        return false;
 
-    return 0;
+    record.id = selectQuery.value(0).toInt();
+    record.contactId = contactId;
+    record.url = selectQuery.value(1).toString();
+    record.urlType = (DownloadManager::UrlType)selectQuery.value(2).toInt();
+    record.status = (DownloadManager::DownloadStatus)selectQuery.value(3).toInt();
+    record.parentId = selectQuery.value(4).toInt();
+    return true;
 }
 
 int DownloadDAO::addDownload(Download *download)
@@ -160,10 +184,12 @@ int DownloadDAO::addDownload(Download *download)
     contactId = contact->getId();
 
     int id = checkExistingContactDownload(contactId);
-    if (id == -1)
+    if (id == -1) {
         id = insertDownload(download);
-    else
+    } else {
+        download->setId(id);
         updateDownload(download);
+    }
 
     return id;
 }
@@ -184,7 +210,7 @@ int DownloadDAO::insertDownload(Download *download)
         contactId = contact->getId();
 
     QSqlQuery q(m_dbConnection->getSqlDatabase());
-    QString queryStr = QString("INSERT INTO %1(contact_id, url, url_type, status) VALUES(:contact_id, :url, :url_type, :status)").arg(DOWNLOAD_TABLE_NAME);
+    QString queryStr = QString("INSERT INTO %1(contact_id, url, url_type, status, parent_id) VALUES(:contact_id, :url, :url_type, :status, :parent_id)").arg(DOWNLOAD_TABLE_NAME);
     QSqlDatabase db = m_dbConnection->getSqlDatabase();
     QSqlQuery insertQuery(db);
     insertQuery.prepare(queryStr);
@@ -192,6 +218,7 @@ int DownloadDAO::insertDownload(Download *download)
     insertQuery.bindValue(":url", download->getUrl());
     insertQuery.bindValue(":url_type", download->getUrlType());
     insertQuery.bindValue(":status", download->getDownloadStatus());
+    insertQuery.bindValue(":parent_id", download->getParentId());
 
     if (!insertQuery.exec()) {
         qDebug() << __PRETTY_FUNCTION__ << insertQuery.lastError();
@@ -201,6 +228,98 @@ int DownloadDAO::insertDownload(Download *download)
     return insertQuery.lastInsertId().toInt();
 }
 
+int DownloadDAO::addDownload(const QueuedDownload &entry)
+{
+    if (!checkDB()) {
+        qDebug() << __PRETTY_FUNCTION__ << ". Database Error";
+        return -1;
+    }
+
+    if (entry.urls.isEmpty())
+        return -1;
+
+    // Same as addDownload(Download *), the record of the contact is reused
+    int id = checkExistingContactDownload(entry.contactId);
+    QString queryStr;
+    if (id == -1)
+        queryStr = QString("INSERT INTO %1(contact_id, url, url_type, status, parent_id) VALUES(:contact_id, :url, :url_type, :status, :parent_id)").arg(DOWNLOAD_TABLE_NAME);
+    else
+        queryStr = QString("UPDATE %1 SET url = :url, url_type = :url_type, status = :status WHERE id = :id").arg(DOWNLOAD_TABLE_NAME);
+
+    QSqlDatabase db = m_dbConnection->getSqlDatabase();
+    QSqlQuery query(db);
+    query.prepare(queryStr);
+    if (id == -1) {
+        query.bindValue(":contact_id", entry.contactId);
+        query.bindValue(":parent_id", entry.parentId);
+    } else {
+        query.bindValue(":id", id);
+    }
+    query.bindValue(":url", entry.urls.first());
+    query.bindValue(":url_type", entry.urlType);
+    query.bindValue(":status", DownloadManager::Queueing);
+
+    if (!query.exec()) {
+        qDebug() << __PRETTY_FUNCTION__ << query.lastError();
+        return -1;
+    }
+
+    if (id == -1)
+        id = query.lastInsertId().toInt();
+
+    return id;
+}
+
+int DownloadDAO::insertDownloads(QList<QueuedDownload> &entries)
+{
+    if (!checkDB()) {
+        qDebug() << __PRETTY_FUNCTION__ << ". Database Error";
+        return 0;
+    }
+
+    QSqlDatabase db = m_dbConnection->getSqlDatabase();
+    QString queryStr = QString("INSERT INTO %1(contact_id, url, url_type, status, parent_id) VALUES(:contact_id, :url, :url_type, :status, :parent_id)").arg(DOWNLOAD_TABLE_NAME);
+
+    // One transaction and one prepared statement for the whole list
+    bool transaction = db.transaction();
+    QSqlQuery insertQuery(db);
+    insertQuery.prepare(queryStr);
+
+    int insertedCount = 0;
+    for (int i = 0; i < entries.count(); i++) {
+        QueuedDownload &entry = entries[i];
+        if (entry.urls.isEmpty()) {
+            entry.downloadId = -1;
+            continue;
+        }
+
+        insertQuery.bindValue(":contact_id", entry.contactId);
+        insertQuery.bindValue(":url", entry.urls.first());
+        insertQuery.bindValue(":url_type", entry.urlType);
+        insertQuery.bindValue(":status", DownloadManager::Queueing);
+        insertQuery.bindValue(":parent_id", entry.parentId);
+
+        if (!insertQuery.exec()) {
+            qDebug() << __PRETTY_FUNCTION__ << insertQuery.lastError();
+            entry.downloadId = -1;
+            continue;
+        }
+
+        entry.downloadId = insertQuery.lastInsertId().toInt();
+        insertedCount++;
+    }
+
+    if (transaction && !db.commit()) {
+        qDebug() << __PRETTY_FUNCTION__ << db.lastError();
+        db.rollback();
+        for (int i = 0; i < entries.count(); i++)
+            entries[i].downloadId = -1;
+        return 0;
+    }
+
+    return insertedCount;
+}
+
 bool DownloadDAO::updateDownload(Download *download)
 {
     if (!checkDB()) {
@@ -217,11 +336,19 @@ bool DownloadDAO::updateDownload(Download *download)
         contactId = contact->getId();
 
     QSqlQuery q(m_dbConnection->getSqlDatabase());
-    QString queryStr = QString("UPDATE %1 SET url = :url, url_type = :url_type, status = :status WHERE contact_id = :contact_id").arg(DOWNLOAD_TABLE_NAME);
+    // Several rows of a contact exist once a playlist is expanded, a known download only updates its own row
+    QString queryStr;
+    if (download->getId() >= 0)
+        queryStr = QString("UPDATE %1 SET url = :url, url_type = :url_type, status = :status WHERE id = :id").arg(DOWNLOAD_TABLE_NAME);
+    else
+        queryStr = QString("UPDATE %1 SET url = :url, url_type = :url_type, status = :status WHERE contact_id = :contact_id AND parent_id < 0").arg(DOWNLOAD_TABLE_NAME);
     QSqlDatabase db = m_dbConnection->getSqlDatabase();
     QSqlQuery updateQuery(db);
     updateQuery.prepare(queryStr);
-    updateQuery.bindValue(":contact_id", contactId);
+    if (download->getId() >= 0)
+        updateQuery.bindValue(":id", download->getId());
+    else
+        updateQuery.bindValue(":contact_id", contactId);
     updateQuery.bindValue(":url", download->getUrl());
     updateQuery.bindValue(":url_type", download->getUrlType());
     updateQuery.bindValue(":status", download->getDownloadStatus());
@@ -234,6 +361,84 @@ bool DownloadDAO::updateDownload(Download *download)
     return true;
 }
 
+bool DownloadDAO::getQueuedDownloads(int afterId, int limit, QList<QueuedDownload> &entries)
+{
+    if (!checkDB()) {
+        qDebug() << __PRETTY_FUNCTION__ << ". Database Error";
+        return false;
+    }
+
+    QString queryStr = QString("SELECT id, contact_id, url, url_type, parent_id FROM %1 WHERE status = :status AND id > :after_id ORDER BY id LIMIT :limit").arg(DOWNLOAD_TABLE_NAME);
+    QSqlDatabase db = m_dbConnection->getSqlDatabase();
+    QSqlQuery selectQuery(db);
+    selectQuery.setForwardOnly(true);
+    selectQuery.prepare(queryStr);
+    selectQuery.bindValue(":status", DownloadManager::Queueing);
+    selectQuery.bindValue(":after_id", afterId);
+    selectQuery.bindValue(":limit", limit);
+
+    if (!selectQuery.exec()) {
+        qDebug() << __PRETTY_FUNCTION__ << selectQuery.lastError();
+        return false;
+    }
+
+    while (selectQuery.next()) {
+        QueuedDownload entry;
+        entry.downloadId = selectQuery.value(0).toInt();
+        entry.contactId = selectQuery.value(1).toInt();
+        entry.urls << selectQuery.value(2).toString();
+        entry.urlType = (DownloadManager::UrlType)selectQuery.value(3).toInt();
+        entry.parentId = selectQuery.value(4).toInt();
+        entries.append(entry);
+    }
+
+    return true;
+}
+
+int DownloadDAO::requeueInterruptedDownloads()
+{
+    if (!checkDB()) {
+        qDebug() << __PRETTY_FUNCTION__ << ". Database Error";
+        return -1;
+    }
+
+    QString queryStr = QString("UPDATE %1 SET status = :queueing WHERE status = :downloading").arg(DOWNLOAD_TABLE_NAME);
+    QSqlDatabase db = m_dbConnection->getSqlDatabase();
+    QSqlQuery updateQuery(db);
+    updateQuery.prepare(queryStr);
+    updateQuery.bindValue(":queueing", DownloadManager::Queueing);
+    updateQuery.bindValue(":downloading", DownloadManager::Downloading);
+
+    if (!updateQuery.exec()) {
+        qDebug() << __PRETTY_FUNCTION__ << updateQuery.lastError();
+        return -1;
+    }
+
+    return updateQuery.numRowsAffected();
+}
+
+bool DownloadDAO::updateDownloadStatus(int downloadId, DownloadManager::DownloadStatus status)
+{
+    if (!checkDB()) {
+        qDebug() << __PRETTY_FUNCTION__ << ". Database Error";
+        return false;
+    }
+
+    QString queryStr = QString("UPDATE %1 SET status = :status WHERE id = :id").arg(DOWNLOAD_TABLE_NAME);
+    QSqlDatabase db = m_dbConnection->getSqlDatabase();
+    QSqlQuery updateQuery(db);
+    updateQuery.prepare(queryStr);
+    updateQuery.bindValue(":id", downloadId);
+    updateQuery.bindValue(":status", status);
+
+    if (!updateQuery.exec()) {
+        qDebug() << __PRETTY_FUNCTION__ << updateQuery.lastError();
+        return false;
+    }
+
+    return true;
+}
+
 bool DownloadDAO::deleteDownload(Download *download)
 {
     if (!download)
@@ -13,15 +13,40 @@
 #define DOWNLOADDAO_H
 
 #include <QObject>
+#include <QList>
 #include "dbconnection.h"
+#include "downloadmanager.h"
 
 class Download;
+struct QueuedDownload;
+
+/*!
+ * \brief Values of a download record
+ */
+struct DownloadRecord
+{
+    DownloadRecord();
+
+    int id;
+    int contactId;
+    QString url;
+    DownloadManager::UrlType urlType;
+    DownloadManager::DownloadStatus status;
+    int parentId; // id of the playlist download, -1 if it was added by an url
+};
+
 class DownloadDAO : public QObject
 {
     Q_OBJECT
 public:
     explicit DownloadDAO(DBConnection *dbConnection, QObject *parent = 0);
 
+    /*!
+     * \brief Create the download table if it does not exist yet
+     * \returns true if successful, otherwise returns false
+     */
+    bool createTable();
+
     /*!
      * \brief Check the contact download if it is existing
      * \param contactId: contact id of the download
@@ -32,18 +57,18 @@ public:
     /*!
      * \brief Get download by download id
      * \param downloadId: the id of the download
-     * \returns download object
-     * \note The pointer later needs to be release to avoid memory leak
+     * \param record: receives the values of the download
+     * \returns true if the download was found, otherwise returns false
      */
-    Download *getDownloadByDownloadId(int downloadId);
+    bool getDownloadByDownloadId(int downloadId, DownloadRecord &record);
 
     /*!
      * \brief Get download by contact id
      * \param contactId: the id of the contact
-     * \returns download object
-     * \note The pointer later needs to be release to avoid memory leak
+     * \param record: receives the download added for the contact, not the ones expanded from its playlist
+     * \returns true if the download was found, otherwise returns false
      */
-    Download *getDownloadByContactId(int contactId);
+    bool getDownloadByContactId(int contactId, DownloadRecord &record);
 
     /*!
      * \brief Add a download to the database
@@ -52,6 +77,13 @@ public:
      */
     int addDownload(Download *download);
 
+    /*!
+     * \brief Add a queued download to the database
+     * \param entry: values of the download
+     * \returns -1 if failed, otherwise returns the id of the download record
+     */
+    int addDownload(const QueuedDownload &entry);
+
     /*!
      * \brief Insert a download to the database
      * \param download: download entity
@@ -59,6 +91,13 @@ public:
      */
     int insertDownload(Download *download);
 
+    /*!
+     * \brief Insert several queued downloads in one transaction
+     * \param entries: values of the downloads, their downloadId is set to the id of their record or -1 if it failed
+     * \returns number of downloads inserted
+     */
+    int insertDownloads(QList<QueuedDownload> &entries);
+
     /*!
      * \brief Update a download to the database
      * \param download: download entity
@@ -66,6 +105,29 @@ public:
      */
     bool updateDownload(Download *download);
 
+    /*!
+     * \brief Update the status of a download record
+     * \param downloadId: the id of the download
+     * \param status: the new status
+     * \returns true if successful, otherwise returns false
+     */
+    bool updateDownloadStatus(int downloadId, DownloadManager::DownloadStatus status);
+
+    /*!
+     * \brief Get the queued downloads following a download, in id order
+     * \param afterId: id of the last download read, 0 to start from the first one
+     * \param limit: max number of downloads to read, -1 for all of them
+     * \param entries: receives the values of the downloads, only their first url is stored
+     * \returns true if successful, otherwise returns false
+     */
+    bool getQueuedDownloads(int afterId, int limit, QList<QueuedDownload> &entries);
+
+    /*!
+     * \brief Put the downloads interrupted by the last exit back in the queue
+     * \returns number of downloads queued again, -1 if failed
+     */
+    int requeueInterruptedDownloads();
+
     /*!
      * \brief Delete a download from the database
      * \param download: download entity
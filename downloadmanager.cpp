@@ -43,6 +43,11 @@ void DownloadManager::addUrl(const QString &url, int contactId)
     QMetaObject::invokeMethod(m_downloadManagerImpl, "addUrl", Qt::QueuedConnection, Q_ARG(QString, url), Q_ARG(int, contactId));
 }
 
+void DownloadManager::addUrls(const QStringList &urls, int contactId)
+{
+    QMetaObject::invokeMethod(m_downloadManagerImpl, "addUrls", Qt::QueuedConnection, Q_ARG(QStringList, urls), Q_ARG(int, contactId));
+}
+
 int DownloadManager::getUrlTypeByUrl(const QString &url)
 {
     return m_downloadManagerImpl->getUrlTypeByUrl(url);
@@ -78,6 +83,37 @@ bool DownloadManager::stopDownload(int downloadId)
     return m_downloadManagerImpl->stopDownload(downloadId);
 }
 
+bool DownloadManager::seekDownload(int downloadId, qint64 offset)
+{
+    return m_downloadManagerImpl->seekDownload(downloadId, offset);
+}
+
+void DownloadManager::setRetryPolicy(int maxAttempts, int baseDelay, int maxDelay)
+{
+    QMetaObject::invokeMethod(m_downloadManagerImpl, "setRetryPolicy", Qt::QueuedConnection,
+                              Q_ARG(int, maxAttempts), Q_ARG(int, baseDelay), Q_ARG(int, maxDelay));
+}
+
+void DownloadManager::setMaxConcurrentDownloads(int count)
+{
+    QMetaObject::invokeMethod(m_downloadManagerImpl, "setMaxConcurrentDownloads", Qt::QueuedConnection, Q_ARG(int, count));
+}
+
+void DownloadManager::setPlaylistExpansion(bool enabled)
+{
+    QMetaObject::invokeMethod(m_downloadManagerImpl, "setPlaylistExpansion", Qt::QueuedConnection, Q_ARG(bool, enabled));
+}
+
+void DownloadManager::setStreamingMode(bool enabled, bool prefetchTail)
+{
+    QMetaObject::invokeMethod(m_downloadManagerImpl, "setStreamingMode", Qt::QueuedConnection, Q_ARG(bool, enabled), Q_ARG(bool, prefetchTail));
+}
+
+void DownloadManager::setLazyQueue(bool enabled)
+{
+    QMetaObject::invokeMethod(m_downloadManagerImpl, "setLazyQueue", Qt::QueuedConnection, Q_ARG(bool, enabled));
+}
+
 int DownloadManager::getCurrentRemainTimeByDownload(int downloadId)
 {
     return m_downloadManagerImpl->getCurrentRemainTimeByDownload(downloadId);
@@ -88,6 +124,46 @@ int DownloadManager::getCurrentRemainTimeByContact(int contactId)
     return m_downloadManagerImpl->getCurrentRemainTimeByContact(contactId);
 }
 
+int DownloadManager::getCurrentSpeedByDownload(int downloadId)
+{
+    return m_downloadManagerImpl->getCurrentSpeedByDownload(downloadId);
+}
+
+int DownloadManager::getInstantSpeedByDownload(int downloadId)
+{
+    return m_downloadManagerImpl->getInstantSpeedByDownload(downloadId);
+}
+
+qint64 DownloadManager::getBytesReceivedByDownload(int downloadId)
+{
+    return m_downloadManagerImpl->getBytesReceivedByDownload(downloadId);
+}
+
+qint64 DownloadManager::getBytesTotalByDownload(int downloadId)
+{
+    return m_downloadManagerImpl->getBytesTotalByDownload(downloadId);
+}
+
+qint64 DownloadManager::getWireBytesReceivedByDownload(int downloadId)
+{
+    return m_downloadManagerImpl->getWireBytesReceivedByDownload(downloadId);
+}
+
+qint64 DownloadManager::getContiguousBytesByDownload(int downloadId)
+{
+    return m_downloadManagerImpl->getContiguousBytesByDownload(downloadId);
+}
+
+QVariantMap DownloadManager::getDownloadTrace(int downloadId)
+{
+    return m_downloadManagerImpl->getDownloadTrace(downloadId);
+}
+
+bool DownloadManager::dumpTraces(const QString &filePath)
+{
+    return m_downloadManagerImpl->dumpTraces(filePath);
+}
+
 void DownloadManager::release()
 {
     disconnectSignals();
@@ -114,6 +190,11 @@ void DownloadManager::setDBStoragePath(const QString &dbPath)
     return m_downloadManagerImpl->setDBStoragePath(dbPath);
 }
 
+bool DownloadManager::loadMediaTypes(const QString &filePath)
+{
+    return m_downloadManagerImpl->loadMediaTypes(filePath);
+}
+
 void DownloadManager::connectSignals()
 {
     connect(m_downloadManagerImpl, SIGNAL(contactDownloadError(int,int)), this, SIGNAL(contactDownloadError(int,int)), Qt::DirectConnection);
@@ -122,6 +203,9 @@ void DownloadManager::connectSignals()
     connect(m_downloadManagerImpl, SIGNAL(downloadStatusChanged(int,int,int)), this, SIGNAL(downloadStatusChanged(int,int,int)), Qt::DirectConnection);
     connect(m_downloadManagerImpl, SIGNAL(downloadTimeRemain(int,int)), this, SIGNAL(downloadTimeRemain(int,int)), Qt::DirectConnection);
     connect(m_downloadManagerImpl, SIGNAL(noReceivedData(int)), this, SIGNAL(noReceivedData(int)), Qt::DirectConnection);
+    connect(m_downloadManagerImpl, SIGNAL(playlistProgress(int,int,int,int)), this, SIGNAL(playlistProgress(int,int,int,int)), Qt::DirectConnection);
+    connect(m_downloadManagerImpl, SIGNAL(playlistFinished(int,int,int,int)), this, SIGNAL(playlistFinished(int,int,int,int)), Qt::DirectConnection);
+    connect(m_downloadManagerImpl, SIGNAL(contiguousBytesAvailable(int,qint64)), this, SIGNAL(contiguousBytesAvailable(int,qint64)), Qt::DirectConnection);
 }
 
 void DownloadManager::disconnectSignals()
@@ -132,6 +216,9 @@ void DownloadManager::disconnectSignals()
     disconnect(m_downloadManagerImpl, SIGNAL(downloadStatusChanged(int,int,int)), this, SIGNAL(downloadStatusChanged(int,int,int)));
     disconnect(m_downloadManagerImpl, SIGNAL(downloadTimeRemain(int,int)), this, SIGNAL(downloadTimeRemain(int,int)));
     disconnect(m_downloadManagerImpl, SIGNAL(noReceivedData(int)), this, SIGNAL(noReceivedData(int)));
+    disconnect(m_downloadManagerImpl, SIGNAL(playlistProgress(int,int,int,int)), this, SIGNAL(playlistProgress(int,int,int,int)));
+    disconnect(m_downloadManagerImpl, SIGNAL(playlistFinished(int,int,int,int)), this, SIGNAL(playlistFinished(int,int,int,int)));
+    disconnect(m_downloadManagerImpl, SIGNAL(contiguousBytesAvailable(int,qint64)), this, SIGNAL(contiguousBytesAvailable(int,qint64)));
 }
 
 DownloadManager::~DownloadManager()
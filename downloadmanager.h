@@ -14,6 +14,7 @@
 
 #include <QObject>
 #include <QStringList>
+#include <QVariantMap>
 #include <QSslError>
 
 class DownloadManagerImpl;
@@ -96,6 +97,16 @@ public:
      */
     Q_INVOKABLE void addUrl(const QString &url, int contactId);
 
+    /*!
+     * \brief Add a file served by several mirrors to queue to download
+     * \param urls: urls of the same file, the first one gives the type and the file name
+     * \param contactId: the id of the contact from database
+     * \note the fastest mirror is selected when the download starts and the others are used on failures
+     * \note an url without a known extension is classified by the Content-Type and the first bytes of
+     * the answer, the download fails with UnknownUrlType if neither is known
+     */
+    Q_INVOKABLE void addUrls(const QStringList &urls, int contactId);
+
     /*!
      * \brief Get url type
      * \param url: url of the file
@@ -148,6 +159,15 @@ public:
      */
     Q_INVOKABLE bool stopDownload(int downloadId);
 
+    /*!
+     * \brief Fetch a streamed download from an offset before the rest of the file
+     * \param downloadId: the id of the download
+     * \param offset: position the player moved to
+     * \returns true if the running download was asked to fetch the offset first, otherwise returns false
+     * \note only for downloads in streaming mode, ignored if the server does not serve ranges
+     */
+    Q_INVOKABLE bool seekDownload(int downloadId, qint64 offset);
+
     /*!
      * \brief QML calls this when a contact is removed to delete the download links this contact from the database
      * \param contactId: the id of the contact
@@ -162,6 +182,51 @@ public:
      */
     Q_INVOKABLE void setDBStoragePath(const QString &dbPath);
 
+    /*!
+     * \brief Replace the supported types and their policies by the ones of an ini file
+     * \param filePath: full file path name
+     * \returns true if the file was loaded, otherwise the current types are kept
+     * \note call it before the first url is added, it returns false once the engine uses the types.
+     * MEDIA_TYPES_FILE is loaded at startup if it exists
+     */
+    Q_INVOKABLE bool loadMediaTypes(const QString &filePath);
+
+    /*!
+     * \brief Set the retry policy for transient errors
+     * \param maxAttempts: max number of retries of a download, 0 disables retrying
+     * \param baseDelay: delay before the first retry calculated by second
+     * \param maxDelay: upper bound of the delay between retries calculated by second
+     */
+    Q_INVOKABLE void setRetryPolicy(int maxAttempts, int baseDelay, int maxDelay);
+
+    /*!
+     * \brief Set the max number of downloads running at the same time
+     * \param count: number of downloads, 0 keeps every download in the queue
+     */
+    Q_INVOKABLE void setMaxConcurrentDownloads(int count);
+
+    /*!
+     * \brief Enable the expansion of downloaded .pls playlists
+     * \param enabled: true to download the entries of a playlist once it is downloaded
+     * \note the entries are child downloads of the same contact, see playlistProgress and playlistFinished
+     */
+    Q_INVOKABLE void setPlaylistExpansion(bool enabled);
+
+    /*!
+     * \brief Fetch the files of the streamed types in playback order
+     * \param enabled: true to keep the start of the file sequential, see contiguousBytesAvailable and MediaTypePolicy
+     * \param prefetchTail: true to also fetch the end of the file early, where some containers keep their index
+     * \note applies to the downloads started afterwards
+     */
+    Q_INVOKABLE void setStreamingMode(bool enabled, bool prefetchTail);
+
+    /*!
+     * \brief Keep the queue in the database and only the next QUEUE_WINDOW_SIZE downloads in memory
+     * \param enabled: true to read the queued downloads from the database as the running ones complete
+     * \note call it after setDBStoragePath(), enabled at startup the queue of the last run starts again
+     */
+    Q_INVOKABLE void setLazyQueue(bool enabled);
+
     /*!
      * \brief get current remain time by download id
      * \returns current remain time
@@ -176,6 +241,59 @@ public:
      */
     Q_INVOKABLE int getCurrentRemainTimeByContact(int contactId);
 
+    /*!
+     * \brief get current smoothed speed by download id
+     * \returns speed averaged over the last few seconds calculated by byte/s
+     * \returns -1 if it is not known yet
+     */
+    Q_INVOKABLE int getCurrentSpeedByDownload(int downloadId);
+
+    /*!
+     * \brief get instantaneous speed by download id
+     * \returns speed over the last sample interval calculated by byte/s
+     * \returns -1 if it is not known yet
+     */
+    Q_INVOKABLE int getInstantSpeedByDownload(int downloadId);
+
+    /*!
+     * \brief get received bytes by download id
+     * \returns number of bytes received, -1 if the download is not running
+     */
+    Q_INVOKABLE qint64 getBytesReceivedByDownload(int downloadId);
+
+    /*!
+     * \brief get total bytes by download id
+     * \returns size of the file, -1 if the download is not running or the size is unknown
+     */
+    Q_INVOKABLE qint64 getBytesTotalByDownload(int downloadId);
+
+    /*!
+     * \brief get the bytes received from the network by download id
+     * \returns number of bytes of the current attempt before content decoding, -1 if the download is not running
+     */
+    Q_INVOKABLE qint64 getWireBytesReceivedByDownload(int downloadId);
+
+    /*!
+     * \brief get the playable bytes by download id
+     * \returns number of bytes written from the start of the file without any gap, -1 if the download is not running
+     */
+    Q_INVOKABLE qint64 getContiguousBytesByDownload(int downloadId);
+
+    /*!
+     * \brief get the phase timestamps of a download
+     * \returns downloadId, contactId, attempt and the time of each reached phase calculated by
+     * milisecond since the epoch: queued, dequeued, requestSent, firstByte, lastByte, fileClosed,
+     * statusWritten. Empty if the download is unknown
+     */
+    Q_INVOKABLE QVariantMap getDownloadTrace(int downloadId);
+
+    /*!
+     * \brief write the traces of the recent and running downloads as Chrome trace event JSON
+     * \param filePath: full path of the file, to be loaded in chrome://tracing
+     * \returns true if the file was written, otherwise returns false
+     */
+    Q_INVOKABLE bool dumpTraces(const QString &filePath);
+
 signals:
 
     /*!
@@ -229,6 +347,31 @@ signals:
      */
     void downloadStatusChanged(int contactId, int downloadId, int downloadStatus);
 
+    /*!
+     * \brief emitted when a child download of an expanded playlist completed
+     * \param contactId: the id of the contact
+     * \param playlistId: id of the playlist download
+     * \param completedCount: number of finished or failed entries
+     * \param totalCount: number of entries of the playlist
+     */
+    void playlistProgress(int contactId, int playlistId, int completedCount, int totalCount);
+
+    /*!
+     * \brief emitted when every entry of an expanded playlist completed
+     * \param contactId: the id of the contact
+     * \param playlistId: id of the playlist download
+     * \param finishedCount: number of entries downloaded
+     * \param failedCount: number of entries that failed
+     */
+    void playlistFinished(int contactId, int playlistId, int finishedCount, int failedCount);
+
+    /*!
+     * \brief emitted in streaming mode when more of the start of the file can be read
+     * \param downloadId: id of download
+     * \param bytesAvailable: bytes written from the start of the file without any gap
+     */
+    void contiguousBytesAvailable(int downloadId, qint64 bytesAvailable);
+
 protected:
 
     // Start up the object
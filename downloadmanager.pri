@@ -0,0 +1,60 @@
+#-------------------------------------------------
+#
+# Download engine shared by the GUI and the headless builds,
+# it only needs QtCore, QtNetwork and QtSql. Paths are relative to this file
+# so projects in other directories can include it
+#
+#-------------------------------------------------
+
+QT       += core network sql
+
+INCLUDEPATH += $$PWD
+
+# Content-Encoding decoding
+LIBS += -lz
+
+SOURCES += $$PWD/downloadmanager.cpp \
+    $$PWD/downloaddao.cpp \
+    $$PWD/download.cpp \
+    $$PWD/dbconnection.cpp \
+    $$PWD/contact.cpp \
+    $$PWD/downloadthread.cpp \
+    $$PWD/downloadmanagerimpl.cpp \
+    $$PWD/downloadprogresstable.cpp \
+    $$PWD/speedestimator.cpp \
+    $$PWD/downloadtimerwheel.cpp \
+    $$PWD/retrypolicy.cpp \
+    $$PWD/metricsregistry.cpp \
+    $$PWD/downloadtrace.cpp \
+    $$PWD/streamdecoder.cpp \
+    $$PWD/downloadcachedao.cpp \
+    $$PWD/contentstore.cpp \
+    $$PWD/playlistparser.cpp \
+    $$PWD/contentsniffer.cpp \
+    $$PWD/urltypeclassifier.cpp \
+    $$PWD/mediatyperegistry.cpp \
+    $$PWD/queueddownloadtable.cpp
+
+HEADERS += $$PWD/downloadmanager.h \
+    $$PWD/downloaddao.h \
+    $$PWD/download.h \
+    $$PWD/dbconnection.h \
+    $$PWD/contact.h \
+    $$PWD/common.h \
+    $$PWD/downloadthread.h \
+    $$PWD/downloadmanagerimpl.h \
+    $$PWD/downloadprogresstable.h \
+    $$PWD/speedestimator.h \
+    $$PWD/downloadtimerwheel.h \
+    $$PWD/retrypolicy.h \
+    $$PWD/metricsregistry.h \
+    $$PWD/downloadtrace.h \
+    $$PWD/streamdecoder.h \
+    $$PWD/downloadcachedao.h \
+    $$PWD/contentstore.h \
+    $$PWD/playlistparser.h \
+    $$PWD/contentsniffer.h \
+    $$PWD/urltypeclassifier.h \
+    $$PWD/mediatyperegistry.h \
+    $$PWD/queueddownloadtable.h \
+    $$PWD/objectpool.h
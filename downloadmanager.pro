@@ -9,26 +9,12 @@ QT       += core gui network sql webkit
 TARGET = downloadmanager
 TEMPLATE = app
 
+include(downloadmanager.pri)
 
 SOURCES += main.cpp\
-        mainwindow.cpp \
-    downloadmanager.cpp \
-    downloaddao.cpp \
-    download.cpp \
-    dbconnection.cpp \
-    contact.cpp \
-    downloadthread.cpp \
-    downloadmanagerimpl.cpp
-
-HEADERS  += mainwindow.h \
-    downloadmanager.h \
-    downloaddao.h \
-    download.h \
-    dbconnection.h \
-    contact.h \
-    common.h \
-    downloadthread.h \
-    downloadmanagerimpl.h
+        mainwindow.cpp
+
+HEADERS  += mainwindow.h
 
 MOC_DIR += build/moc
 OBJECTS_DIR += build/obj
@@ -0,0 +1,28 @@
+#-------------------------------------------------
+#
+# Headless download manager daemon, no QtGui/QtWebKit
+#
+#-------------------------------------------------
+
+QT       = core network sql
+
+TARGET = downloadmanagerd
+TEMPLATE = app
+CONFIG   += console
+CONFIG   -= app_bundle
+
+include(downloadmanager.pri)
+
+SOURCES += daemonmain.cpp \
+    downloaddaemon.cpp \
+    controlserver.cpp \
+    manifestloader.cpp
+
+HEADERS  += downloaddaemon.h \
+    controlserver.h \
+    manifestloader.h
+
+# Separate from the GUI build, both projects share the source directory
+MOC_DIR += build/daemon/moc
+OBJECTS_DIR += build/daemon/obj
+DESTDIR += bin
@@ -13,37 +13,75 @@
 #include "contact.h"
 #include "dbconnection.h"
 #include <QDebug>
+#include <limits.h>
 #include "download.h"
 #include "downloaddao.h"
+#include "downloadcachedao.h"
+#include "contentstore.h"
+#include "playlistparser.h"
 #include "dbconnection.h"
 #include "downloadmanager.h"
+#include "downloadprogresstable.h"
+#include "downloadtimerwheel.h"
+#include "metricsregistry.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
 
 DownloadManagerImpl::DownloadManagerImpl(QObject *parent) :
-    QObject(parent)
+    QObject(parent), m_downloadPool(DOWNLOAD_POOL_CAPACITY)
 {
     m_dbConnection = 0;
     m_downloadDAO = 0;
+    m_downloadCacheDAO = 0;
+    m_contentStore = 0;
+    m_progressTable = 0;
+    m_timerWheel = 0;
+    m_maxConcurrentDownloads = MAX_CONCURRENT_DOWNLOAD_THREADS;
+    m_playlistExpansion = false;
+    m_lazyQueue = false;
+    m_queueCursor = 0;
+    m_queueExhausted = true;
+    m_streamingMode = false;
+    m_streamingTail = false;
 
     initialize();
 }
 
 void DownloadManagerImpl::initialize()
 {
-    // Initialize supported types
-    m_supportedMusicTypeList << ".mp3" << ".ogg";
-    m_supportedVideoTypeList << ".avi" << ".ogv";
-    m_supportedApplicationTypeList << ".wgt";
-    m_supportedPlaylistTypeList << ".pls";
+    // Initialize supported types, the built-in ones are kept without a registry file
+    QString mediaTypesPath = QDir::homePath() + MEDIA_TYPES_FILE;
+    if (QFile::exists(mediaTypesPath))
+        loadMediaTypes(mediaTypesPath);
 
     m_dbConnection = new DBConnection();
     Q_ASSERT(m_dbConnection != 0);
     m_downloadDAO = new DownloadDAO(m_dbConnection);
     Q_ASSERT(m_downloadDAO != 0);
+    m_downloadCacheDAO = new DownloadCacheDAO(m_dbConnection);
+    Q_ASSERT(m_downloadCacheDAO != 0);
+
+    m_progressTable = new DownloadProgressTable();
+    Q_ASSERT(m_progressTable != 0);
+
+    m_contentStore = new ContentStore(QDir::homePath() + SAVED_DOWNLOAD_DIRECTORY + CONTENT_STORE_DIRECTORY);
+    Q_ASSERT(m_contentStore != 0);
+    int prunedCount = m_contentStore->prune();
+    if (prunedCount > 0)
+        qDebug() << __PRETTY_FUNCTION__ << " Removed " << prunedCount << " unused objects from the content store";
+
+    // Child object, moves to the manager thread with this object
+    m_timerWheel = new DownloadTimerWheel(this);
+    Q_ASSERT(m_timerWheel != 0);
 }
 
 bool DownloadManagerImpl::isDownloadExistingInQueue(int contactId)
 {
-    for (int i = 0; i < m_downloadQueue.count(); i++) {
+    m_mutexLocker.lock();
+    bool existing = (m_queuedTable.findByContactId(contactId) >= 0);
+    for (int i = 0; i < m_downloadQueue.count() && !existing; i++) {
         Download *download = m_downloadQueue.at(i);
         if (download == 0)
             continue;
@@ -51,8 +89,19 @@ bool DownloadManagerImpl::isDownloadExistingInQueue(int contactId)
         if (contact == 0)
             continue;
         if (contact->getId() == contactId)
-            return true;
+            existing = true;
     }
+    bool onDisk = m_lazyQueue && !m_queueExhausted;
+    int queueCursor = m_queueCursor;
+    m_mutexLocker.unlock();
+
+    if (existing)
+        return true;
+
+    // The lazy queue keeps the downloads after its window in the database only
+    DownloadRecord record;
+    if (onDisk && m_downloadDAO->getDownloadByContactId(contactId, record))
+        return record.status == DownloadManager::Queueing && record.id > queueCursor;
 
     return false;
 }
@@ -68,13 +117,20 @@ bool DownloadManagerImpl::isDownloadExistingInList(int contactId)
 
 void DownloadManagerImpl::addUrl(const QString &url, int contactId)
 {
-    DownloadManager::UrlType urlType = (DownloadManager::UrlType)getUrlTypeByUrl(url);
-    if (urlType == DownloadManager::UnknownType) {
+    addUrls(QStringList() << url, contactId);
+}
+
+void DownloadManagerImpl::addUrls(const QStringList &urls, int contactId)
+{
+    if (urls.isEmpty()) {
         // Emits contact download error signal
         emit contactDownloadError(contactId, DownloadManager::UnknownUrlType);
         return;
     }
 
+    // An url without a known extension is classified by the answer of the server, see ContentSniffer
+    DownloadManager::UrlType urlType = (DownloadManager::UrlType)getUrlTypeByUrl(urls.first());
+
     if (isDownloadExistingInQueue(contactId))  {
         // Emits contact download error signal
         emit contactDownloadError(contactId, DownloadManager::DownloadInQueue);
@@ -87,40 +143,93 @@ void DownloadManagerImpl::addUrl(const QString &url, int contactId)
         return;
     }
 
-    // Create objects and add to the queue
-    Contact *contact = new Contact();
-    Q_ASSERT(contact != 0);
-    contact->setId(contactId);
-
+    // The queue only keeps the values, the download object is created when it starts
     DownloadManager::DownloadStatus downloadStatus = DownloadManager::Queueing;
-    Download *download = new Download();
-    Q_ASSERT(download != 0);
-    download->setUrl(url);
-    download->setDownloadStatus(downloadStatus);
-    download->setUrlType(urlType);
-    download->setContact(contact);
-
-    m_mutexLocker.lock();
-    // Add download to the queue
-    m_downloadQueue.enqueue(download);
-    m_mutexLocker.unlock();
+    QueuedDownload entry;
+    entry.contactId = contactId;
+    entry.urlType = urlType;
+    entry.urls = urls;
+    entry.queuedTime = QDateTime::currentMSecsSinceEpoch();
 
     // Add params to the download table
-    int downloadId = m_downloadDAO->addDownload(download);
+    entry.downloadId = m_downloadDAO->addDownload(entry);
 
-    if (downloadId < 0) {
+    if (entry.downloadId < 0) {
         emit contactDownloadError(contactId, DownloadManager::CanNotInsertDownloadToDB);
         return;
     }
 
-    download->setId(downloadId);
+    m_mutexLocker.lock();
+    // Add download to the queue
+    appendQueuedDownload(entry);
+    m_mutexLocker.unlock();
 
     // Emit download status change signal
-    emit downloadStatusChanged(contactId, downloadId, (int)downloadStatus);
+    emit downloadStatusChanged(contactId, entry.downloadId, (int)downloadStatus);
 
     checkDownloadQueue();
 }
 
+Download *DownloadManagerImpl::createDownload(const QStringList &urls, int contactId, DownloadManager::UrlType urlType)
+{
+    // The download thread reads the policy of its type
+    useMediaTypes();
+
+    // A pooled download keeps its contact and its thread
+    Download *download = m_downloadPool.acquire();
+    Contact *contact = download->getContact();
+    if (contact == 0) {
+        contact = new Contact();
+        Q_ASSERT(contact != 0);
+        download->setContact(contact);
+    }
+    contact->setId(contactId);
+
+    download->setUrl(urls.first());
+    download->setMirrorUrls(urls);
+    download->setDownloadStatus(DownloadManager::Queueing);
+    download->setUrlType(urlType);
+    download->setProgressTable(m_progressTable);
+    download->setTimerWheel(m_timerWheel);
+    download->setMediaTypes(&m_mediaTypes);
+    connect(download, SIGNAL(retryReady(int)), this, SLOT(slotRetryReady(int)), Qt::DirectConnection);
+
+    return download;
+}
+
+Download *DownloadManagerImpl::materializeDownload(const QueuedDownload &entry)
+{
+    Download *download = createDownload(entry.urls, entry.contactId, entry.urlType);
+    download->setId(entry.downloadId);
+    download->setParentId(entry.parentId);
+    download->markTrace(DownloadTrace::Queued, entry.queuedTime);
+
+    return download;
+}
+
+void DownloadManagerImpl::recycleDownload(Download *download)
+{
+    // The download thread may still be in a slot of the download, it is reset once control is back in the manager thread
+    download->stop();
+    m_recycledList.append(download);
+    if (m_recycledList.count() == 1)
+        QMetaObject::invokeMethod(this, "recycleDownloads", Qt::QueuedConnection);
+}
+
+void DownloadManagerImpl::recycleDownloads()
+{
+    m_mutexLocker.lock();
+    QList<Download *> recycledList = m_recycledList;
+    m_recycledList.clear();
+    m_mutexLocker.unlock();
+
+    // Waits for the threads, the lock must not be held
+    foreach(Download *download, recycledList) {
+        download->reset();
+        m_downloadPool.release(download);
+    }
+}
+
 Download *DownloadManagerImpl::getDownloadByContactId(int contactId)
 {
     QMutexLocker locker(&m_mutexLocker);
@@ -145,6 +254,26 @@ Download *DownloadManagerImpl::getDownloadByContactId(int contactId)
             return download;
     }
 
+    foreach(Download *download, m_retryingList) {
+        if (download == 0)
+            continue;
+        Contact *contact = download->getContact();
+        if (contact == 0)
+            continue;
+        if (contact->getId() == contactId)
+            return download;
+    }
+
+    foreach(Download *download, m_coalescedList) {
+        if (download == 0)
+            continue;
+        Contact *contact = download->getContact();
+        if (contact == 0)
+            continue;
+        if (contact->getId() == contactId)
+            return download;
+    }
+
     return 0;
 }
 
@@ -166,21 +295,142 @@ Download *DownloadManagerImpl::getDownloadByDownloadId(int downloadId)
             return download;
     }
 
+    foreach(Download *download, m_retryingList) {
+        if (download == 0)
+            continue;
+        if (download->getId() == downloadId)
+            return download;
+    }
+
+    foreach(Download *download, m_coalescedList) {
+        if (download == 0)
+            continue;
+        if (download->getId() == downloadId)
+            return download;
+    }
+
     return 0;
 }
 
+// Copy the values of a download, the caller holds the lock keeping it from being recycled
+static void fillDownloadRecord(Download *download, DownloadRecord &record)
+{
+    record.id = download->getId();
+    record.contactId = download->getContact() ? download->getContact()->getId() : -1;
+    record.url = download->getUrl();
+    record.urlType = download->getUrlType();
+    record.status = download->getDownloadStatus();
+    record.parentId = download->getParentId();
+}
+
+// Copy the values of a queued download
+static void fillDownloadRecord(const QueuedDownload &entry, DownloadRecord &record)
+{
+    record.id = entry.downloadId;
+    record.contactId = entry.contactId;
+    record.url = entry.urls.value(0);
+    record.urlType = entry.urlType;
+    record.status = DownloadManager::Queueing;
+    record.parentId = entry.parentId;
+}
+
+bool DownloadManagerImpl::getDownloadRecordByDownloadId(int downloadId, DownloadRecord &record)
+{
+    QMutexLocker locker(&m_mutexLocker);
+    QueuedDownload entry;
+    if (m_queuedTable.getEntry(m_queuedTable.findByDownloadId(downloadId), entry)) {
+        fillDownloadRecord(entry, record);
+        return true;
+    }
+
+    QList<Download *> *lists[] = { &m_downloadQueue, &m_downloadingList, &m_retryingList, &m_coalescedList };
+    for (int i = 0; i < 4; i++) {
+        foreach(Download *download, *lists[i]) {
+            if (download != 0 && download->getId() == downloadId) {
+                fillDownloadRecord(download, record);
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+bool DownloadManagerImpl::getDownloadRecordByContactId(int contactId, DownloadRecord &record)
+{
+    QMutexLocker locker(&m_mutexLocker);
+    QList<Download *> *lists[] = { &m_downloadQueue, &m_downloadingList, &m_retryingList, &m_coalescedList };
+    for (int i = 0; i < 4; i++) {
+        foreach(Download *download, *lists[i]) {
+            if (download != 0 && download->getContact() != 0 && download->getContact()->getId() == contactId) {
+                fillDownloadRecord(download, record);
+                return true;
+            }
+        }
+    }
+
+    QueuedDownload entry;
+    if (m_queuedTable.getEntry(m_queuedTable.findByContactId(contactId), entry)) {
+        fillDownloadRecord(entry, record);
+        return true;
+    }
+
+    return false;
+}
+
 bool DownloadManagerImpl::removeDownloadById(int downloadId)
 {
     QMutexLocker locker(&m_mutexLocker);
+    // A queued download has no object yet
+    QueuedDownload entry;
+    if (m_queuedTable.take(m_queuedTable.findByDownloadId(downloadId), entry))
+        return true;
+
+    Download *download = takeDownloadById(downloadId);
+    if (download == 0)
+        return false;
+
+    // Reused by a next download
+    recycleDownload(download);
+    return true;
+}
+
+Download *DownloadManagerImpl::takeDownloadById(int downloadId)
+{
+    QList<Download *> *lists[] = { &m_downloadQueue, &m_downloadingList, &m_retryingList, &m_coalescedList };
+    for (int i = 0; i < 4; i++) {
+        QList<Download *> &list = *lists[i];
+        for (int j = 0; j < list.count(); j++) {
+            Download *download = list.at(j);
+            if (download != 0 && download->getId() == downloadId) {
+                list.removeAt(j);
+                return download;
+            }
+        }
+    }
+
+    return 0;
+}
+
+bool DownloadManagerImpl::removeDownloadByContactId(int contactId)
+{
+    QMutexLocker locker(&m_mutexLocker);
+    // A queued download has no object yet
+    QueuedDownload entry;
+    if (m_queuedTable.take(m_queuedTable.findByContactId(contactId), entry))
+        return true;
+
     for (int i = 0; i < m_downloadQueue.count(); i++) {
         Download *download = m_downloadQueue.at(i);
         if (download == 0)
             continue;
-        if (download->getId() == downloadId) {
+        Contact *contact = download->getContact();
+        if (contact == 0)
+            continue;
+        if (contact->getId() == contactId) {
             m_downloadQueue.removeAt(i);
-            // Free memory
-            download->stop();
-            download->deleteLater();
+            // Reused by a next download
+            recycleDownload(download);
             return true;
         }
     }
@@ -189,49 +439,43 @@ bool DownloadManagerImpl::removeDownloadById(int downloadId)
         Download *download = m_downloadingList.at(i);
         if (download == 0)
             continue;
-        if (download->getId() == downloadId) {
+        Contact *contact = download->getContact();
+        if (contact == 0)
+            continue;
+        if (contact->getId() == contactId) {
             m_downloadingList.removeAt(i);
-            // Free memory
-            download->stop();
-            download->deleteLater();
+            // Reused by a next download
+            recycleDownload(download);
             return true;
         }
     }
 
-    return false;
-}
-
-bool DownloadManagerImpl::removeDownloadByContactId(int contactId)
-{
-    QMutexLocker locker(&m_mutexLocker);
-    for (int i = 0; i < m_downloadQueue.count(); i++) {
-        Download *download = m_downloadQueue.at(i);
+    for (int i = 0; i < m_retryingList.count(); i++) {
+        Download *download = m_retryingList.at(i);
         if (download == 0)
             continue;
         Contact *contact = download->getContact();
         if (contact == 0)
             continue;
         if (contact->getId() == contactId) {
-            m_downloadQueue.removeAt(i);
-            // Free memory
-            download->stop();
-            download->deleteLater();
+            m_retryingList.removeAt(i);
+            // Reused by a next download
+            recycleDownload(download);
             return true;
         }
     }
 
-    for (int i = 0; i < m_downloadingList.count(); i++) {
-        Download *download = m_downloadingList.at(i);
+    for (int i = 0; i < m_coalescedList.count(); i++) {
+        Download *download = m_coalescedList.at(i);
         if (download == 0)
             continue;
         Contact *contact = download->getContact();
         if (contact == 0)
             continue;
         if (contact->getId() == contactId) {
-            m_downloadingList.removeAt(i);
-            // Free memory
-            download->stop();
-            download->deleteLater();
+            m_coalescedList.removeAt(i);
+            // Reused by a next download
+            recycleDownload(download);
             return true;
         }
     }
@@ -241,22 +485,44 @@ bool DownloadManagerImpl::removeDownloadByContactId(int contactId)
 
 void DownloadManagerImpl::checkDownloadQueue()
 {
+    // Download threads are created here and their timer callbacks are delivered to the creating thread
+    if (QThread::currentThread() != thread()) {
+        QMetaObject::invokeMethod(this, "checkDownloadQueue", Qt::QueuedConnection);
+        return;
+    }
+
+    // The policies of the types order the queue
+    useMediaTypes();
+
     m_mutexLocker.lock();
-    int queueCount = m_downloadQueue.count();
+    requeueCoalescedDownloads();
+    int queueCount = getQueueLength();
     int downloadingCount = m_downloadingList.count();
     m_mutexLocker.unlock();
 
-    while (downloadingCount < MAX_CONCURRENT_DOWNLOAD_THREADS) {
+    while (downloadingCount < m_maxConcurrentDownloads) {
+        // The lazy queue reads the next downloads from the database as its window empties
+        queueCount += refillQueueWindow();
         if (queueCount == 0)
-            return;
+            break;
 
         m_mutexLocker.lock();
-        Download *download = m_downloadQueue.dequeue();
-        // Add the download to the downloading list
-        m_downloadingList.append(download);
+        Download *download = takeNextDownload();
+        if (download == 0) {
+            // Every queued type is at its own limit
+            m_mutexLocker.unlock();
+            break;
+        }
+
+        // Another download already fetches the url, wait for its file instead of a second transfer
+        bool coalesced = (findTransferByUrl(download->getUrl()) != 0);
+        if (coalesced)
+            m_coalescedList.append(download);
+        else
+            m_downloadingList.append(download); // Add the download to the downloading list
 
         // Recalculate params
-        queueCount = m_downloadQueue.count();
+        queueCount = getQueueLength();
         downloadingCount = m_downloadingList.count();
 
         m_mutexLocker.unlock();
@@ -267,99 +533,204 @@ void DownloadManagerImpl::checkDownloadQueue()
         download->setDownloadStatus(downloadStatus);
         m_downloadDAO->updateDownload(download);
 
+        if (coalesced) {
+            download->markTrace(DownloadTrace::Dequeued);
+            MetricsRegistry::instance()->increment(METRIC_DOWNLOADS_COALESCED);
+            emit downloadStatusChanged(download->getContact()->getId(), download->getId(), (int)downloadStatus);
+            continue;
+        }
+
         // Connect signals
         connectDownloadSignals(download);
 
+        // A fresh download only revalidates the copy of a previous one
+        if (download->getRetryCount() == 0)
+            attachCachedCopy(download);
+
+        // The thread applies the streaming policy of the type, once an unknown one is classified too
+        download->setStreaming(m_streamingMode, m_streamingTail);
+
         // Start the download
+        download->markTrace(DownloadTrace::Dequeued);
         download->start();
+        MetricsRegistry::instance()->increment(METRIC_DOWNLOADS_STARTED);
 
         // Emit download status change signal
         emit downloadStatusChanged(download->getContact()->getId(), download->getId(), (int)downloadStatus);
     }
+
+    // Every change of the lists ends here
+    m_mutexLocker.lock();
+    MetricsRegistry::instance()->setGauge(METRIC_QUEUE_LENGTH, getQueueLength());
+    MetricsRegistry::instance()->setGauge(METRIC_ACTIVE_DOWNLOADS, m_downloadingList.count());
+    MetricsRegistry::instance()->setGauge(METRIC_RETRYING_DOWNLOADS, m_retryingList.count());
+    m_mutexLocker.unlock();
+}
+
+Download *DownloadManagerImpl::takeNextDownload()
+{
+    // Running downloads by type, a type at its limit lets the next ones start
+    int runningCounts[MediaTypeRegistry::TypeCount];
+    for (int i = 0; i < MediaTypeRegistry::TypeCount; i++)
+        runningCounts[i] = 0;
+    for (int i = 0; i < m_downloadingList.count(); i++)
+        runningCounts[MediaTypeRegistry::getTypeIndex(m_downloadingList.at(i)->getUrlType())]++;
+
+    // The oldest download of the highest priority class, the ones put back come first
+    int next = -1;
+    int nextPriority = 0;
+    for (int i = 0; i < m_downloadQueue.count(); i++) {
+        int urlType = m_downloadQueue.at(i)->getUrlType();
+        const MediaTypePolicy &policy = m_mediaTypes.getPolicy(urlType);
+        if (policy.maxConcurrentDownloads > 0 && runningCounts[MediaTypeRegistry::getTypeIndex(urlType)] >= policy.maxConcurrentDownloads)
+            continue;
+        if (next < 0 || policy.priority > nextPriority) {
+            next = i;
+            nextPriority = policy.priority;
+        }
+    }
+
+    // The table keeps one list per type, only their first rows are candidates
+    int nextRow = -1;
+    int nextRowPriority = 0;
+    for (int typeIndex = 0; typeIndex < MediaTypeRegistry::TypeCount; typeIndex++) {
+        int row = m_queuedTable.getFirstRow(typeIndex);
+        if (row < 0)
+            continue;
+        const MediaTypePolicy &policy = m_mediaTypes.getPolicy(m_queuedTable.getUrlType(row));
+        if (policy.maxConcurrentDownloads > 0 && runningCounts[typeIndex] >= policy.maxConcurrentDownloads)
+            continue;
+        if (nextRow < 0 || policy.priority > nextRowPriority
+                || (policy.priority == nextRowPriority && m_queuedTable.isQueuedBefore(row, nextRow))) {
+            nextRow = row;
+            nextRowPriority = policy.priority;
+        }
+    }
+
+    if (next >= 0 && (nextRow < 0 || nextPriority >= nextRowPriority))
+        return m_downloadQueue.takeAt(next);
+
+    QueuedDownload entry;
+    if (!m_queuedTable.take(nextRow, entry))
+        return 0;
+
+    return materializeDownload(entry);
 }
 
-QString DownloadManagerImpl::getTextExtension(const QString &text)
+int DownloadManagerImpl::getQueueLength() const
 {
-    int index = text.lastIndexOf(".");
-    if (index < 0)
-        return "";
-    return text.right(text.size()-index);
+    return m_downloadQueue.count() + m_queuedTable.count();
 }
 
-int DownloadManagerImpl::getUrlTypeByUrl(const QString &url)
+void DownloadManagerImpl::appendQueuedDownload(const QueuedDownload &entry)
+{
+    // The database only stores the first url, a download with mirrors always stays in memory
+    if (m_lazyQueue && entry.downloadId > m_queueCursor && entry.urls.count() == 1) {
+        // Read back in id order once the window has room, the ones after it wait in the database
+        if (!m_queueExhausted || m_queuedTable.count() >= QUEUE_WINDOW_SIZE) {
+            m_queueExhausted = false;
+            return;
+        }
+        m_queueCursor = entry.downloadId;
+    }
+
+    m_queuedTable.append(entry);
+}
+
+int DownloadManagerImpl::refillQueueWindow()
 {
-    QString fileExtension = getTextExtension(url);
-    if (fileExtension == "")
-        return DownloadManager::UnknownType;
+    m_mutexLocker.lock();
+    bool refill = m_lazyQueue && !m_queueExhausted && m_queuedTable.count() < QUEUE_WINDOW_LOW_WATERMARK;
+    int limit = QUEUE_WINDOW_SIZE - m_queuedTable.count();
+    m_mutexLocker.unlock();
 
-    if (m_supportedMusicTypeList.contains(fileExtension))
-        return DownloadManager::Music;
+    if (!refill)
+        return 0;
 
-    if (m_supportedVideoTypeList.contains(fileExtension))
-        return DownloadManager::Video;
+    return loadQueuedDownloads(limit);
+}
 
-    if (m_supportedApplicationTypeList.contains(fileExtension))
-        return DownloadManager::Application;
+int DownloadManagerImpl::loadQueuedDownloads(int limit)
+{
+    // Only the manager thread moves the cursor
+    QList<QueuedDownload> entries;
+    if (!m_downloadDAO->getQueuedDownloads(m_queueCursor, limit, entries))
+        return 0;
+
+    // A failed download waiting for its retry is queued in the database too
+    QList<QueuedDownload> loadedList;
+    foreach(const QueuedDownload &entry, entries) {
+        if (getDownloadByDownloadId(entry.downloadId) == 0)
+            loadedList.append(entry);
+    }
 
-    if (m_supportedPlaylistTypeList.contains(fileExtension))
-        return DownloadManager::Playlist;
+    qint64 queuedTime = QDateTime::currentMSecsSinceEpoch();
+    int loadedCount = 0;
+    m_mutexLocker.lock();
+    for (int i = 0; i < loadedList.count(); i++) {
+        QueuedDownload &entry = loadedList[i];
+        if (m_queuedTable.findByDownloadId(entry.downloadId) >= 0)
+            continue;
+        entry.queuedTime = queuedTime;
+        m_queuedTable.append(entry);
+        loadedCount++;
+    }
 
-    return DownloadManager::UnknownType;
+    if (!entries.isEmpty())
+        m_queueCursor = entries.last().downloadId;
+    m_queueExhausted = (limit < 0 || entries.count() < limit);
+    m_mutexLocker.unlock();
+
+    return loadedCount;
+}
+
+int DownloadManagerImpl::getUrlTypeByUrl(const QString &url)
+{
+    useMediaTypes();
+    return m_mediaTypes.classify(url);
 }
 
 int DownloadManagerImpl::getUrlTypeByContactId(int contactId)
 {
-    Download *download = getDownloadByContactId(contactId);
-    if (download)
-        return download->getUrlType();
+    // Read under the lock, the download may be recycled as soon as it is removed
+    DownloadRecord record;
+    if (getDownloadRecordByContactId(contactId, record))
+        return record.urlType;
 
     // Look up from the database
-    download = m_downloadDAO->getDownloadByContactId(contactId);
-    int urlType = DownloadManager::UnknownType;
-    if (download) {
-        urlType = download->getUrlType();
-        // release pointer
-        delete download;
-    }
+    if (m_downloadDAO->getDownloadByContactId(contactId, record))
+        return record.urlType;
 
-    return urlType;
+    return DownloadManager::UnknownType;
 }
 
 int DownloadManagerImpl::getUrlTypeByDownloadId(int downloadId)
 {
-    Download *download = getDownloadByDownloadId(downloadId);
-    if (download)
-        return download->getUrlType();
+    // Read under the lock, the download may be recycled as soon as it is removed
+    DownloadRecord record;
+    if (getDownloadRecordByDownloadId(downloadId, record))
+        return record.urlType;
 
     // Look up from the database
-    download = m_downloadDAO->getDownloadByDownloadId(downloadId);
-    int urlType = DownloadManager::UnknownType;
-    if (download) {
-        urlType = download->getUrlType();
-        // release pointer
-        delete download;
-    }
+    if (m_downloadDAO->getDownloadByDownloadId(downloadId, record))
+        return record.urlType;
 
-    return urlType;
+    return DownloadManager::UnknownType;
 }
 
 int DownloadManagerImpl::getDownloadStatus(int downloadId)
 {
-    Download *download = getDownloadByDownloadId(downloadId);
-    if (download)
-        return download->getDownloadStatus();
+    // Read under the lock, the download may be recycled as soon as it is removed
+    DownloadRecord record;
+    if (getDownloadRecordByDownloadId(downloadId, record))
+        return record.status;
 
     // Look up from the database
-    download = m_downloadDAO->getDownloadByDownloadId(downloadId);
-    int downloadStatus = DownloadManager::UnknownStatus;
-    if (download) {
-        downloadStatus = download->getDownloadStatus();
-        // release pointer
-        delete download;
-    } else
-        qDebug() << __PRETTY_FUNCTION__ << " Could not find the download with id = " << downloadId;
+    if (m_downloadDAO->getDownloadByDownloadId(downloadId, record))
+        return record.status;
 
-    return downloadStatus;
+    qDebug() << __PRETTY_FUNCTION__ << " Could not find the download with id = " << downloadId;
+    return DownloadManager::UnknownStatus;
 }
 
 bool DownloadManagerImpl::pauseDownload(int downloadId)
@@ -381,10 +752,68 @@ bool DownloadManagerImpl::stopDownload(int downloadId)
     return removeAndUpdateDownload(downloadId, DownloadManager::Stopping);
 }
 
+bool DownloadManagerImpl::seekDownload(int downloadId, qint64 offset)
+{
+    // Only a running download has segments to move
+    QMutexLocker locker(&m_mutexLocker);
+    for (int i = 0; i < m_downloadingList.count(); i++) {
+        Download *download = m_downloadingList.at(i);
+        if (download && download->getId() == downloadId)
+            return download->seek(offset);
+    }
+
+    return false;
+}
+
 bool DownloadManagerImpl::removeAndUpdateDownload(int downloadId, DownloadManager::DownloadStatus status)
 {
-    Download *download = getDownloadByDownloadId(downloadId);
+    // A download that never started only has its record and its queued time
+    QueuedDownload entry;
+    m_mutexLocker.lock();
+    bool queued = m_queuedTable.take(m_queuedTable.findByDownloadId(downloadId), entry);
+    m_mutexLocker.unlock();
+    if (queued) {
+        if (!m_downloadDAO->updateDownloadStatus(downloadId, status))
+            qDebug() << __PRETTY_FUNCTION__ << " Could not update information for download with id = " << downloadId;
+
+        DownloadTrace trace;
+        trace.setIds(downloadId, entry.contactId);
+        trace.mark(DownloadTrace::Queued, entry.queuedTime);
+        trace.mark(DownloadTrace::StatusWritten);
+        addTraceToHistory(trace);
+
+        qDebug() << "Remove the download with downloadId = " << downloadId;
+
+        // check download
+        checkDownloadQueue();
+
+        return true;
+    }
+
+    // Out of the lists nobody else can reach it, a concurrent removal does not recycle it under us
+    m_mutexLocker.lock();
+    Download *download = takeDownloadById(downloadId);
+    m_mutexLocker.unlock();
     if (!download) {
+        // The lazy queue keeps the downloads after its window in the database only
+        m_mutexLocker.lock();
+        bool onDisk = m_lazyQueue && !m_queueExhausted && downloadId > m_queueCursor;
+        m_mutexLocker.unlock();
+
+        DownloadRecord record;
+        if (onDisk && m_downloadDAO->getDownloadByDownloadId(downloadId, record) && record.status == DownloadManager::Queueing) {
+            if (!m_downloadDAO->updateDownloadStatus(downloadId, status))
+                qDebug() << __PRETTY_FUNCTION__ << " Could not update information for download with id = " << downloadId;
+
+            DownloadTrace trace;
+            trace.setIds(downloadId, record.contactId);
+            trace.mark(DownloadTrace::StatusWritten);
+            addTraceToHistory(trace);
+
+            qDebug() << "Remove the download with downloadId = " << downloadId;
+            return true;
+        }
+
         qDebug() << "Could not find downloadId = " << downloadId;
 
         // check download
@@ -397,9 +826,13 @@ bool DownloadManagerImpl::removeAndUpdateDownload(int downloadId, DownloadManage
     download->setDownloadStatus(status);
     if (!m_downloadDAO->updateDownload(download))
         qDebug() << __PRETTY_FUNCTION__ << " Could not update information for download with id = " << downloadId;
+    download->markTrace(DownloadTrace::StatusWritten);
+    addTraceToHistory(download->getTrace());
 
-    // Remove the download from the downloading list
-    removeDownloadById(downloadId);
+    // Reused by a next download
+    m_mutexLocker.lock();
+    recycleDownload(download);
+    m_mutexLocker.unlock();
 
     qDebug() << "Remove the download with downloadId = " << downloadId;
 
@@ -409,47 +842,579 @@ bool DownloadManagerImpl::removeAndUpdateDownload(int downloadId, DownloadManage
     return true;
 }
 
+bool DownloadManagerImpl::scheduleRetry(int downloadId, DownloadManager::DownloadErrorCode error)
+{
+    if (!m_retryPolicy.isRetryable(error))
+        return false;
+
+    m_mutexLocker.lock();
+    Download *download = 0;
+    for (int i = 0; i < m_downloadingList.count(); i++) {
+        Download *item = m_downloadingList.at(i);
+        if (item == 0)
+            continue;
+        if (item->getId() == downloadId) {
+            download = item;
+            break;
+        }
+    }
+
+    int attempt = 0;
+    if (download)
+        attempt = download->getRetryCount() + 1;
+
+    if (download == 0 || attempt > m_retryPolicy.getMaxAttempts()) {
+        m_mutexLocker.unlock();
+        return false;
+    }
+
+    // Free the download slot while waiting
+    m_downloadingList.removeOne(download);
+    m_retryingList.append(download);
+    m_mutexLocker.unlock();
+
+    // Stop listening to the failed attempt, it may still report the same failure. A stalled
+    // attempt would keep its connection and write to the file until the retry starts
+    download->abort();
+    disconnectDownloadSignals(download);
+
+    DownloadManager::DownloadStatus downloadStatus = DownloadManager::Queueing;
+    download->setDownloadStatus(downloadStatus);
+    download->setRetryCount(attempt);
+    m_downloadDAO->updateDownload(download);
+
+    int delay = m_retryPolicy.getRetryDelay(attempt);
+    download->scheduleRetry(delay);
+    MetricsRegistry::instance()->increment(METRIC_DOWNLOAD_RETRIES);
+
+    qDebug() << __PRETTY_FUNCTION__ << " Retry " << attempt << " in " << delay << " seconds, downloadId = "
+             << downloadId << ", error = " << error;
+
+    // Emit download status change signal
+    emit downloadStatusChanged(download->getContact()->getId(), downloadId, (int)downloadStatus);
+
+    // Another download can use the slot
+    checkDownloadQueue();
+
+    return true;
+}
+
+void DownloadManagerImpl::slotRetryReady(int downloadId)
+{
+    m_mutexLocker.lock();
+    Download *download = 0;
+    for (int i = 0; i < m_retryingList.count(); i++) {
+        Download *item = m_retryingList.at(i);
+        if (item == 0)
+            continue;
+        if (item->getId() == downloadId) {
+            download = item;
+            m_retryingList.removeAt(i);
+            break;
+        }
+    }
+
+    // It already waited for its turn, put it in front of the queue
+    if (download) {
+        download->markTrace(DownloadTrace::Queued);
+        m_downloadQueue.prepend(download);
+    }
+    m_mutexLocker.unlock();
+
+    checkDownloadQueue();
+}
+
+void DownloadManagerImpl::setRetryPolicy(int maxAttempts, int baseDelay, int maxDelay)
+{
+    m_retryPolicy.setMaxAttempts(maxAttempts);
+    m_retryPolicy.setBaseDelay(baseDelay);
+    m_retryPolicy.setMaxDelay(maxDelay);
+}
+
+void DownloadManagerImpl::setMaxConcurrentDownloads(int count)
+{
+    m_maxConcurrentDownloads = qMax(count, 0);
+
+    // More room, start the waiting downloads
+    checkDownloadQueue();
+}
+
+void DownloadManagerImpl::attachCachedCopy(Download *download)
+{
+    DownloadCacheEntry entry;
+    if (m_downloadCacheDAO == 0 || !m_downloadCacheDAO->getCacheEntry(download->getUrl(), entry)) {
+        download->setCachedCopy(DownloadCacheEntry());
+        return;
+    }
+
+    // The file may have been removed or changed since it was stored
+    QFileInfo fileInfo(entry.filePath);
+    if (!entry.isValid() || !fileInfo.exists() || fileInfo.size() != entry.size) {
+        m_downloadCacheDAO->deleteCacheEntry(entry.url);
+        download->setCachedCopy(DownloadCacheEntry());
+        return;
+    }
+
+    download->setCachedCopy(entry);
+}
+
+void DownloadManagerImpl::updateCachedCopy(Download *download, const QString &filePath)
+{
+    if (m_downloadCacheDAO == 0)
+        return;
+
+    DownloadCacheEntry entry;
+    entry.url = download->getUrl();
+    entry.filePath = filePath;
+    entry.etag = download->getEtag();
+    entry.lastModified = download->getLastModified();
+    entry.size = QFileInfo(filePath).size();
+
+    // Without validators the content cannot be revalidated, forget an older copy
+    if (entry.isValid())
+        m_downloadCacheDAO->saveCacheEntry(entry);
+    else
+        m_downloadCacheDAO->deleteCacheEntry(entry.url);
+}
+
+Download *DownloadManagerImpl::findTransferByUrl(const QString &url)
+{
+    foreach(Download *download, m_downloadingList) {
+        if (download != 0 && download->getUrl() == url)
+            return download;
+    }
+
+    foreach(Download *download, m_retryingList) {
+        if (download != 0 && download->getUrl() == url)
+            return download;
+    }
+
+    return 0;
+}
+
+void DownloadManagerImpl::requeueCoalescedDownloads()
+{
+    // The transfer failed or was removed, the first waiting download starts a new one
+    for (int i = m_coalescedList.count() - 1; i >= 0; i--) {
+        Download *download = m_coalescedList.at(i);
+        if (download == 0 || findTransferByUrl(download->getUrl()) != 0)
+            continue;
+
+        m_coalescedList.removeAt(i);
+        download->setDownloadStatus(DownloadManager::Queueing);
+        download->markTrace(DownloadTrace::Queued);
+        m_downloadQueue.prepend(download);
+    }
+}
+
+void DownloadManagerImpl::finishCoalescedDownloads(const QString &url, const QString &filePath)
+{
+    QList<Download *> waitingList;
+    m_mutexLocker.lock();
+    foreach(Download *download, m_coalescedList) {
+        if (download != 0 && download->getUrl() == url)
+            waitingList.append(download);
+    }
+    m_mutexLocker.unlock();
+
+    foreach(Download *download, waitingList) {
+        // A download failing here starts its own transfer once the current one is removed
+        if (!download->completeFromFile(filePath))
+            continue;
+
+        int contactId = download->getContact()->getId();
+        int downloadId = download->getId();
+        int playlistId = download->getParentId();
+        QString savedFilePath = download->getSavedFilePathName();
+        int type = (int)download->getUrlType();
+        download->markTrace(DownloadTrace::FileClosed);
+        MetricsRegistry::instance()->increment(METRIC_DOWNLOADS_FINISHED);
+
+        emit downloadFinished(contactId, downloadId, savedFilePath, type);
+        removeAndUpdateDownload(downloadId, DownloadManager::Finished);
+        qDebug() << __PRETTY_FUNCTION__ << " Emitted downloadFinished signal, contactId = "
+                 << contactId << ", downloadId = " << downloadId;
+
+        updatePlaylistProgress(playlistId, true);
+    }
+}
+
 void DownloadManagerImpl::slotDownloadFinished(int contactId, int downloadId, const QString &filePath, int type)
 {
+    MetricsRegistry::instance()->increment(METRIC_DOWNLOADS_FINISHED);
+
+    // Emitted by the thread of the download, the download is not recycled before the thread is over
+    Download *download = getDownloadByDownloadId(downloadId);
+
+    // Keep a single copy of the content, the file becomes a link to it. A revalidated copy is already stored.
+    // Hashed in the thread of the store, so the waiting downloads link to the file itself
+    if (m_contentStore && download && !download->isRevalidated() && m_mediaTypes.getPolicy(type).hashContent)
+        m_contentStore->addLater(filePath);
+
+    int playlistId = -1;
+    if (download) {
+        updateCachedCopy(download, filePath);
+        finishCoalescedDownloads(download->getUrl(), filePath);
+        playlistId = download->getParentId();
+
+        // The children are created in the manager thread, this slot runs in the download thread
+        if (m_playlistExpansion && type == DownloadManager::Playlist && playlistId < 0)
+            QMetaObject::invokeMethod(this, "expandPlaylist", Qt::QueuedConnection, Q_ARG(int, downloadId),
+                                      Q_ARG(int, contactId), Q_ARG(QString, download->getUrl()), Q_ARG(QString, filePath));
+    }
+
     emit downloadFinished(contactId, downloadId, filePath, type);
     removeAndUpdateDownload(downloadId, DownloadManager::Finished);
     qDebug() << __PRETTY_FUNCTION__ << " Emitted downloadFinished signal, contactId = "
              << contactId << ", downloadId = " << downloadId;
+
+    updatePlaylistProgress(playlistId, true);
+}
+
+void DownloadManagerImpl::setPlaylistExpansion(bool enabled)
+{
+    m_playlistExpansion = enabled;
+}
+
+void DownloadManagerImpl::setStreamingMode(bool enabled, bool prefetchTail)
+{
+    m_streamingMode = enabled;
+    m_streamingTail = prefetchTail;
+}
+
+void DownloadManagerImpl::setLazyQueue(bool enabled)
+{
+    if (enabled == m_lazyQueue)
+        return;
+
+    if (!enabled) {
+        // The downloads left in the database go back to memory
+        loadQueuedDownloads(-1);
+        m_lazyQueue = false;
+        return;
+    }
+
+    // Nothing ran yet at startup, the downloads interrupted by the last exit start again
+    m_mutexLocker.lock();
+    bool idle = m_downloadingList.isEmpty() && m_retryingList.isEmpty() && m_coalescedList.isEmpty();
+    m_mutexLocker.unlock();
+    if (idle) {
+        int requeuedCount = m_downloadDAO->requeueInterruptedDownloads();
+        if (requeuedCount > 0)
+            qDebug() << __PRETTY_FUNCTION__ << " Queued again " << requeuedCount << " interrupted downloads";
+    }
+
+    // The queue is read from the first queued download, the ones already in memory are skipped
+    m_mutexLocker.lock();
+    m_lazyQueue = true;
+    m_queueCursor = 0;
+    m_queueExhausted = false;
+    m_mutexLocker.unlock();
+
+    checkDownloadQueue();
+}
+
+void DownloadManagerImpl::expandPlaylist(int playlistId, int contactId, const QString &playlistUrl, const QString &filePath)
+{
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qDebug() << __PRETTY_FUNCTION__ << " Could not read playlist " << filePath;
+        return;
+    }
+
+    PlaylistProgress progress;
+    progress.contactId = contactId;
+    progress.totalCount = 0;
+    progress.finishedCount = 0;
+    progress.failedCount = 0;
+    progress.expanded = false;
+    m_playlistMutex.lock();
+    m_playlists.insert(playlistId, progress);
+    m_playlistMutex.unlock();
+
+    // Entries are queued by batch while the playlist is parsed, the first ones start before the end is read
+    PlaylistParser parser(&file, playlistUrl);
+    QList<QueuedDownload> batch;
+    PlaylistEntry entry;
+    forever {
+        bool hasEntry = parser.readEntry(entry);
+        if (hasEntry) {
+            // Entries of unknown type are classified by their answer like any other url
+            QueuedDownload child;
+            child.contactId = contactId;
+            child.parentId = playlistId;
+            child.urlType = (DownloadManager::UrlType)getUrlTypeByUrl(entry.url);
+            child.urls << entry.url;
+            batch.append(child);
+        }
+
+        if (batch.count() >= PLAYLIST_INSERT_BATCH || (!hasEntry && !batch.isEmpty())) {
+            int queuedCount = enqueueChildDownloads(batch);
+            batch.clear();
+
+            m_playlistMutex.lock();
+            m_playlists[playlistId].totalCount += queuedCount;
+            m_playlistMutex.unlock();
+        }
+
+        if (!hasEntry)
+            break;
+    }
+
+    m_playlistMutex.lock();
+    m_playlists[playlistId].expanded = true;
+    progress = m_playlists.value(playlistId);
+    int completedCount = progress.finishedCount + progress.failedCount;
+    bool done = (completedCount >= progress.totalCount);
+    if (done)
+        m_playlists.remove(playlistId);
+    m_playlistMutex.unlock();
+
+    qDebug() << __PRETTY_FUNCTION__ << " Expanded " << progress.totalCount << " entries, skipped " << parser.getSkippedCount()
+             << ", playlistId = " << playlistId;
+
+    emit playlistProgress(contactId, playlistId, completedCount, progress.totalCount);
+    if (done)
+        emit playlistFinished(contactId, playlistId, progress.finishedCount, progress.failedCount);
+}
+
+int DownloadManagerImpl::enqueueChildDownloads(QList<QueuedDownload> &entries)
+{
+    m_downloadDAO->insertDownloads(entries);
+
+    qint64 queuedTime = QDateTime::currentMSecsSinceEpoch();
+    int queuedCount = 0;
+    m_mutexLocker.lock();
+    for (int i = 0; i < entries.count(); i++) {
+        QueuedDownload &entry = entries[i];
+        if (entry.downloadId < 0)
+            continue;
+        entry.queuedTime = queuedTime;
+        appendQueuedDownload(entry);
+        queuedCount++;
+    }
+    m_mutexLocker.unlock();
+
+    foreach(const QueuedDownload &entry, entries) {
+        if (entry.downloadId >= 0)
+            emit downloadStatusChanged(entry.contactId, entry.downloadId, (int)DownloadManager::Queueing);
+    }
+
+    checkDownloadQueue();
+
+    return queuedCount;
+}
+
+void DownloadManagerImpl::updatePlaylistProgress(int playlistId, bool succeeded)
+{
+    if (playlistId < 0)
+        return;
+
+    m_playlistMutex.lock();
+    QHash<int, PlaylistProgress>::iterator it = m_playlists.find(playlistId);
+    if (it == m_playlists.end()) {
+        m_playlistMutex.unlock();
+        return;
+    }
+
+    if (succeeded)
+        it->finishedCount++;
+    else
+        it->failedCount++;
+
+    PlaylistProgress progress = *it;
+    int completedCount = progress.finishedCount + progress.failedCount;
+    bool done = (progress.expanded && completedCount >= progress.totalCount);
+    if (done)
+        m_playlists.erase(it);
+    m_playlistMutex.unlock();
+
+    emit playlistProgress(progress.contactId, playlistId, completedCount, progress.totalCount);
+    if (done)
+        emit playlistFinished(progress.contactId, playlistId, progress.finishedCount, progress.failedCount);
 }
 
 void DownloadManagerImpl::slotDownloadError(int downloadId, DownloadManager::DownloadErrorCode error)
 {
+    // Transient errors are retried later, the user only sees the final error
+    if (scheduleRetry(downloadId, error))
+        return;
+
+    MetricsRegistry::instance()->increment(METRIC_DOWNLOADS_FAILED, 1, QString("code=\"%1\"").arg((int)error));
+
+    DownloadRecord record;
+    int playlistId = getDownloadRecordByDownloadId(downloadId, record) ? record.parentId : -1;
+
     emit downloadError(downloadId, error);
     removeAndUpdateDownload(downloadId, DownloadManager::Error);
     qDebug() << __PRETTY_FUNCTION__ << " Emitted downloadError DownloadErrorCode signal" << ", downloadId = " << downloadId;
+
+    updatePlaylistProgress(playlistId, false);
 }
 
 void DownloadManagerImpl::slotDownloadSslErrors(int downloadId, const QList<QSslError> &errors)
 {
     Q_UNUSED(errors);
+    MetricsRegistry::instance()->increment(METRIC_DOWNLOADS_FAILED, 1, QString("code=\"%1\"").arg((int)DownloadManager::SslHandshakeFailedError));
+
+    DownloadRecord record;
+    int playlistId = getDownloadRecordByDownloadId(downloadId, record) ? record.parentId : -1;
+
     emit downloadError(downloadId, DownloadManager::SslHandshakeFailedError);
     removeAndUpdateDownload(downloadId, DownloadManager::Error);
     qDebug() << __PRETTY_FUNCTION__ << " Emitted downloadError SslHandshakeFailedError signal" << ", downloadId = " << downloadId;
+
+    updatePlaylistProgress(playlistId, false);
 }
 
 int DownloadManagerImpl::getCurrentRemainTimeByDownload(int downloadId)
 {
-    Download *download = getDownloadByDownloadId(downloadId);
-    if (download)
-        return download->getCurrentRemainTime();
+    DownloadProgressSnapshot snapshot;
+    if (m_progressTable && m_progressTable->getSnapshotByDownload(downloadId, snapshot))
+        return snapshot.remainTime;
 
     return -1;
 }
 
 int DownloadManagerImpl::getCurrentRemainTimeByContact(int contactId)
 {
-    Download *download = getDownloadByContactId(contactId);
-    if (download)
-        return download->getCurrentRemainTime();
+    DownloadProgressSnapshot snapshot;
+    if (m_progressTable && m_progressTable->getSnapshotByContact(contactId, snapshot))
+        return snapshot.remainTime;
+
+    return -1;
+}
+
+int DownloadManagerImpl::getCurrentSpeedByDownload(int downloadId)
+{
+    DownloadProgressSnapshot snapshot;
+    if (m_progressTable && m_progressTable->getSnapshotByDownload(downloadId, snapshot))
+        return (int)qMin(snapshot.smoothedSpeed, (qint64)INT_MAX);
+
+    return -1;
+}
+
+int DownloadManagerImpl::getInstantSpeedByDownload(int downloadId)
+{
+    DownloadProgressSnapshot snapshot;
+    if (m_progressTable && m_progressTable->getSnapshotByDownload(downloadId, snapshot))
+        return (int)qMin(snapshot.instantSpeed, (qint64)INT_MAX);
+
+    return -1;
+}
+
+qint64 DownloadManagerImpl::getBytesReceivedByDownload(int downloadId)
+{
+    DownloadProgressSnapshot snapshot;
+    if (m_progressTable && m_progressTable->getSnapshotByDownload(downloadId, snapshot))
+        return snapshot.bytesReceived;
+
+    return -1;
+}
+
+qint64 DownloadManagerImpl::getBytesTotalByDownload(int downloadId)
+{
+    DownloadProgressSnapshot snapshot;
+    if (m_progressTable && m_progressTable->getSnapshotByDownload(downloadId, snapshot) && snapshot.bytesTotal > 0)
+        return snapshot.bytesTotal;
+
+    return -1;
+}
+
+qint64 DownloadManagerImpl::getWireBytesReceivedByDownload(int downloadId)
+{
+    DownloadProgressSnapshot snapshot;
+    if (m_progressTable && m_progressTable->getSnapshotByDownload(downloadId, snapshot))
+        return snapshot.wireBytesReceived;
+
+    return -1;
+}
+
+qint64 DownloadManagerImpl::getContiguousBytesByDownload(int downloadId)
+{
+    DownloadProgressSnapshot snapshot;
+    if (m_progressTable && m_progressTable->getSnapshotByDownload(downloadId, snapshot))
+        return snapshot.contiguousBytes;
 
     return -1;
 }
 
+void DownloadManagerImpl::addTraceToHistory(const DownloadTrace &trace)
+{
+    QMutexLocker locker(&m_traceMutex);
+    m_traceHistory.append(trace);
+    while (m_traceHistory.count() > TRACE_HISTORY_SIZE)
+        m_traceHistory.removeFirst();
+}
+
+QList<DownloadTrace> DownloadManagerImpl::getLiveTraces(int downloadId)
+{
+    QList<Download *> downloads;
+    QList<DownloadTrace> traces;
+
+    // Downloads are only deleted after they left the lists, copy the traces under the lock
+    QMutexLocker locker(&m_mutexLocker);
+    downloads << m_downloadQueue << m_downloadingList << m_retryingList;
+    foreach(Download *download, downloads) {
+        if (download == 0)
+            continue;
+        if (downloadId == -1 || download->getId() == downloadId)
+            traces.append(download->getTrace());
+    }
+
+    // The downloads of the queued table only reached the queued phase
+    int firstRow = 0;
+    int endRow = m_queuedTable.getRowCount();
+    if (downloadId != -1) {
+        firstRow = m_queuedTable.findByDownloadId(downloadId);
+        endRow = firstRow + 1;
+    }
+    for (int row = firstRow; row < endRow; row++) {
+        if (!m_queuedTable.isUsed(row))
+            continue;
+        DownloadTrace trace;
+        trace.setIds(m_queuedTable.getDownloadId(row), m_queuedTable.getContactId(row));
+        trace.mark(DownloadTrace::Queued, m_queuedTable.getQueuedTime(row));
+        traces.append(trace);
+    }
+
+    return traces;
+}
+
+QVariantMap DownloadManagerImpl::getDownloadTrace(int downloadId)
+{
+    QList<DownloadTrace> traces = getLiveTraces(downloadId);
+    if (!traces.isEmpty())
+        return traces.first().toVariantMap();
+
+    QMutexLocker locker(&m_traceMutex);
+    for (int i = m_traceHistory.count() - 1; i >= 0; i--) {
+        if (m_traceHistory.at(i).getDownloadId() == downloadId)
+            return m_traceHistory.at(i).toVariantMap();
+    }
+
+    return QVariantMap();
+}
+
+bool DownloadManagerImpl::dumpTraces(const QString &filePath)
+{
+    QList<DownloadTrace> traces;
+    m_traceMutex.lock();
+    traces = m_traceHistory;
+    m_traceMutex.unlock();
+    traces << getLiveTraces();
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qDebug() << __PRETTY_FUNCTION__ << " Could not write " << filePath;
+        return false;
+    }
+
+    file.write(DownloadTrace::toChromeTrace(traces));
+    file.close();
+    return true;
+}
+
 void DownloadManagerImpl::release()
 {
     m_mutexLocker.lock();
@@ -463,6 +1428,24 @@ void DownloadManagerImpl::release()
     }
     m_downloadingList.clear();
 
+    foreach(Download *download, m_retryingList) {
+        if (download == 0)
+            continue;
+        download->stop();
+        download->deleteLater();
+        download = 0;
+    }
+    m_retryingList.clear();
+
+    foreach(Download *download, m_coalescedList) {
+        if (download == 0)
+            continue;
+        download->stop();
+        download->deleteLater();
+        download = 0;
+    }
+    m_coalescedList.clear();
+
     for (int i = 0; i < m_downloadQueue.count(); i++) {
         Download *download = m_downloadQueue.at(i);
         if (download == 0)
@@ -472,8 +1455,22 @@ void DownloadManagerImpl::release()
         download = 0;
     }
     m_downloadQueue.clear();
+    m_queuedTable.clear();
+
+    foreach(Download *download, m_recycledList) {
+        if (download == 0)
+            continue;
+        download->deleteLater();
+    }
+    m_recycledList.clear();
     m_mutexLocker.unlock();
 
+    m_downloadPool.clear();
+
+    m_playlistMutex.lock();
+    m_playlists.clear();
+    m_playlistMutex.unlock();
+
     if (m_dbConnection) {
         m_dbConnection->close();
         delete m_dbConnection;
@@ -484,6 +1481,21 @@ void DownloadManagerImpl::release()
         delete m_downloadDAO;
         m_downloadDAO = 0;
     }
+
+    if (m_downloadCacheDAO) {
+        delete m_downloadCacheDAO;
+        m_downloadCacheDAO = 0;
+    }
+
+    if (m_contentStore) {
+        delete m_contentStore;
+        m_contentStore = 0;
+    }
+
+    if (m_progressTable) {
+        delete m_progressTable;
+        m_progressTable = 0;
+    }
 }
 
 void DownloadManagerImpl::connectDownloadSignals(Download *download)
@@ -493,26 +1505,61 @@ void DownloadManagerImpl::connectDownloadSignals(Download *download)
     connect(download, SIGNAL(downloadFinished(int,int,QString,int)), this, SLOT(slotDownloadFinished(int,int,QString,int)), Qt::DirectConnection);
     connect(download, SIGNAL(downloadError(int,DownloadManager::DownloadErrorCode)), this, SLOT(slotDownloadError(int,DownloadManager::DownloadErrorCode)), Qt::DirectConnection);
     connect(download, SIGNAL(downloadSslErrors(int,QList<QSslError>)), this, SLOT(slotDownloadSslErrors(int,QList<QSslError>)), Qt::DirectConnection);
+    connect(download, SIGNAL(contiguousBytesAvailable(int,qint64)), this, SIGNAL(contiguousBytesAvailable(int,qint64)), Qt::DirectConnection);
 }
 
 void DownloadManagerImpl::disconnectDownloadSignals(Download *download)
 {
-    disconnect(download, SIGNAL(downloadProgress(int,qint64,qint64)), this, SIGNAL(downloadProgress(int,qint64,qint64)));
+    disconnect(download, SIGNAL(downloadTimeRemain(int,int)), this, SIGNAL(downloadTimeRemain(int,int)));
     disconnect(download, SIGNAL(noReceivedData(int)), this, SIGNAL(noReceivedData(int)));
-    disconnect(download, SIGNAL(downloadFinished(int,QString,int)), this, SLOT(slotDownloadFinished(int,QString,int)));
-    disconnect(download, SIGNAL(downloadError(int,DownloadManager::DownloadErrorCode)), this, SIGNAL(downloadError(int,DownloadManager::DownloadErrorCode)));
+    disconnect(download, SIGNAL(downloadFinished(int,int,QString,int)), this, SLOT(slotDownloadFinished(int,int,QString,int)));
+    disconnect(download, SIGNAL(downloadError(int,DownloadManager::DownloadErrorCode)), this, SLOT(slotDownloadError(int,DownloadManager::DownloadErrorCode)));
     disconnect(download, SIGNAL(downloadSslErrors(int,QList<QSslError>)), this, SLOT(slotDownloadSslErrors(int,QList<QSslError>)));
+    disconnect(download, SIGNAL(contiguousBytesAvailable(int,qint64)), this, SIGNAL(contiguousBytesAvailable(int,qint64)));
 }
 
 bool DownloadManagerImpl::deleteDownloadContact(int contactId)
 {
-    // Remove from the lists
-    removeDownloadByContactId(contactId);
+    // Remove from the lists, the entries of an expanded playlist belong to the same contact
+    while (removeDownloadByContactId(contactId))
+        ;
+
+    m_playlistMutex.lock();
+    QHash<int, PlaylistProgress>::iterator it = m_playlists.begin();
+    while (it != m_playlists.end()) {
+        if (it->contactId == contactId)
+            it = m_playlists.erase(it);
+        else
+            ++it;
+    }
+    m_playlistMutex.unlock();
 
     // Remove from the database
     return m_downloadDAO->deleteDownloadContact(contactId);
 }
 
+bool DownloadManagerImpl::loadMediaTypes(const QString &filePath)
+{
+    // Threads already reading the registry would see it change under them
+    QMutexLocker locker(&m_mediaTypesMutex);
+    if (m_mediaTypesInUse) {
+        qDebug() << __PRETTY_FUNCTION__ << " Could not load " << filePath << ", the media types are in use";
+        return false;
+    }
+
+    return m_mediaTypes.load(filePath);
+}
+
+void DownloadManagerImpl::useMediaTypes()
+{
+    // Only the first use takes the lock, it waits for a load in progress
+    if (m_mediaTypesInUse.fetchAndAddAcquire(0) != 0)
+        return;
+
+    QMutexLocker locker(&m_mediaTypesMutex);
+    m_mediaTypesInUse.fetchAndStoreRelease(1);
+}
+
 void DownloadManagerImpl::setDBStoragePath(const QString &dbPath)
 {
     if (m_dbConnection == 0)
@@ -525,11 +1572,12 @@ void DownloadManagerImpl::setDBStoragePath(const QString &dbPath)
     }
 
     // Create the download table
-    QString createDownloadTableString = QString(
-            "CREATE TABLE IF NOT EXISTS %1(id INTEGER NOT NULL PRIMARY KEY AUTOINCREMENT, "
-            "contact_id INTEGER, url TEXT, url_type INTEGER, status INTEGER)").arg(DOWNLOAD_TABLE_NAME);
-//    m_dbConnection = new DBConnection();
-    m_dbConnection->createTable(createDownloadTableString);
+    if (m_downloadDAO != 0)
+        m_downloadDAO->createTable();
+
+    // Create the table of the cached copies
+    if (m_downloadCacheDAO != 0)
+        m_downloadCacheDAO->createTable();
 }
 
 DownloadManagerImpl::~DownloadManagerImpl()
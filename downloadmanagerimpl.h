@@ -17,11 +17,23 @@
 #include <QStringList>
 #include <QQueue>
 #include <QMutex>
+#include <QAtomicInt>
+#include <QHash>
 #include <QSslError>
 #include "downloadmanager.h"
+#include "retrypolicy.h"
+#include "downloadtrace.h"
+#include "mediatyperegistry.h"
+#include "queueddownloadtable.h"
+#include "objectpool.h"
 
 class Download;
 class DownloadDAO;
+struct DownloadRecord;
+class DownloadCacheDAO;
+class ContentStore;
+class DownloadProgressTable;
+class DownloadTimerWheel;
 class DBConnection;
 class DownloadManager;
 class DownloadManagerImpl : public QObject
@@ -38,6 +50,13 @@ public:
      */
     Q_INVOKABLE void addUrl(const QString &url, int contactId);
 
+    /*!
+     * \brief Add a file served by several mirrors to queue to download
+     * \param urls: urls of the same file, the first one gives the type and the file name
+     * \param contactId: the id of the contact from database
+     */
+    Q_INVOKABLE void addUrls(const QStringList &urls, int contactId);
+
     /*!
      * \brief Get url type
      * \param url: url of the file
@@ -90,6 +109,15 @@ public:
      */
     bool stopDownload(int downloadId);
 
+    /*!
+     * \brief Fetch a streamed download from an offset before the rest of the file
+     * \param downloadId: the id of the download
+     * \param offset: position the player moved to
+     * \returns true if the running download was asked to fetch the offset first, otherwise returns false
+     * \note only for downloads in streaming mode, ignored if the server does not serve ranges
+     */
+    bool seekDownload(int downloadId, qint64 offset);
+
     /*!
      * \brief QML calls this when a contact is removed to delete the download links this contact from the database
      * \param contactId: the id of the contact
@@ -104,10 +132,58 @@ public:
      */
     void setDBStoragePath(const QString &dbPath);
 
+    /*!
+     * \brief Replace the supported types and their policies by the ones of an ini file
+     * \param filePath: full file path name, see MediaTypeRegistry for the format
+     * \returns true if the file was loaded, otherwise the current types are kept
+     * \note the registry is read without lock once the engine uses it, so the file is rejected after the first
+     * url is classified or the queue is checked. MEDIA_TYPES_FILE is loaded at startup if it exists
+     */
+    bool loadMediaTypes(const QString &filePath);
+
+    /*!
+     * \brief Set the retry policy for transient errors
+     * \param maxAttempts: max number of retries of a download, 0 disables retrying
+     * \param baseDelay: delay before the first retry calculated by second
+     * \param maxDelay: upper bound of the delay between retries calculated by second
+     */
+    Q_INVOKABLE void setRetryPolicy(int maxAttempts, int baseDelay, int maxDelay);
+
+    /*!
+     * \brief Set the max number of downloads running at the same time
+     * \param count: number of downloads, 0 keeps every download in the queue
+     */
+    Q_INVOKABLE void setMaxConcurrentDownloads(int count);
+
+    /*!
+     * \brief Enable the expansion of downloaded .pls playlists
+     * \param enabled: true to download the entries of a playlist once it is downloaded
+     * \note the entries are child downloads of the same contact, see playlistProgress and playlistFinished
+     */
+    Q_INVOKABLE void setPlaylistExpansion(bool enabled);
+
+    /*!
+     * \brief Fetch the files of the streamed types in playback order
+     * \param enabled: true to keep the start of the file sequential, see contiguousBytesAvailable and MediaTypePolicy
+     * \param prefetchTail: true to also fetch the end of the file early, where some containers keep their index
+     * \note applies to the downloads started afterwards
+     */
+    Q_INVOKABLE void setStreamingMode(bool enabled, bool prefetchTail);
+
+    /*!
+     * \brief Keep the queue in the database and only the next QUEUE_WINDOW_SIZE downloads in memory
+     * \param enabled: true to read the queued downloads from the database as the running ones complete
+     * \note call it after setDBStoragePath(). Enabled at startup, it also starts again the downloads of the
+     * database that are still queued or were interrupted by the last exit. The priorities and limits of the
+     * types only see the downloads in memory, and a download left in the database only keeps its first url
+     */
+    Q_INVOKABLE void setLazyQueue(bool enabled);
+
     /*!
      * \brief get current remain time by download id
      * \returns current remain time
      * \returns -1 if it does not receive data
+     * \note lock-free, can be called from any thread
      */
     int getCurrentRemainTimeByDownload(int downloadId);
 
@@ -115,9 +191,62 @@ public:
      * \brief get current remain time by contact id
      * \returns current remain time
      * \returns -1 if it does not receive data
+     * \note lock-free, can be called from any thread
      */
     int getCurrentRemainTimeByContact(int contactId);
 
+    /*!
+     * \brief get current smoothed speed by download id
+     * \returns speed averaged over the last few seconds calculated by byte/s
+     * \returns -1 if it is not known yet
+     */
+    int getCurrentSpeedByDownload(int downloadId);
+
+    /*!
+     * \brief get instantaneous speed by download id
+     * \returns speed over the last sample interval calculated by byte/s
+     * \returns -1 if it is not known yet
+     */
+    int getInstantSpeedByDownload(int downloadId);
+
+    /*!
+     * \brief get received bytes by download id
+     * \returns number of bytes received, -1 if the download is not running
+     */
+    qint64 getBytesReceivedByDownload(int downloadId);
+
+    /*!
+     * \brief get total bytes by download id
+     * \returns size of the file, -1 if the download is not running or the size is unknown
+     */
+    qint64 getBytesTotalByDownload(int downloadId);
+
+    /*!
+     * \brief get the bytes received from the network by download id
+     * \returns number of bytes of the current attempt before content decoding, -1 if the download is not running
+     */
+    qint64 getWireBytesReceivedByDownload(int downloadId);
+
+    /*!
+     * \brief get the playable bytes by download id
+     * \returns number of bytes written from the start of the file without any gap, -1 if the download is not running
+     */
+    qint64 getContiguousBytesByDownload(int downloadId);
+
+    /*!
+     * \brief get the phase timestamps of a download
+     * \returns ids, attempt and the time of each reached phase, empty if the download is unknown
+     * \note finished and failed downloads stay available until TRACE_HISTORY_SIZE newer ones completed
+     */
+    QVariantMap getDownloadTrace(int downloadId);
+
+    /*!
+     * \brief write the traces of the recent and running downloads as Chrome trace event JSON
+     * \param filePath: full path of the file
+     * \returns true if the file was written, otherwise returns false
+     */
+    bool dumpTraces(const QString &filePath);
+
 signals:
 
     /*!
@@ -164,6 +293,31 @@ signals:
      */
     void downloadStatusChanged(int contactId, int downloadId, int downloadStatus);
 
+    /*!
+     * \brief emitted when a child download of an expanded playlist completed
+     * \param contactId: the id of the contact
+     * \param playlistId: id of the playlist download
+     * \param completedCount: number of finished or failed entries
+     * \param totalCount: number of entries of the playlist
+     */
+    void playlistProgress(int contactId, int playlistId, int completedCount, int totalCount);
+
+    /*!
+     * \brief emitted when every entry of an expanded playlist completed
+     * \param contactId: the id of the contact
+     * \param playlistId: id of the playlist download
+     * \param finishedCount: number of entries downloaded
+     * \param failedCount: number of entries that failed
+     */
+    void playlistFinished(int contactId, int playlistId, int finishedCount, int failedCount);
+
+    /*!
+     * \brief emitted in streaming mode when more of the start of the file can be read
+     * \param downloadId: id of download
+     * \param bytesAvailable: bytes written from the start of the file without any gap
+     */
+    void contiguousBytesAvailable(int downloadId, qint64 bytesAvailable);
+
 public slots:
 
     /*!
@@ -182,6 +336,12 @@ public slots:
      */
     void slotDownloadError(int downloadId, DownloadManager::DownloadErrorCode error);
 
+    /*!
+     * \brief Slot when the retry delay of a download elapsed
+     * \param downloadId: the id of the download
+     */
+    void slotRetryReady(int downloadId);
+
 #ifndef QT_NO_OPENSSL
     /*!
      * \brief Slot when an ssl error occurs
@@ -207,17 +367,40 @@ protected:
     /*!
      * \brief Get download by contact id
      * \param contactId: the id of the contact
-     * \returns download entity
+     * \returns download entity, 0 if it is still in the queued table
+     * \note a removed download is reset and reused by another one, only dereference the pointer
+     * in the thread of the download, other threads use getDownloadRecordByContactId()
      */
     Download *getDownloadByContactId(int contactId);
 
     /*!
      * \brief Get download by download id
      * \param downloadId: the id of the download
-     * \returns download entity
+     * \returns download entity, 0 if it is still in the queued table
+     * \note a removed download is reset and reused by another one, only dereference the pointer
+     * in the thread of the download, other threads use getDownloadRecordByDownloadId()
      */
     Download *getDownloadByDownloadId(int downloadId);
 
+    /*!
+     * \brief Copy the values of a download of the lists or the queued table
+     * \param downloadId: the id of the download
+     * \param record: receives the values
+     * \returns true if the download is in memory, otherwise the database has the values
+     */
+    bool getDownloadRecordByDownloadId(int downloadId, DownloadRecord &record);
+
+    /*!
+     * \brief Copy the values of the download of a contact from the lists or the queued table
+     * \param contactId: the id of the contact
+     * \param record: receives the values
+     * \returns true if the download is in memory, otherwise the database has the values
+     */
+    bool getDownloadRecordByContactId(int contactId, DownloadRecord &record);
+
+    // Take a download out of the lists, the caller owns it until it recycles it. The caller holds m_mutexLocker
+    Download *takeDownloadById(int downloadId);
+
     // Remove on the lists only
     bool removeDownloadById(int downloadId);
     // Remove on the lists only
@@ -226,8 +409,11 @@ protected:
     // Remove download from the lists and update to the database
     bool removeAndUpdateDownload(int downloadId, DownloadManager::DownloadStatus status);
 
-    // Check download in the queue to start
-    void checkDownloadQueue();
+    // Move a failed download to the retry list, returns false if it must not be retried
+    bool scheduleRetry(int downloadId, DownloadManager::DownloadErrorCode error);
+
+    // Check download in the queue to start, always runs in the manager thread
+    Q_INVOKABLE void checkDownloadQueue();
 
     // Connect signals with a download
     void connectDownloadSignals(Download *download);
@@ -235,28 +421,139 @@ protected:
     // Disconnect signals with a download
     void disconnectDownloadSignals(Download *download);
 
-    // Get text extension of an input text, returns empty if does not have
-    QString getTextExtension(const QString &text);
+    // Give a download the copy of its url left by a previous download, if it is still on the disk
+    void attachCachedCopy(Download *download);
+
+    // Store the validators of a finished download with its file
+    void updateCachedCopy(Download *download, const QString &filePath);
+
+    // Create a download of a contact, not queued yet
+    Download *createDownload(const QStringList &urls, int contactId, DownloadManager::UrlType urlType);
+
+    // Create the download of an entry of the queued table when it starts
+    Download *materializeDownload(const QueuedDownload &entry);
+
+    // Stop a download taken out of the lists and reset it later for reuse, the caller holds m_mutexLocker
+    void recycleDownload(Download *download);
+
+    // Reset the recycled downloads and put them in the pool, runs in the manager thread
+    Q_INVOKABLE void recycleDownloads();
+
+    // Queue the entries of a downloaded playlist as child downloads, runs in the manager thread
+    Q_INVOKABLE void expandPlaylist(int playlistId, int contactId, const QString &playlistUrl, const QString &filePath);
+
+    // Insert and queue a batch of child downloads, returns the number queued
+    int enqueueChildDownloads(QList<QueuedDownload> &entries);
+
+    // Count a completed child download and report the progress of its playlist
+    void updatePlaylistProgress(int playlistId, bool succeeded);
+
+    // Get the running or retrying download of a url, the caller holds m_mutexLocker
+    Download *findTransferByUrl(const QString &url);
+
+    // Put the downloads waiting for a transfer that is gone back in front of the queue, the caller holds m_mutexLocker
+    void requeueCoalescedDownloads();
+
+    // Take the next download allowed to start by the policies of the types, the caller holds m_mutexLocker
+    Download *takeNextDownload();
+
+    // Mark the media types as read by the engine, loadMediaTypes() is rejected from then on
+    void useMediaTypes();
+
+    // Number of downloads waiting to start in memory, the caller holds m_mutexLocker
+    int getQueueLength() const;
+
+    // Queue a download in the table, or leave it in the database if it is after the lazy queue window. The caller holds m_mutexLocker
+    void appendQueuedDownload(const QueuedDownload &entry);
+
+    // Read the next queued downloads of the database once the lazy queue window runs low, returns the number read
+    int refillQueueWindow();
+
+    // Read up to limit queued downloads after the cursor of the lazy queue, -1 reads all of them. Returns the number read
+    int loadQueuedDownloads(int limit);
+
+    // Finish the downloads waiting for the transfer of a url with its file
+    void finishCoalescedDownloads(const QString &url, const QString &filePath);
+
+    // Keep the trace of a completed download
+    void addTraceToHistory(const DownloadTrace &trace);
+
+    // Get the traces of the downloads in the lists, or only the one of downloadId if it is not -1
+    QList<DownloadTrace> getLiveTraces(int downloadId = -1);
 
 private:
 
-    // Waiting download queue
+    // Downloads put back in front of the queue by a retry or a transfer that is gone
     QQueue<Download *> m_downloadQueue;
+    // Downloads that did not start yet, materialized when they start
+    QueuedDownloadTable m_queuedTable;
+    // Downloads taken out of the lists, waiting to be reset in the manager thread
+    QList<Download *> m_recycledList;
+    // Reset downloads with their thread and contact, used by the next ones
+    ObjectPool<Download> m_downloadPool;
     // List of downloading object
     QList<Download *> m_downloadingList;
-
-    // Supported meta type lists
-    QStringList m_supportedMusicTypeList;
-    QStringList m_supportedVideoTypeList;
-    QStringList m_supportedApplicationTypeList;
-    QStringList m_supportedPlaylistTypeList;
+    // Failed downloads waiting for their retry delay
+    QList<Download *> m_retryingList;
+    // Downloads waiting for the running transfer of the same url
+    QList<Download *> m_coalescedList;
+
+    // Completion of an expanded playlist
+    struct PlaylistProgress
+    {
+        int contactId;
+        int totalCount; // child downloads queued
+        int finishedCount;
+        int failedCount;
+        bool expanded; // true once every entry is queued
+    };
+
+    // Expanded playlists by id of the playlist download
+    QHash<int, PlaylistProgress> m_playlists;
+    QMutex m_playlistMutex; // Guards m_playlists, children complete in their download threads
+    // True to download the entries of the downloaded playlists
+    bool m_playlistExpansion;
+
+    // True to keep the queue in the database and only a window of it in memory
+    bool m_lazyQueue;
+    int m_queueCursor; // id of the last queued download read from the database
+    bool m_queueExhausted; // true if no queued download of the database is after the cursor
+
+    // True to fetch the files of the streamed types in playback order
+    bool m_streamingMode;
+    bool m_streamingTail; // True to fetch the end of a streamed file early
+
+    // Retry policy of transient errors
+    RetryPolicy m_retryPolicy;
+
+    // Max number of running downloads
+    int m_maxConcurrentDownloads;
+
+    // Supported types and their policies
+    MediaTypeRegistry m_mediaTypes;
+    QAtomicInt m_mediaTypesInUse; // 1 once the engine reads the media types
+    QMutex m_mediaTypesMutex; // Orders loadMediaTypes() with the first use of the media types
 
     // Database connection
     DBConnection *m_dbConnection;
     // Database helper
     DownloadDAO *m_downloadDAO;
+    // Validators of the downloaded files
+    DownloadCacheDAO *m_downloadCacheDAO;
+    // Single copy of every downloaded content
+    ContentStore *m_contentStore;
+
+    // Progress of the running downloads, readable from any thread
+    DownloadProgressTable *m_progressTable;
+
+    // Progress, stall and timeout timers of all downloads
+    DownloadTimerWheel *m_timerWheel;
 
     QMutex m_mutexLocker; // mutex loker for synchronization
+
+    // Traces of the last completed downloads, oldest first
+    QList<DownloadTrace> m_traceHistory;
+    QMutex m_traceMutex; // Guards m_traceHistory
 };
 
 #endif // DOWNLOADMANAGERIMPL_H
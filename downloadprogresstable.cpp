@@ -0,0 +1,200 @@
+/*!
+ * \file downloadprogresstable.cpp
+ * \brief lock-free table of download progress snapshots
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#include "downloadprogresstable.h"
+#include <new>
+
+DownloadProgressSnapshot::DownloadProgressSnapshot()
+{
+    downloadId = -1;
+    contactId = -1;
+    remainTime = -1;
+    bytesReceived = 0;
+    bytesTotal = 0;
+    wireBytesReceived = 0;
+    wireBytesTotal = 0;
+    contiguousBytes = 0;
+    instantSpeed = -1;
+    smoothedSpeed = -1;
+}
+
+DownloadProgressTable::DownloadProgressTable(int capacity)
+{
+    // Round the capacity up to a power of two to probe with a mask
+    m_capacity = 1;
+    while (m_capacity < capacity)
+        m_capacity <<= 1;
+
+    m_slots = static_cast<Slot *>(qMallocAligned(sizeof(Slot)*m_capacity, CACHE_LINE_SIZE));
+    Q_ASSERT(m_slots != 0);
+
+    for (int i = 0; i < m_capacity; i++) {
+        Slot *slot = new (&m_slots[i]) Slot;
+        slot->sequence = 0;
+        slot->key = EmptySlot;
+    }
+
+    m_maxProbe = 0;
+}
+
+int DownloadProgressTable::hashIndex(int downloadId) const
+{
+    // Knuth multiplicative hash, ids are mostly consecutive
+    return (int)(((uint)downloadId*2654435761u) & (uint)(m_capacity - 1));
+}
+
+void DownloadProgressTable::raiseMaxProbe(int probe)
+{
+    forever {
+        int maxProbe = m_maxProbe;
+        if (probe <= maxProbe || m_maxProbe.testAndSetOrdered(maxProbe, probe))
+            return;
+    }
+}
+
+void DownloadProgressTable::lockSlot(Slot *slot)
+{
+    forever {
+        int sequence = slot->sequence;
+        if ((sequence & 1) == 0 && slot->sequence.testAndSetAcquire(sequence, sequence + 1))
+            return;
+    }
+}
+
+void DownloadProgressTable::unlockSlot(Slot *slot)
+{
+    slot->sequence.fetchAndAddRelease(1);
+}
+
+int DownloadProgressTable::acquire(int downloadId, int contactId)
+{
+    int index = hashIndex(downloadId);
+    for (int i = 0; i < m_capacity; i++) {
+        Slot *slot = &m_slots[index];
+        int key = slot->key;
+        if (key != EmptySlot && key != ReleasedSlot) {
+            index = (index + 1) & (m_capacity - 1);
+            continue;
+        }
+
+        // Lookups must reach the slot before it gets the id
+        raiseMaxProbe(i);
+        if (slot->key.testAndSetOrdered(key, downloadId)) {
+            lockSlot(slot);
+            slot->data = DownloadProgressSnapshot();
+            slot->data.downloadId = downloadId;
+            slot->data.contactId = contactId;
+            unlockSlot(slot);
+            return index;
+        }
+        index = (index + 1) & (m_capacity - 1);
+    }
+
+    return -1;
+}
+
+void DownloadProgressTable::release(int slot, int downloadId)
+{
+    if (slot < 0 || slot >= m_capacity)
+        return;
+
+    Slot *s = &m_slots[slot];
+    lockSlot(s);
+    // Keep released slots distinguishable from empty ones so probing goes on past them
+    if (s->key.testAndSetOrdered(downloadId, ReleasedSlot))
+        s->data = DownloadProgressSnapshot();
+    unlockSlot(s);
+}
+
+void DownloadProgressTable::publish(int slot, const DownloadProgressSnapshot &snapshot)
+{
+    if (slot < 0 || slot >= m_capacity)
+        return;
+
+    Slot *s = &m_slots[slot];
+    lockSlot(s);
+    if (s->key == snapshot.downloadId)
+        s->data = snapshot;
+    unlockSlot(s);
+}
+
+bool DownloadProgressTable::readSlot(const Slot *slot, int downloadId, DownloadProgressSnapshot &snapshot) const
+{
+    // Qt atomics have no plain acquire load, a read-modify-write of zero gives the same ordering
+    Slot *s = const_cast<Slot *>(slot);
+    forever {
+        int sequence = s->sequence.fetchAndAddAcquire(0);
+        if (sequence & 1)
+            continue; // a writer is in the middle of an update
+
+        DownloadProgressSnapshot copy = s->data;
+
+        if (s->sequence.fetchAndAddOrdered(0) != sequence)
+            continue; // torn read, try again
+
+        if (copy.downloadId != downloadId && downloadId != -1)
+            return false;
+
+        snapshot = copy;
+        return copy.downloadId != -1;
+    }
+}
+
+bool DownloadProgressTable::getSnapshotByDownload(int downloadId, DownloadProgressSnapshot &snapshot) const
+{
+    if (downloadId < 0)
+        return false;
+
+    // Released slots are never empty again, the probe stops at the farthest slot a download ever took
+    int maxProbe = m_maxProbe;
+    int index = hashIndex(downloadId);
+    for (int i = 0; i <= maxProbe && i < m_capacity; i++) {
+        const Slot *slot = &m_slots[index];
+        int key = slot->key;
+        if (key == EmptySlot)
+            return false;
+        if (key == downloadId)
+            return readSlot(slot, downloadId, snapshot);
+        index = (index + 1) & (m_capacity - 1);
+    }
+
+    return false;
+}
+
+bool DownloadProgressTable::getSnapshotByContact(int contactId, DownloadProgressSnapshot &snapshot) const
+{
+    if (contactId < 0)
+        return false;
+
+    // Contacts are not hashed, the table only holds the running downloads so a scan is cheap
+    for (int i = 0; i < m_capacity; i++) {
+        const Slot *slot = &m_slots[i];
+        if ((int)slot->key < 0)
+            continue;
+
+        DownloadProgressSnapshot copy;
+        if (readSlot(slot, -1, copy) && copy.contactId == contactId) {
+            snapshot = copy;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+DownloadProgressTable::~DownloadProgressTable()
+{
+    for (int i = 0; i < m_capacity; i++)
+        m_slots[i].~Slot();
+
+    qFreeAligned(m_slots);
+    m_slots = 0;
+}
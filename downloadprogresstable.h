@@ -0,0 +1,124 @@
+/*!
+ * \file downloadprogresstable.h
+ * \brief lock-free table of download progress snapshots
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#ifndef DOWNLOADPROGRESSTABLE_H
+#define DOWNLOADPROGRESSTABLE_H
+
+#include <QAtomicInt>
+#include "common.h"
+
+/*!
+ * \brief Consistent copy of the progress of one download
+ */
+struct DownloadProgressSnapshot
+{
+    DownloadProgressSnapshot();
+
+    int downloadId;
+    int contactId;
+    int remainTime; // remain time calculated by milisecond, -1 if it does not receive data
+    qint64 bytesReceived;
+    qint64 bytesTotal;
+    qint64 wireBytesReceived; // bytes received from the network by the current attempt, before decoding
+    qint64 wireBytesTotal; // bytes the current attempt receives from the network, 0 if unknown
+    qint64 contiguousBytes; // bytes written from the start of the file without any gap
+    qint64 instantSpeed; // speed over the last sample interval calculated by byte/s, -1 if unknown
+    qint64 smoothedSpeed; // smoothed speed calculated by byte/s, -1 if unknown
+};
+
+/*!
+ * \brief Fixed size table of progress snapshots, one slot per running download.
+ *
+ * Every slot is guarded by its own sequence lock and padded to a cache line, so
+ * the download threads publish their progress without taking any mutex and any
+ * thread can read a consistent snapshot without blocking the writers.
+ */
+class DownloadProgressTable
+{
+public:
+    explicit DownloadProgressTable(int capacity = PROGRESS_TABLE_CAPACITY);
+    ~DownloadProgressTable();
+
+    /*!
+     * \brief Reserve a slot for a download
+     * \param downloadId: the id of the download
+     * \param contactId: the id of the contact
+     * \returns the index of the slot, -1 if the table is full
+     */
+    int acquire(int downloadId, int contactId);
+
+    /*!
+     * \brief Free the slot of a download
+     * \param slot: the index returned by acquire()
+     * \param downloadId: the id of the download owning the slot
+     */
+    void release(int slot, int downloadId);
+
+    /*!
+     * \brief Publish new progress values of a download
+     * \param slot: the index returned by acquire()
+     * \param snapshot: the new values, downloadId must match the slot owner
+     * \note the values are dropped if the slot has been released meanwhile
+     */
+    void publish(int slot, const DownloadProgressSnapshot &snapshot);
+
+    /*!
+     * \brief Read the progress of a download
+     * \param downloadId: the id of the download
+     * \param snapshot: receives the values
+     * \returns true if the download has a slot, otherwise returns false
+     */
+    bool getSnapshotByDownload(int downloadId, DownloadProgressSnapshot &snapshot) const;
+
+    /*!
+     * \brief Read the progress of the download of a contact
+     * \param contactId: the id of the contact
+     * \param snapshot: receives the values
+     * \returns true if the contact has a running download, otherwise returns false
+     */
+    bool getSnapshotByContact(int contactId, DownloadProgressSnapshot &snapshot) const;
+
+protected:
+
+    enum SlotKey {
+        EmptySlot = -1,
+        ReleasedSlot = -2
+    };
+
+    struct Slot
+    {
+        QAtomicInt sequence; // odd while a writer is updating the slot
+        QAtomicInt key; // id of the owning download or a SlotKey value
+        DownloadProgressSnapshot data;
+        char padding[CACHE_LINE_SIZE - (sizeof(QAtomicInt)*2 + sizeof(DownloadProgressSnapshot)) % CACHE_LINE_SIZE];
+    };
+
+    // Take the write side of the sequence lock of a slot
+    void lockSlot(Slot *slot);
+    // Leave the write side of the sequence lock of a slot
+    void unlockSlot(Slot *slot);
+
+    // Copy a slot without tearing, returns false if it does not belong to downloadId any more
+    bool readSlot(const Slot *slot, int downloadId, DownloadProgressSnapshot &snapshot) const;
+
+    // First probe position of a download id
+    int hashIndex(int downloadId) const;
+
+    // Let the lookups probe up to probe slots after the first position
+    void raiseMaxProbe(int probe);
+
+private:
+    Slot *m_slots; // cache line aligned slot array
+    int m_capacity; // number of slots, power of two
+    QAtomicInt m_maxProbe; // farthest distance from its first position a download was given a slot at
+};
+
+#endif // DOWNLOADPROGRESSTABLE_H
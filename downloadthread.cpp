@@ -11,193 +11,1027 @@
  */
 #include "downloadthread.h"
 #include "download.h"
+#include "downloadtimerwheel.h"
+#include "metricsregistry.h"
+#include "contentsniffer.h"
+#include "mediatyperegistry.h"
 #include <QDebug>
+#include <QCoreApplication>
 #include <QTime>
+#include <QFileInfo>
+
+// Extensions of the text files worth compressing on the wire, playlists and manifests
+static const char *COMPRESSIBLE_EXTENSIONS[] = { "pls", "m3u", "m3u8", "xspf", "xml", "json", "txt", 0 };
+
+// Check whether a file is likely to shrink with gzip, media files are already compressed
+static bool isCompressible(const QString &url, DownloadManager::UrlType urlType)
+{
+    if (urlType == DownloadManager::Playlist)
+        return true;
+
+    QString suffix = QFileInfo(QUrl(url).path()).suffix().toLower();
+    for (int i = 0; COMPRESSIBLE_EXTENSIONS[i] != 0; i++) {
+        if (suffix == COMPRESSIBLE_EXTENSIONS[i])
+            return true;
+    }
+
+    return false;
+}
+
+DownloadThreadControl::DownloadThreadControl(QObject *parent) :
+    QObject(parent)
+{
+}
+
+void DownloadThreadControl::requestFailover()
+{
+    emit failoverRequested();
+}
+
+void DownloadThreadControl::requestSeek(qint64 offset)
+{
+    emit seekRequested(offset);
+}
 
 DownloadThread::DownloadThread(Download *download) : QThread(download)
 {
     m_download = download;
     m_networkAccessManager = 0;
-    m_downloadProgressTimer = 0;
-    m_downloadTimeoutTimer = 0;
+    m_downloadProgressTimerId = -1;
+    m_downloadTimeoutTimerId = -1;
     m_downloadTime = 0;
+    m_stopped = 0;
+    m_segmented = false;
+    m_baseOffset = 0;
+    m_bytesTotal = -1;
+    m_firstByteReceived = false;
+    m_bufferedBytes = 0;
+    m_wireBytes = 0;
+    m_wireBytesTotal = -1;
+    m_rangesSupported = false;
+    m_streaming = false;
+    m_watermark = 0;
+    m_sniffing = false;
+    m_currentMirror = 0;
+    m_failoverCount = 0;
 
     Q_ASSERT(m_download != 0);
+
+    // Lives in the download thread, lets other threads post work to it
+    m_control = new DownloadThreadControl();
+    Q_ASSERT(m_control != 0);
+    m_control->moveToThread(this);
+    connect(m_control, SIGNAL(failoverRequested()), this, SLOT(slotFailoverRequested()), Qt::DirectConnection);
+    connect(m_control, SIGNAL(seekRequested(qint64)), this, SLOT(slotSeekRequested(qint64)), Qt::DirectConnection);
 }
 
 void DownloadThread::init()
 {
-    QUrl url = QUrl(m_download->getUrl());
-    QNetworkRequest request(url);
+    m_mirrorUrls = m_download->getMirrorUrls();
+    m_currentMirror = 0;
+    m_failoverCount = 0;
+    m_segmented = false;
+    m_bytesTotal = -1;
+    m_firstByteReceived = false;
+    m_wireBytes = 0;
+    m_wireBytesTotal = -1;
+    m_rangesSupported = false;
+    m_watermark = 0;
 
-    qDebug() << "URL= " << url;
+    // A download without a known extension is classified by its answer
+    m_sniffing = (m_download->getUrlType() == DownloadManager::UnknownType);
+    m_sniffBuffer.clear();
+    m_streaming = isStreamable(m_download->getUrlType());
+
+    qDebug() << "URL= " << m_download->getUrl();
 
     if (m_networkAccessManager)
         delete m_networkAccessManager;
     m_networkAccessManager = new QNetworkAccessManager();
     Q_ASSERT(m_networkAccessManager != 0);
 
-    if (m_downloadProgressTimer)
-        delete m_downloadProgressTimer;
-    m_downloadProgressTimer = new QTimer;
-    Q_ASSERT(m_downloadProgressTimer != 0);
-    connect(m_downloadProgressTimer, SIGNAL(timeout()), this, SLOT(updateDownloadProgress()), Qt::DirectConnection);
-    m_downloadProgressTimer->start(1000*DOWNLOAD_PROGRESS_INTERVAL);
-
-    if (m_downloadTimeoutTimer)
-        delete m_downloadTimeoutTimer;
-    m_downloadTimeoutTimer = new QTimer;
-    Q_ASSERT(m_downloadTimeoutTimer != 0);
-    connect(m_downloadTimeoutTimer, SIGNAL(timeout()), this, SLOT(updateDownloadTimeout()), Qt::DirectConnection);
-    m_downloadTimeoutTimer->start(1000*DOWNLOAD_TIMEOUT);
+    // Progress and timeout are driven by the shared timer wheel
+    cancelTimers();
+    DownloadTimerWheel *timerWheel = m_download->getTimerWheel();
+    if (timerWheel) {
+        m_downloadProgressTimerId = timerWheel->schedule(this, "updateDownloadProgress", DOWNLOAD_PROGRESS_INTERVAL*1000/TIMER_WHEEL_TICK, true);
+        m_downloadTimeoutTimerId = timerWheel->schedule(this, "updateDownloadTimeout", DOWNLOAD_TIMEOUT*1000/TIMER_WHEEL_TICK, true);
+    }
 
     if (m_downloadTime)
         delete m_downloadTime;
     m_downloadTime = new QTime;
     Q_ASSERT(m_downloadTime != 0);
     m_downloadTime->start();
+    m_speedEstimator.reset();
 
-    m_canUpdateProgress = true;
-    m_hasData = true;
-    m_currentRemainTime = -1;
+    m_canUpdateProgress = 1;
+    m_hasData = 1;
 
-    m_networkReply = m_networkAccessManager->get(request);
-    connect(m_networkReply, SIGNAL(downloadProgress(qint64, qint64)), this, SLOT(slotDownloadProgress(qint64, qint64)), Qt::DirectConnection);
-    connect(m_networkReply, SIGNAL(finished()), this, SLOT(slotDownloadFinished()), Qt::DirectConnection);
-    connect(m_networkReply, SIGNAL(error(QNetworkReply::NetworkError)), this, SLOT(slotDownloadError(QNetworkReply::NetworkError)), Qt::DirectConnection);
-    connect(m_networkReply, SIGNAL(sslErrors(QList<QSslError>)), this, SIGNAL(downloadSslErrors(QList<QSslError>)), Qt::DirectConnection);
-    connect(m_networkReply, SIGNAL(readyRead()), this, SLOT(slotReadyRead()), Qt::DirectConnection);
+    m_progress = DownloadProgressSnapshot();
+    m_progress.downloadId = m_download->getId();
+    if (m_download->getContact())
+        m_progress.contactId = m_download->getContact()->getId();
+    publishProgress();
 
-    QString savedFilePath = m_download->getSavedFilePathName();
-    m_output.setFileName(savedFilePath);
-    if (!m_output.open(QIODevice::WriteOnly)) {
-        emit downloadError(m_download->getId(), DownloadManager::CanNotWriteToDisk);
+    // A retry keeps the bytes of the previous attempt
+    m_baseOffset = m_download->getResumeOffset();
+
+    // Only a fresh attempt can be answered by a 304
+    m_cachedCopy = DownloadCacheEntry();
+    if (m_baseOffset == 0)
+        m_cachedCopy = m_download->getCachedCopy();
+
+    // The cached copy may be the output file itself, it is only truncated once new content arrives
+    m_output.setFileName(m_download->getSavedFilePathName());
+    if (!m_cachedCopy.isValid() && !openOutput()) {
         exit();
         return; // skip this download
     }
+
+    if (m_mirrorUrls.count() > 1 && m_baseOffset == 0)
+        startRace();
+    else
+        startSegment(0, m_baseOffset, -1);
+    m_download->markTrace(DownloadTrace::RequestSent);
+}
+
+DownloadSegment *DownloadThread::startSegment(int mirror, qint64 start, qint64 end)
+{
+    DownloadSegment *segment = new DownloadSegment;
+    Q_ASSERT(segment != 0);
+    segment->reply = 0;
+    segment->mirror = mirror;
+    segment->start = start;
+    segment->position = start;
+    segment->end = end;
+    segment->checked = false;
+    segment->decoder = 0;
+
+    // Keep the segments sorted by start, the gapless prefix of the file is read from them
+    int index = 0;
+    while (index < m_segments.count() && m_segments.at(index)->start < start)
+        index++;
+    m_segments.insert(index, segment);
+
+    requestSegment(segment);
+    return segment;
+}
+
+void DownloadThread::requestSegment(DownloadSegment *segment)
+{
+    QNetworkRequest request = createRequest(m_mirrorUrls.value(segment->mirror, m_download->getUrl()),
+                                            segment->position == 0 && segment->end < 0);
+
+    // Ask only for the missing part of the segment
+    if (segment->end >= 0)
+        request.setRawHeader("Range", QString("bytes=%1-%2").arg(segment->position).arg(segment->end - 1).toAscii());
+    else if (segment->position > 0)
+        request.setRawHeader("Range", QString("bytes=%1-").arg(segment->position).toAscii());
+
+    segment->checked = false;
+    attachReply(segment, m_networkAccessManager->get(request));
+}
+
+QNetworkRequest DownloadThread::createRequest(const QString &url, bool wholeFile)
+{
+    QNetworkRequest request = QNetworkRequest(QUrl(url));
+
+    // Setting the header stops QNetworkAccessManager from decoding gzip by itself, ranges and
+    // progress then always refer to the bytes on the wire. Ranges of a compressed answer
+    // cannot be mapped to the file, so only the request of the whole file may get one
+    if (wholeFile && isCompressible(url, m_download->getUrlType()))
+        request.setRawHeader("Accept-Encoding", "gzip, deflate");
+    else
+        request.setRawHeader("Accept-Encoding", "identity");
+
+    // The validators belong to the primary url, mirrors may serve other ones
+    if (wholeFile && m_cachedCopy.isValid() && url == m_download->getUrl()) {
+        if (!m_cachedCopy.etag.isEmpty())
+            request.setRawHeader("If-None-Match", m_cachedCopy.etag.toAscii());
+        if (!m_cachedCopy.lastModified.isEmpty())
+            request.setRawHeader("If-Modified-Since", m_cachedCopy.lastModified.toAscii());
+    }
+
+    return request;
+}
+
+void DownloadThread::attachReply(DownloadSegment *segment, QNetworkReply *reply)
+{
+    segment->reply = reply;
+    m_segmentReplies.insert(reply, segment);
+
+    connect(reply, SIGNAL(finished()), this, SLOT(slotSegmentFinished()), Qt::DirectConnection);
+    connect(reply, SIGNAL(sslErrors(QList<QSslError>)), this, SIGNAL(downloadSslErrors(QList<QSslError>)), Qt::DirectConnection);
+    connect(reply, SIGNAL(readyRead()), this, SLOT(slotSegmentReadyRead()), Qt::DirectConnection);
 }
 
-void DownloadThread::disconnectSignals()
+void DownloadThread::detachReply(DownloadSegment *segment)
 {
-    if (m_downloadProgressTimer) {
-        disconnect(m_downloadProgressTimer, SIGNAL(timeout()), this, SLOT(updateDownloadProgress()));
+    QNetworkReply *reply = segment->reply;
+    if (reply == 0)
+        return;
+
+    segment->reply = 0;
+    delete segment->decoder;
+    segment->decoder = 0;
+    m_segmentReplies.remove(reply);
+    disconnect(reply, 0, this, 0);
+    if (!reply->isFinished())
+        reply->abort();
+    reply->deleteLater();
+}
+
+void DownloadThread::startRace()
+{
+    // Request the file from every mirror, the data stays in the reply buffers until a winner is known
+    for (int i = 0; i < m_mirrorUrls.count(); i++) {
+        QNetworkReply *reply = m_networkAccessManager->get(createRequest(m_mirrorUrls.at(i), true));
+        connect(reply, SIGNAL(downloadProgress(qint64, qint64)), this, SLOT(slotRaceProgress(qint64, qint64)), Qt::DirectConnection);
+        connect(reply, SIGNAL(finished()), this, SLOT(slotRaceFinished()), Qt::DirectConnection);
+        m_racingReplies.insert(reply, i);
     }
+}
 
-    if (m_downloadTimeoutTimer) {
-        disconnect(m_downloadTimeoutTimer, SIGNAL(timeout()), this, SLOT(updateDownloadTimeout()));
+void DownloadThread::slotRaceProgress(qint64 bytesReceived, qint64 bytesTotal)
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+    if (reply == 0 || !m_racingReplies.contains(reply) || reply->error() != QNetworkReply::NoError)
+        return;
+
+    m_hasData = 1;
+    recordFirstByte();
+    updateBufferedBytes();
+
+    // The first mirror delivering MIRROR_RACE_BYTES wins
+    if (bytesReceived >= MIRROR_RACE_BYTES || (bytesTotal > 0 && bytesReceived >= bytesTotal))
+        finishRace(reply);
+}
+
+void DownloadThread::slotRaceFinished()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+    if (reply == 0 || !m_racingReplies.contains(reply))
+        return;
+
+    // The whole file arrived before the threshold
+    if (reply->error() == QNetworkReply::NoError) {
+        finishRace(reply);
+        return;
+    }
+
+    qDebug() << __PRETTY_FUNCTION__ << " Mirror failed" << ", downloadId = " << m_download->getId() << ": " << reply->errorString();
+    m_racingReplies.remove(reply);
+    reply->deleteLater();
+
+    if (m_racingReplies.isEmpty())
+        emit downloadError(m_download->getId(), (DownloadManager::DownloadErrorCode)reply->error());
+}
+
+void DownloadThread::finishRace(QNetworkReply *winner)
+{
+    m_currentMirror = m_racingReplies.value(winner, 0);
+
+    QHash<QNetworkReply *, int>::iterator it;
+    for (it = m_racingReplies.begin(); it != m_racingReplies.end(); ++it) {
+        QNetworkReply *reply = it.key();
+        disconnect(reply, 0, this, 0);
+        if (reply == winner)
+            continue;
+        reply->abort();
+        reply->deleteLater();
     }
+    m_racingReplies.clear();
+
+    qDebug() << __PRETTY_FUNCTION__ << " Selected mirror " << m_mirrorUrls.at(m_currentMirror) << ", downloadId = " << m_download->getId();
+
+    // The winner becomes the first segment
+    DownloadSegment *segment = new DownloadSegment;
+    Q_ASSERT(segment != 0);
+    segment->mirror = m_currentMirror;
+    segment->start = 0;
+    segment->position = 0;
+    segment->end = -1;
+    segment->checked = false;
+    segment->decoder = 0;
+    m_segments.append(segment);
+    attachReply(segment, winner);
+
+    // Catch up with what the winner already received
+    readSegment(segment);
+    if (segment->reply && segment->reply->isFinished())
+        finishSegment(segment);
+
+    updateBufferedBytes();
+}
+
+bool DownloadThread::switchMirror(DownloadSegment *segment)
+{
+    // Every segment may move once through every mirror
+    int maxFailovers = m_mirrorUrls.count()*qMax(1, m_segments.count());
+    if (m_mirrorUrls.count() < 2 || m_failoverCount >= maxFailovers)
+        return false;
+
+    detachReply(segment);
+
+    m_failoverCount++;
+    segment->mirror = (segment->mirror + 1) % m_mirrorUrls.count();
+    m_currentMirror = segment->mirror;
+
+    qDebug() << __PRETTY_FUNCTION__ << " Switched to mirror " << m_mirrorUrls.at(segment->mirror) << ", downloadId = " << m_download->getId();
+
+    // Continue from the bytes already written
+    requestSegment(segment);
+    return true;
+}
+
+void DownloadThread::slotFailoverRequested()
+{
+    // No connection received anything, move all of them
+    for (int i = 0; i < m_segments.count(); i++) {
+        if (m_segments.at(i)->reply)
+            switchMirror(m_segments.at(i));
+    }
+}
+
+void DownloadThread::cancelTimers()
+{
+    if (m_downloadProgressTimerId < 0 && m_downloadTimeoutTimerId < 0)
+        return;
+
+    DownloadTimerWheel *timerWheel = m_download->getTimerWheel();
+    if (timerWheel == 0)
+        return;
+
+    timerWheel->cancel(m_downloadProgressTimerId);
+    m_downloadProgressTimerId = -1;
+
+    timerWheel->cancel(m_downloadTimeoutTimerId);
+    m_downloadTimeoutTimerId = -1;
 }
 
 void DownloadThread::run()
 {
     init();
 
-    exec();
+    // An attempt aborted while it started does not wait for the next exit()
+    if (!m_stopped)
+        exec();
+
+    cleanup();
+}
+
+void DownloadThread::cleanup()
+{
+    for (int i = 0; i < m_segments.count(); i++)
+        detachReply(m_segments.at(i));
+
+    // Segments write anywhere in the file, only keep the part a retry can resume from
+    if (m_output.isOpen()) {
+        if (m_segmented)
+            m_output.resize(getContiguousBytes());
+        m_output.close();
+    }
+
+    qDeleteAll(m_segments);
+    m_segments.clear();
+    m_segmentReplies.clear();
+    m_racingReplies.clear();
+    updateBufferedBytes();
+
+    // The replies belong to this thread, delete them before the thread is gone
+    delete m_networkAccessManager;
+    m_networkAccessManager = 0;
+}
+
+bool DownloadThread::openOutput()
+{
+    if (m_output.isOpen())
+        return true;
+
+    // A finished file may be a hard link into the content store, unlink it instead of truncating the shared content
+    // Every segment writes at its own position, a resumed file is opened without Append and without truncating it
+    QIODevice::OpenMode openMode = QIODevice::WriteOnly;
+    if (m_baseOffset > 0)
+        openMode = QIODevice::ReadWrite;
+    else
+        QFile::remove(m_output.fileName());
+    if (!m_output.open(openMode) || !m_output.seek(m_baseOffset)) {
+        m_output.close();
+        emit downloadError(m_download->getId(), DownloadManager::CanNotWriteToDisk);
+        return false;
+    }
+
+    return true;
 }
 
 void DownloadThread::updateDownloadProgress()
 {
-    m_canUpdateProgress = true;
+    if (m_stopped)
+        return;
 
-    if (m_hasData) {
-        m_hasData = false;
-    } else {
-        // emit no received data
-        int downloadId = m_download->getId();
-        m_currentRemainTime = -1;
-        emit noReceivedData(downloadId);
-        qDebug() << __PRETTY_FUNCTION__ << " Emitted noReceivedData signal. Download Id = " << downloadId;
+    m_canUpdateProgress = 1;
+
+    if (m_hasData.fetchAndStoreOrdered(0))
+        return;
+
+    // emit no received data
+    int downloadId = m_download->getId();
+
+    // Move to another mirror, the reply belongs to the download thread
+    if (m_download->getMirrorUrls().count() > 1)
+        QMetaObject::invokeMethod(m_control, "requestFailover", Qt::QueuedConnection);
+
+    // The progress belongs to the download thread, only reset the published values
+    DownloadProgressSnapshot snapshot;
+    if (m_download->getProgress(snapshot)) {
+        snapshot.instantSpeed = 0;
+        snapshot.remainTime = -1;
+        m_download->publishProgress(snapshot);
     }
+
+    emit noReceivedData(downloadId);
+    qDebug() << __PRETTY_FUNCTION__ << " Emitted noReceivedData signal. Download Id = " << downloadId;
 }
 
 void DownloadThread::updateDownloadTimeout()
 {
-    if (m_hasData)
+    if (m_stopped || m_hasData)
         return;
 
     // emit timeout signal
     emit downloadError(m_download->getId(), DownloadManager::TimeoutError);
 }
 
-void DownloadThread::slotDownloadError(QNetworkReply::NetworkError error)
+bool DownloadThread::checkSegmentAnswer(DownloadSegment *segment)
 {
-    emit downloadError(m_download->getId(), (DownloadManager::DownloadErrorCode)error);
+    QNetworkReply *reply = segment->reply;
+    int statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+    bool rangeRequest = (segment->position > 0 || segment->end >= 0);
+
+    // Validators of the whole file, stored with the file once it is complete
+    if (!rangeRequest && statusCode == 200)
+        m_download->setValidators(QString::fromAscii(reply->rawHeader("ETag")), QString::fromAscii(reply->rawHeader("Last-Modified")));
+
+    // Classify before the file is split, streaming depends on the type
+    if (m_sniffing && segment->start == 0) {
+        DownloadManager::UrlType urlType = ContentSniffer::getUrlTypeByContentType(reply->rawHeader("Content-Type"));
+        if (urlType != DownloadManager::UnknownType)
+            classify(urlType);
+    }
+
+    StreamDecoder::Encoding encoding = StreamDecoder::getEncoding(reply->rawHeader("Content-Encoding"));
+    if (encoding == StreamDecoder::Unsupported || (encoding != StreamDecoder::Identity && rangeRequest)) {
+        qDebug() << __PRETTY_FUNCTION__ << " Unexpected Content-Encoding " << reply->rawHeader("Content-Encoding") << ", downloadId = " << m_download->getId();
+        return false;
+    }
+
+    if (encoding != StreamDecoder::Identity) {
+        segment->decoder = new StreamDecoder;
+        Q_ASSERT(segment->decoder != 0);
+        if (!segment->decoder->begin(encoding))
+            return false;
+
+        // Content-Length is the size of the compressed body, the size of the file is known at the end only
+        bool ok = false;
+        qint64 length = reply->header(QNetworkRequest::ContentLengthHeader).toLongLong(&ok);
+        m_wireBytesTotal = (ok && length >= 0) ? length : -1;
+        return true;
+    }
+
+    if (rangeRequest && statusCode != 206) {
+        // The other segments cannot be kept if the server sends the whole file again
+        if (m_segments.count() > 1)
+            return false;
+
+        qDebug() << __PRETTY_FUNCTION__ << " Could not resume, downloadId = " << m_download->getId();
+        m_output.resize(0);
+        m_output.seek(0);
+        segment->start = 0;
+        segment->position = 0;
+        segment->end = -1;
+        m_baseOffset = 0;
+    }
+
+    // Learn the size of the file from the first answer
+    if (m_bytesTotal < 0) {
+        if (statusCode == 206) {
+            // Content-Range: bytes first-last/total
+            QByteArray contentRange = reply->rawHeader("Content-Range");
+            int slash = contentRange.lastIndexOf('/');
+            bool ok = false;
+            qint64 total = (slash >= 0) ? contentRange.mid(slash + 1).toLongLong(&ok) : -1;
+            if (ok)
+                m_bytesTotal = total;
+        } else {
+            bool ok = false;
+            qint64 length = reply->header(QNetworkRequest::ContentLengthHeader).toLongLong(&ok);
+            if (ok && length >= 0)
+                m_bytesTotal = segment->position + length;
+        }
+    }
+
+    if (statusCode == 206 || reply->rawHeader("Accept-Ranges") == "bytes")
+        m_rangesSupported = true;
+
+    if (segment->end < 0 && m_bytesTotal >= 0 && m_segments.count() == 1) {
+        segment->end = m_bytesTotal;
+
+        // Only split when the server is known to serve ranges
+        if (m_rangesSupported)
+            splitDownload(segment);
+    }
+
+    return true;
 }
 
-void DownloadThread::slotDownloadProgress(qint64 bytesReceived, qint64 bytesTotal)
+void DownloadThread::splitDownload(DownloadSegment *segment)
 {
-    m_hasData = true;
+    qint64 remain = segment->end - segment->position;
 
-    if (m_canUpdateProgress) {
-        int elapseTime = 1;
-        if (m_downloadTime != 0)
-            elapseTime = m_downloadTime->elapsed();
+    // A player reads from the start, the running reply stays sequential and a second
+    // connection only fetches the tail. Other connections join through stealWork
+    if (m_streaming) {
+        if (!m_download->isTailPrefetched() || remain < 2*STREAMING_TAIL_SIZE)
+            return;
 
-        if (elapseTime == 0)
-            elapseTime = 0.001; // When fast download, the elapse time might be equal to 0, reset it to 1 milisecond
+        m_segmented = true;
+        qint64 end = segment->end;
+        segment->end = end - STREAMING_TAIL_SIZE;
+        startSegment((segment->mirror + 1) % qMax(1, m_mirrorUrls.count()), segment->end, end);
 
-        int currentSpeed = 0;
-        currentSpeed = bytesReceived*1000/elapseTime; //byte/s
+        qDebug() << __PRETTY_FUNCTION__ << " Prefetching the tail, downloadId = " << m_download->getId();
+        return;
+    }
 
-        qint64 remainByte = bytesTotal - bytesReceived;
-        if (currentSpeed > 0) {
-            int remainTime = remainByte*1000/currentSpeed;
-            m_currentRemainTime = remainTime;
-            emit downloadTimeRemain(m_download->getId(), remainTime);
-            qDebug() << __PRETTY_FUNCTION__ << " Emitted downloadTimeRemain signal" << ", downloadId = " << m_download->getId();
+    int count = (int)qMin((qint64)DOWNLOAD_SEGMENT_COUNT, remain/DOWNLOAD_SEGMENT_MIN_SIZE);
+    if (count < 2)
+        return;
+
+    m_segmented = true;
+
+    // The running reply keeps the first part, its request already covers the whole file
+    qint64 size = remain/count;
+    qint64 end = segment->end;
+    segment->end = segment->position + size;
+
+    // Spread the other parts over the mirrors, the fastest one keeps the first part
+    for (int i = 1; i < count; i++) {
+        qint64 start = segment->position + size*i;
+        int mirror = (segment->mirror + i) % qMax(1, m_mirrorUrls.count());
+        startSegment(mirror, start, (i == count - 1) ? end : start + size);
+    }
+
+    qDebug() << __PRETTY_FUNCTION__ << " Split in " << count << " segments, downloadId = " << m_download->getId();
+}
+
+void DownloadThread::slotSegmentReadyRead()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+    DownloadSegment *segment = m_segmentReplies.value(reply, 0);
+    if (segment == 0)
+        return;
+
+    readSegment(segment);
+}
+
+void DownloadThread::readSegment(DownloadSegment *segment)
+{
+    QNetworkReply *reply = segment->reply;
+    if (reply == 0)
+        return;
+
+    if (!segment->checked) {
+        segment->checked = true;
+
+        // The cached copy is still valid, nothing to download
+        int statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+        if (statusCode == 304 && m_cachedCopy.isValid()) {
+            detachReply(segment);
+            completeNotModified();
+            return;
         }
 
-        m_canUpdateProgress = false;
+        if (!checkSegmentAnswer(segment)) {
+            failSegment(segment, QNetworkReply::ContentReSendError);
+            return;
+        }
+
+        if (!openOutput()) {
+            detachReply(segment);
+            return;
+        }
+    }
+
+    // A reply may run past the end of its segment once the range has been shared
+    qint64 available = reply->bytesAvailable();
+    if (segment->end >= 0)
+        available = qMin(available, segment->end - segment->position);
+
+    if (available > 0) {
+        QByteArray data = reply->read(available);
+        m_wireBytes += data.size();
+        MetricsRegistry::instance()->increment(METRIC_WIRE_BYTES, data.size());
+
+        // Decode before the data reaches the file, positions are counted in decoded bytes
+        if (segment->decoder) {
+            QByteArray decoded;
+            if (!segment->decoder->decode(data, decoded)) {
+                failSegment(segment, QNetworkReply::ProtocolFailure);
+                return;
+            }
+            data = decoded;
+        }
+
+        // The start of the file is inspected on its way to the disk, nothing is held back
+        if (m_sniffing && segment->start == 0 && !sniffData(data)) {
+            detachReply(segment);
+            emit downloadError(m_download->getId(), DownloadManager::UnknownUrlType);
+            return;
+        }
+
+        if (m_output.pos() != segment->position)
+            m_output.seek(segment->position);
+        m_output.write(data);
+        segment->position += data.size();
+        MetricsRegistry::instance()->increment(METRIC_BYTES_DOWNLOADED, data.size());
+
+        m_hasData = 1;
+        recordFirstByte();
+        updateProgress();
+        if (m_streaming)
+            updateWatermark();
+    }
+
+    if (segment->end >= 0 && segment->position >= segment->end) {
+        detachReply(segment);
+        completeSegment(segment);
+    }
+
+    updateBufferedBytes();
+}
+
+void DownloadThread::slotSegmentFinished()
+{
+    QNetworkReply *reply = qobject_cast<QNetworkReply *>(sender());
+    DownloadSegment *segment = m_segmentReplies.value(reply, 0);
+    if (segment == 0)
+        return;
+
+    finishSegment(segment);
+}
+
+void DownloadThread::finishSegment(DownloadSegment *segment)
+{
+    QNetworkReply *reply = segment->reply;
+    QNetworkReply::NetworkError error = reply->error();
+
+    // Write what is left in the buffer
+    if (error == QNetworkReply::NoError) {
+        readSegment(segment);
+        if (segment->reply == 0)
+            return; // the segment was completed or failed meanwhile
+    } else {
+        qDebug() << __PRETTY_FUNCTION__ << " Download failed" << ", downloadId = " << m_download->getId() << ": " << reply->errorString();
+    }
+
+    // A compressed body is only complete once its end marker is decoded
+    bool truncated = (segment->decoder != 0 && !segment->decoder->isFinished());
+
+    detachReply(segment);
+
+    if (error == QNetworkReply::NoError && segment->end < 0 && !truncated) {
+        // The size was unknown, the end of the reply is the end of the file
+        segment->end = segment->position;
+        completeSegment(segment);
+        return;
     }
+
+    // The connection closed before the end of the segment
+    if (error == QNetworkReply::NoError)
+        error = QNetworkReply::RemoteHostClosedError;
+    failSegment(segment, error);
 }
 
-void DownloadThread::slotDownloadFinished()
+bool DownloadThread::failSegment(DownloadSegment *segment, QNetworkReply::NetworkError error)
 {
-    m_currentRemainTime = 0;
+    detachReply(segment);
+
+    // Try the next mirror before giving up
+    if (switchMirror(segment))
+        return true;
+
+    // Another connection takes the range over when it runs out of work
+    for (int i = 0; i < m_segments.count(); i++) {
+        if (m_segments.at(i)->reply)
+            return true;
+    }
+
+    emit downloadError(m_download->getId(), (DownloadManager::DownloadErrorCode)error);
+    return false;
+}
+
+void DownloadThread::completeSegment(DownloadSegment *segment)
+{
+    if (stealWork(segment))
+        return;
+
+    for (int i = 0; i < m_segments.count(); i++) {
+        const DownloadSegment *s = m_segments.at(i);
+        if (s->reply || s->position < s->end)
+            return; // still running or waiting for a connection
+    }
+
+    m_download->markTrace(DownloadTrace::LastByte);
+    m_progress.remainTime = 0;
+    publishProgress();
     m_output.close();
 
-    if (m_networkReply->error()) {
-        qDebug() << __PRETTY_FUNCTION__ << " Download failed" << ", downloadId = " << m_download->getId() << ": " << m_networkReply->errorString();
-        // download failed
-        emit downloadError(m_download->getId(), DownloadManager::UnknownError);
-    } else
-        emit downloadFinished();
+    // A resumed or very small file was not classified on the way
+    if (m_sniffing && !sniffFile()) {
+        emit downloadError(m_download->getId(), DownloadManager::UnknownUrlType);
+        return;
+    }
+
+    m_download->markTrace(DownloadTrace::FileClosed);
 
-    m_networkReply->deleteLater();
-    m_networkReply = 0;
+    // Only the bytes of this attempt count for its throughput, the base offset drops to 0 when the server ignores the range
+    int elapseTime = qMax(m_downloadTime ? m_downloadTime->elapsed() : 0, 1);
+    qint64 bytes = m_progress.bytesReceived - m_baseOffset;
+    MetricsRegistry::instance()->observe(METRIC_DOWNLOAD_DURATION, elapseTime/1000.0);
+    MetricsRegistry::instance()->observe(METRIC_DOWNLOAD_THROUGHPUT, bytes*1000.0/elapseTime);
+
+    emit downloadFinished();
 }
 
-void DownloadThread::slotReadyRead()
+void DownloadThread::completeNotModified()
 {
-    if (m_networkReply)
-        m_output.write(m_networkReply->readAll());
+    qDebug() << __PRETTY_FUNCTION__ << " Not modified, using " << m_cachedCopy.filePath << ", downloadId = " << m_download->getId();
+
+    // The validators of the copy stay valid
+    m_download->setSavedFilePathName(m_cachedCopy.filePath);
+    m_download->setValidators(m_cachedCopy.etag, m_cachedCopy.lastModified);
+    m_download->setRevalidated();
+
+    m_download->markTrace(DownloadTrace::LastByte);
+    m_progress.bytesReceived = m_cachedCopy.size;
+    m_progress.bytesTotal = m_cachedCopy.size;
+    m_progress.contiguousBytes = m_cachedCopy.size;
+    m_progress.remainTime = 0;
+    publishProgress();
+    m_download->markTrace(DownloadTrace::FileClosed);
+
+    MetricsRegistry::instance()->increment(METRIC_CACHE_REVALIDATED);
+
+    emit downloadFinished();
+}
+
+bool DownloadThread::stealWork(DownloadSegment *idle)
+{
+    if (!m_segmented)
+        return false;
+
+    // A segment left by a failed connection is taken over as a whole
+    DownloadSegment *victim = 0;
+    for (int i = 0; i < m_segments.count(); i++) {
+        DownloadSegment *s = m_segments.at(i);
+        if (s->reply == 0 && s->position < s->end) {
+            s->mirror = idle->mirror;
+            requestSegment(s);
+            return true;
+        }
+
+        if (s->reply && (victim == 0 || s->end - s->position > victim->end - victim->position))
+            victim = s;
+    }
+
+    // Otherwise split the largest remaining range, the idle connection takes the second half
+    if (victim == 0 || victim->end - victim->position < 2*DOWNLOAD_SEGMENT_MIN_SIZE)
+        return false;
+
+    qint64 middle = victim->position + (victim->end - victim->position)/2;
+    qint64 end = victim->end;
+    victim->end = middle;
+    startSegment(idle->mirror, middle, end);
+
+    qDebug() << __PRETTY_FUNCTION__ << " Stole range " << middle << "-" << end << ", downloadId = " << m_download->getId();
+    return true;
 }
 
-int DownloadThread::getCurrentRemainTime()
+bool DownloadThread::isStreamable(DownloadManager::UrlType urlType)
 {
-    return m_currentRemainTime;
+    const MediaTypeRegistry *mediaTypes = m_download->getMediaTypes();
+    return m_download->isStreaming() && mediaTypes != 0 && mediaTypes->getPolicy(urlType).streaming;
+}
+
+void DownloadThread::classify(DownloadManager::UrlType urlType)
+{
+    qDebug() << __PRETTY_FUNCTION__ << " Classified as " << urlType << ", downloadId = " << m_download->getId();
+
+    m_download->setUrlType(urlType);
+    m_sniffing = false;
+    m_sniffBuffer.clear();
+    m_streaming = isStreamable(urlType);
+}
+
+bool DownloadThread::sniffData(const QByteArray &data)
+{
+    m_sniffBuffer.append(data.left(SNIFF_MAX_BYTES - m_sniffBuffer.size()));
+
+    DownloadManager::UrlType urlType = ContentSniffer::getUrlTypeByMagic(m_sniffBuffer);
+    if (urlType != DownloadManager::UnknownType) {
+        classify(urlType);
+        return true;
+    }
+
+    if (m_sniffBuffer.size() < SNIFF_MAX_BYTES)
+        return true; // wait for more data
+
+    qDebug() << __PRETTY_FUNCTION__ << " Unknown content, downloadId = " << m_download->getId();
+    return false;
+}
+
+bool DownloadThread::sniffFile()
+{
+    QFile file(m_output.fileName());
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    DownloadManager::UrlType urlType = ContentSniffer::getUrlTypeByMagic(file.read(SNIFF_MAX_BYTES));
+    if (urlType == DownloadManager::UnknownType) {
+        qDebug() << __PRETTY_FUNCTION__ << " Unknown content, downloadId = " << m_download->getId();
+        return false;
+    }
+
+    classify(urlType);
+    return true;
+}
+
+void DownloadThread::seek(qint64 offset)
+{
+    // The segments belong to the download thread
+    QMetaObject::invokeMethod(m_control, "requestSeek", Qt::QueuedConnection, Q_ARG(qint64, offset));
+}
+
+void DownloadThread::slotSeekRequested(qint64 offset)
+{
+    // Only a file of known size served by ranges can be fetched out of order
+    if (!m_rangesSupported || m_bytesTotal < 0 || offset < 0 || offset >= m_bytesTotal)
+        return;
+
+    for (int i = 0; i < m_segments.count(); i++) {
+        DownloadSegment *segment = m_segments.at(i);
+        if (offset < segment->start || segment->end < 0 || offset >= segment->end)
+            continue;
+
+        // Already written or about to be received
+        if (segment->decoder != 0 || offset < segment->position)
+            return;
+        if (segment->reply && offset - segment->position < STREAMING_SEEK_THRESHOLD)
+            return;
+
+        // The connection moves to the offset, the skipped range waits for the next free connection
+        qint64 end = segment->end;
+        detachReply(segment);
+        segment->end = offset;
+        m_segmented = true;
+        startSegment(segment->mirror, offset, end);
+
+        qDebug() << __PRETTY_FUNCTION__ << " Fetching from " << offset << ", downloadId = " << m_download->getId();
+        return;
+    }
+}
+
+qint64 DownloadThread::getContiguousBytes() const
+{
+    qint64 contiguous = m_baseOffset;
+    for (int i = 0; i < m_segments.count(); i++) {
+        const DownloadSegment *s = m_segments.at(i);
+        if (s->start > contiguous)
+            break;
+        contiguous = qMax(contiguous, s->position);
+        if (s->end < 0 || s->position < s->end)
+            break;
+    }
+
+    return contiguous;
+}
+
+void DownloadThread::updateWatermark()
+{
+    qint64 contiguous = getContiguousBytes();
+    if (contiguous <= m_watermark)
+        return;
+    if (contiguous - m_watermark < STREAMING_WATERMARK_STEP && contiguous != m_bytesTotal)
+        return;
+
+    // The reader opens the file by itself, the data must be out of the QFile buffer
+    m_output.flush();
+    m_watermark = contiguous;
+    emit contiguousBytesAvailable(m_download->getId(), contiguous);
+}
+
+void DownloadThread::updateProgress()
+{
+    // Bytes kept from the previous attempt plus what every segment wrote
+    qint64 bytesReceived = m_baseOffset;
+    for (int i = 0; i < m_segments.count(); i++)
+        bytesReceived += m_segments.at(i)->position - m_segments.at(i)->start;
+
+    int elapseTime = 0;
+    if (m_downloadTime != 0)
+        elapseTime = m_downloadTime->elapsed();
+    m_speedEstimator.addSample(bytesReceived, elapseTime);
+
+    m_progress.bytesReceived = bytesReceived;
+    m_progress.bytesTotal = qMax(m_bytesTotal, (qint64)0);
+    m_progress.wireBytesReceived = m_wireBytes;
+    m_progress.contiguousBytes = getContiguousBytes();
+    if (m_wireBytesTotal >= 0)
+        m_progress.wireBytesTotal = m_wireBytesTotal;
+    else
+        m_progress.wireBytesTotal = qMax(m_bytesTotal - m_baseOffset, (qint64)0);
+    m_progress.instantSpeed = m_speedEstimator.getInstantSpeed();
+    m_progress.smoothedSpeed = m_speedEstimator.getSmoothedSpeed();
+
+    if (m_canUpdateProgress && m_bytesTotal > 0) {
+        int remainTime = m_speedEstimator.getRemainTime(m_bytesTotal - bytesReceived);
+        if (remainTime >= 0) {
+            m_progress.remainTime = remainTime;
+            emit downloadTimeRemain(m_download->getId(), remainTime);
+            qDebug() << __PRETTY_FUNCTION__ << " Emitted downloadTimeRemain signal" << ", downloadId = " << m_download->getId();
+
+            m_canUpdateProgress = 0;
+        }
+    }
+
+    publishProgress();
+}
+
+void DownloadThread::recordFirstByte()
+{
+    if (m_firstByteReceived || m_downloadTime == 0)
+        return;
+
+    m_firstByteReceived = true;
+    m_download->markTrace(DownloadTrace::FirstByte);
+    MetricsRegistry::instance()->observe(METRIC_TIME_TO_FIRST_BYTE, m_downloadTime->elapsed()/1000.0);
+}
+
+void DownloadThread::updateBufferedBytes()
+{
+    qint64 bufferedBytes = 0;
+
+    QHash<QNetworkReply *, int>::const_iterator race;
+    for (race = m_racingReplies.constBegin(); race != m_racingReplies.constEnd(); ++race)
+        bufferedBytes += race.key()->bytesAvailable();
+
+    QHash<QNetworkReply *, DownloadSegment *>::const_iterator segment;
+    for (segment = m_segmentReplies.constBegin(); segment != m_segmentReplies.constEnd(); ++segment)
+        bufferedBytes += segment.key()->bytesAvailable();
+
+    // The gauge is shared by all downloads, only publish the change
+    if (bufferedBytes != m_bufferedBytes) {
+        MetricsRegistry::instance()->addGauge(METRIC_BUFFERED_BYTES, bufferedBytes - m_bufferedBytes);
+        m_bufferedBytes = bufferedBytes;
+    }
+}
+
+void DownloadThread::publishProgress()
+{
+    m_download->publishProgress(m_progress);
 }
 
 void DownloadThread::stop()
 {
-    disconnectSignals();
+    m_stopped = 1;
+    cancelTimers();
 }
 
-DownloadThread::~DownloadThread()
+void DownloadThread::reset()
 {
-    m_networkAccessManager->deleteLater();
+    // Timer callbacks and requests posted for the last run must not reach the next one
+    QCoreApplication::removePostedEvents(this);
+    QCoreApplication::removePostedEvents(m_control);
+    m_stopped = 0;
+}
 
+DownloadThread::~DownloadThread()
+{
     if (m_downloadTime)
         delete m_downloadTime;
     m_downloadTime = 0;
 
-    if (m_downloadProgressTimer)
-        delete m_downloadProgressTimer;
-    m_downloadProgressTimer = 0;
-
-    if (m_downloadTimeoutTimer)
-        delete m_downloadTimeoutTimer;
-    m_downloadTimeoutTimer = 0;
+    // Queued timer callbacks are dropped with the object, pending ones must not fire any more
+    cancelTimers();
 
     this->wait();
+
+    // Only left if the thread never ran
+    if (m_networkAccessManager)
+        m_networkAccessManager->deleteLater();
+    qDeleteAll(m_segments);
+
+    delete m_control;
+    m_control = 0;
 }
@@ -14,9 +14,55 @@
 
 #include <QThread>
 #include <QNetworkReply>
-#include <QTimer>
+#include <QAtomicInt>
 #include <QFile>
+#include <QHash>
+#include <QStringList>
 #include "downloadmanager.h"
+#include "downloadprogresstable.h"
+#include "speedestimator.h"
+#include "streamdecoder.h"
+
+/*!
+ * \brief Receiver living in a download thread.
+ *
+ * Other threads invoke its slots with a queued connection to run work in the
+ * download thread, which owns the network replies.
+ */
+class DownloadThreadControl : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DownloadThreadControl(QObject *parent = 0);
+
+signals:
+    // emitted in the download thread when a failover is requested
+    void failoverRequested();
+
+    // emitted in the download thread when a reader seeks in a streamed file
+    void seekRequested(qint64 offset);
+
+public slots:
+    // Ask the download thread to move to the next mirror
+    void requestFailover();
+
+    // Ask the download thread to fetch the file from an offset first
+    void requestSeek(qint64 offset);
+};
+
+/*!
+ * \brief Byte range of the file fetched by one connection
+ */
+struct DownloadSegment
+{
+    QNetworkReply *reply; // 0 while the segment waits for a connection or is complete
+    int mirror; // index of the mirror serving the segment
+    qint64 start; // first byte of the segment
+    qint64 position; // next byte to write
+    qint64 end; // byte following the segment, -1 until the size of the file is known
+    bool checked; // true once the answer to the current request has been checked
+    StreamDecoder *decoder; // decodes a compressed answer, 0 if the answer is not encoded
+};
 
 class Download;
 class DownloadThread : public QThread
@@ -31,6 +77,19 @@ public:
      */
     void stop();
 
+    /*!
+     * \brief Forget the last run before the thread is started again
+     * \note call it from the thread owning the object, once the last run is over
+     */
+    void reset();
+
+    /*!
+     * \brief Fetch the bytes following an offset before the rest of the file
+     * \param offset: position the reader moved to
+     * \note can be called from any thread, ignored if the server does not serve ranges
+     */
+    void seek(qint64 offset);
+
 signals:
     /*!
      * \brief emitted when received changed
@@ -67,32 +126,37 @@ signals:
      */
     void downloadSslErrors(const QList<QSslError> &errors);
 
-public:
     /*!
-     * \brief get current remain time
-     * \returns current remain time
-     * \returns -1 if it does not receive data
+     * \brief emitted in streaming mode when more of the start of the file can be read
+     * \param downloadId: id of download
+     * \param bytesAvailable: bytes written from the start of the file without any gap
      */
-    int getCurrentRemainTime();
+    void contiguousBytesAvailable(int downloadId, qint64 bytesAvailable);
 
 protected slots:
-    // Slot when download finished
-    void slotDownloadFinished();
-
-    // Slot when getting progress changes
-    void slotDownloadProgress(qint64 bytesReceived, qint64 bytesTotal);
-
-    // Slot when getting errors
-    void slotDownloadError(QNetworkReply::NetworkError error);
+    // Slot when the reply of a segment finished
+    void slotSegmentFinished();
 
-    // Update download progress
+    // Update download progress, invoked by the timer wheel in the manager thread
     void updateDownloadProgress();
 
-    // Update download timeout
+    // Update download timeout, invoked by the timer wheel in the manager thread
     void updateDownloadTimeout();
 
-    // Write buffer to file
-    void slotReadyRead();
+    // Write the data of a segment to file
+    void slotSegmentReadyRead();
+
+    // Slot when a racing mirror received data
+    void slotRaceProgress(qint64 bytesReceived, qint64 bytesTotal);
+
+    // Slot when a racing mirror finished
+    void slotRaceFinished();
+
+    // Slot when the current mirror stalled
+    void slotFailoverRequested();
+
+    // Slot when a reader moved to another position of a streamed file
+    void slotSeekRequested(qint64 offset);
 
 protected:
 
@@ -100,26 +164,136 @@ protected:
 
     void init();
 
-    void disconnectSignals();
+    // Cancel the progress and timeout timers
+    void cancelTimers();
+
+    // Create a segment and request its range
+    DownloadSegment *startSegment(int mirror, qint64 start, qint64 end);
+
+    // Request the missing part of a segment from its mirror
+    void requestSegment(DownloadSegment *segment);
+
+    // Build the request of a mirror, only a request of the whole file may get a compressed answer
+    QNetworkRequest createRequest(const QString &url, bool wholeFile);
+
+    // Attach a reply to a segment
+    void attachReply(DownloadSegment *segment, QNetworkReply *reply);
+
+    // Detach the reply of a segment, aborting it if it is still running
+    void detachReply(DownloadSegment *segment);
+
+    // Check the status of the first answer to a segment request, returns false if it is unusable
+    bool checkSegmentAnswer(DownloadSegment *segment);
+
+    // Write the available data of a segment, up to its end
+    void readSegment(DownloadSegment *segment);
+
+    // Handle the end of the reply of a segment
+    void finishSegment(DownloadSegment *segment);
+
+    // Move a segment to another mirror or leave it to the other connections, returns false if the download failed
+    bool failSegment(DownloadSegment *segment, QNetworkReply::NetworkError error);
+
+    // Give a free connection more work, then finish the download if nothing is left
+    void completeSegment(DownloadSegment *segment);
+
+    // Share the rest of the file between DOWNLOAD_SEGMENT_COUNT connections, or keep it sequential when streaming
+    void splitDownload(DownloadSegment *segment);
+
+    // Take over a waiting segment or the second half of the largest remaining range
+    bool stealWork(DownloadSegment *idle);
+
+    // Get the bytes written from the start of the file without any gap
+    qint64 getContiguousBytes() const;
+
+    // Tell a streaming reader that the gapless prefix of the file grew
+    void updateWatermark();
+
+    // Check whether the streaming mode is enabled and the policy of a type allows it
+    bool isStreamable(DownloadManager::UrlType urlType);
+
+    // Set the type found for a download whose url did not tell it
+    void classify(DownloadManager::UrlType urlType);
+
+    // Classify by the first bytes of the content, returns false once SNIFF_MAX_BYTES did not match
+    bool sniffData(const QByteArray &data);
+
+    // Classify by the start of the complete file, returns false if it does not match
+    bool sniffFile();
+
+    // Update the progress after new data is written
+    void updateProgress();
+
+    // Close the file and remove the segments
+    void cleanup();
+
+    // Open the output file if it is not open yet, returns false and reports the error if it cannot be written
+    bool openOutput();
+
+    // Finish the download with the cached copy the server confirmed
+    void completeNotModified();
+
+    // Record the time to first byte of the attempt
+    void recordFirstByte();
+
+    // Publish the bytes held by the replies and not written yet
+    void updateBufferedBytes();
+
+    // Request the file from every mirror
+    void startRace();
+
+    // Keep the winner of the race and abort the others
+    void finishRace(QNetworkReply *winner);
+
+    // Continue a segment from the next mirror, returns false if there is none left
+    bool switchMirror(DownloadSegment *segment);
+
+    // Publish the current progress to the progress table
+    void publishProgress();
 
 private:
     Download *m_download;
 
-    QTimer *m_downloadProgressTimer;
-    QTimer *m_downloadTimeoutTimer;
+    int m_downloadProgressTimerId; // progress timer in the timer wheel
+    int m_downloadTimeoutTimerId; // timeout timer in the timer wheel
 
     QTime *m_downloadTime;
 
     QFile m_output; // File to store dta stream
 
     QNetworkAccessManager *m_networkAccessManager;
-    QNetworkReply *m_networkReply;
 
-    bool m_canUpdateProgress;
-    bool m_checkDownloadTimeout;
-    bool m_hasData;
+    QList<DownloadSegment *> m_segments; // byte ranges of the file, sorted by start
+    QHash<QNetworkReply *, DownloadSegment *> m_segmentReplies; // running replies and their segment
+    bool m_segmented; // true once the file is shared between several connections
+    qint64 m_baseOffset; // bytes kept from the previous attempt
+    qint64 m_bytesTotal; // size of the file, -1 if unknown
+    bool m_firstByteReceived; // true once the time to first byte is recorded
+    qint64 m_bufferedBytes; // bytes held by the replies, as last published
+    qint64 m_wireBytes; // bytes read from the network by this attempt, before decoding
+    qint64 m_wireBytesTotal; // size of a compressed answer, -1 if the answer is not encoded or its size is unknown
+    bool m_rangesSupported; // true once the server is known to serve ranges
+    bool m_streaming; // true to fetch the file in playback order
+    qint64 m_watermark; // contiguous bytes last notified to a streaming reader
+    bool m_sniffing; // true while the type of the download is unknown
+    QByteArray m_sniffBuffer; // first bytes of the file, up to SNIFF_MAX_BYTES
+    DownloadCacheEntry m_cachedCopy; // copy revalidated by the first request, invalid if there is none
+
+    DownloadThreadControl *m_control; // posts work to the download thread
+
+    QStringList m_mirrorUrls; // urls of the file, the first one is the primary url
+    int m_currentMirror; // index of the mirror in use
+    int m_failoverCount; // number of mirror switches of the current attempt, all segments together
+    QHash<QNetworkReply *, int> m_racingReplies; // racing replies and their mirror index
+
+    // Shared with the timer callbacks
+    QAtomicInt m_canUpdateProgress;
+    QAtomicInt m_hasData;
+    QAtomicInt m_stopped;
+
+    SpeedEstimator m_speedEstimator; // speed of the transfer
 
-    int m_currentRemainTime; // current remain time
+    DownloadProgressSnapshot m_progress; // current progress, owned by the download thread
 };
 
 #endif // DOWNLOADTHREAD_H
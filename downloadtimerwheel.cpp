@@ -0,0 +1,201 @@
+/*!
+ * \file downloadtimerwheel.cpp
+ * \brief hierarchical timer wheel shared by all downloads
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#include "downloadtimerwheel.h"
+#include <QTimer>
+#include <QMetaObject>
+
+DownloadTimerWheel::DownloadTimerWheel(QObject *parent) :
+    QObject(parent)
+{
+    m_freeList = -1;
+    m_currentTick = 0;
+    m_count = 0;
+
+    // The first nodes are the heads of the circular lists of both levels
+    m_nodes.resize(SentinelCount);
+    for (int i = 0; i < SentinelCount; i++) {
+        m_nodes[i].prev = i;
+        m_nodes[i].next = i;
+        m_nodes[i].generation = 0;
+        m_nodes[i].receiver = 0;
+        m_nodes[i].member = 0;
+    }
+
+    m_tickTimer = new QTimer(this);
+    Q_ASSERT(m_tickTimer != 0);
+    m_tickTimer->setInterval(TIMER_WHEEL_TICK);
+    connect(m_tickTimer, SIGNAL(timeout()), this, SLOT(slotTick()));
+}
+
+int DownloadTimerWheel::allocateNode()
+{
+    if (m_freeList < 0) {
+        int index = m_nodes.size();
+        Q_ASSERT(index <= IndexMask);
+        m_nodes.resize(index + 1);
+        m_nodes[index].generation = 0;
+        return index;
+    }
+
+    int index = m_freeList;
+    m_freeList = m_nodes[index].next;
+    return index;
+}
+
+void DownloadTimerWheel::freeNode(int index)
+{
+    Node &node = m_nodes[index];
+    node.generation = (node.generation + 1) & GenerationMask;
+    node.receiver = 0;
+    node.member = 0;
+    node.prev = -1;
+    node.next = m_freeList;
+    m_freeList = index;
+    m_count--;
+}
+
+void DownloadTimerWheel::link(int index)
+{
+    Node &node = m_nodes[index];
+    int delta = node.expiry - m_currentTick;
+
+    int head;
+    if (delta < WheelSize)
+        head = node.expiry & WheelMask;
+    else if (delta < WheelSize*WheelSize)
+        head = WheelSize + ((node.expiry >> WheelBits) & WheelMask);
+    else // out of range, park it in the last outer slot, the cascade will move it again
+        head = WheelSize + (((m_currentTick + WheelSize*WheelSize - 1) >> WheelBits) & WheelMask);
+
+    node.prev = m_nodes[head].prev;
+    node.next = head;
+    m_nodes[node.prev].next = index;
+    m_nodes[head].prev = index;
+}
+
+void DownloadTimerWheel::unlink(int index)
+{
+    Node &node = m_nodes[index];
+    m_nodes[node.prev].next = node.next;
+    m_nodes[node.next].prev = node.prev;
+    node.prev = -1;
+    node.next = -1;
+}
+
+int DownloadTimerWheel::schedule(QObject *receiver, const char *member, int interval, bool repeat)
+{
+    if (receiver == 0 || member == 0)
+        return -1;
+
+    if (interval < 1)
+        interval = 1;
+
+    QMutexLocker locker(&m_mutex);
+    int index = allocateNode();
+    Node &node = m_nodes[index];
+    node.receiver = receiver;
+    node.member = member;
+    node.interval = repeat ? interval : 0;
+    node.expiry = m_currentTick + interval;
+    link(index);
+
+    if (m_count++ == 0) {
+        // The tick timer belongs to the thread of the wheel
+        QMetaObject::invokeMethod(this, "slotStartTicking", Qt::QueuedConnection);
+    }
+
+    return (node.generation << IndexBits) | index;
+}
+
+void DownloadTimerWheel::cancel(int timerId)
+{
+    if (timerId < 0)
+        return;
+
+    QMutexLocker locker(&m_mutex);
+    int index = timerId & IndexMask;
+    if (index < SentinelCount || index >= m_nodes.size())
+        return;
+
+    Node &node = m_nodes[index];
+    if (node.prev < 0 || node.generation != (timerId >> IndexBits))
+        return; // already expired or cancelled
+
+    unlink(index);
+    freeNode(index);
+}
+
+int DownloadTimerWheel::count()
+{
+    QMutexLocker locker(&m_mutex);
+    return m_count;
+}
+
+void DownloadTimerWheel::cascade()
+{
+    int head = WheelSize + ((m_currentTick >> WheelBits) & WheelMask);
+
+    // Detach the whole list first, some nodes may go back to the same slot
+    int index = m_nodes[head].next;
+    m_nodes[m_nodes[head].prev].next = -1;
+    m_nodes[head].prev = head;
+    m_nodes[head].next = head;
+
+    while (index >= 0 && index != head) {
+        int next = m_nodes[index].next;
+        link(index);
+        index = next;
+    }
+}
+
+void DownloadTimerWheel::slotTick()
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_currentTick++;
+    if ((m_currentTick & WheelMask) == 0)
+        cascade();
+
+    int head = m_currentTick & WheelMask;
+    while (m_nodes[head].next != head) {
+        int index = m_nodes[head].next;
+        unlink(index);
+
+        QObject *receiver = m_nodes[index].receiver;
+        const char *member = m_nodes[index].member;
+
+        if (m_nodes[index].interval > 0) {
+            m_nodes[index].expiry = m_currentTick + m_nodes[index].interval;
+            link(index);
+        } else {
+            freeNode(index);
+        }
+
+        // Only posts an event, the receiver cannot be deleted while the wheel is locked
+        QMetaObject::invokeMethod(receiver, member, Qt::QueuedConnection);
+    }
+
+    if (m_count == 0)
+        m_tickTimer->stop();
+}
+
+void DownloadTimerWheel::slotStartTicking()
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_count > 0 && !m_tickTimer->isActive())
+        m_tickTimer->start();
+}
+
+DownloadTimerWheel::~DownloadTimerWheel()
+{
+    m_tickTimer->stop();
+}
@@ -0,0 +1,113 @@
+/*!
+ * \file downloadtimerwheel.h
+ * \brief hierarchical timer wheel shared by all downloads
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#ifndef DOWNLOADTIMERWHEEL_H
+#define DOWNLOADTIMERWHEEL_H
+
+#include <QObject>
+#include <QVector>
+#include <QMutex>
+#include "common.h"
+
+class QTimer;
+
+/*!
+ * \brief Two level timer wheel ticking every TIMER_WHEEL_TICK milisecond.
+ *
+ * It replaces the per download progress and timeout QTimers: one QTimer drives
+ * every download timer, inserting and cancelling a timer is O(1) and the wheel
+ * does not wake up at all while no timer is scheduled. Expired timers invoke
+ * their slot with a queued connection, so the slot runs in the thread of the
+ * receiver and is dropped if the receiver has been deleted meanwhile.
+ * schedule() and cancel() can be called from any thread.
+ */
+class DownloadTimerWheel : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DownloadTimerWheel(QObject *parent = 0);
+    ~DownloadTimerWheel();
+
+    /*!
+     * \brief Schedule a timer
+     * \param receiver: the object to notify
+     * \param member: name of the slot to invoke, without signature
+     * \param interval: number of ticks before the timer expires, at least 1
+     * \param repeat: true to restart the timer each time it expires
+     * \returns id of the timer
+     * \note the receiver must cancel its timers before it is destroyed
+     */
+    int schedule(QObject *receiver, const char *member, int interval, bool repeat);
+
+    /*!
+     * \brief Cancel a timer
+     * \param timerId: the id returned by schedule(), ignored if it already expired
+     */
+    void cancel(int timerId);
+
+    /*!
+     * \brief Get the number of scheduled timers
+     */
+    int count();
+
+protected slots:
+    // Advance the wheel by one tick
+    void slotTick();
+
+    // Start the tick timer from the thread of the wheel
+    void slotStartTicking();
+
+protected:
+
+    enum {
+        WheelBits = 6,
+        WheelSize = 1 << WheelBits, // slots per level
+        WheelMask = WheelSize - 1,
+        SentinelCount = WheelSize*2, // list heads of both levels
+        IndexBits = 20, // bits of a timer id used by the node index
+        IndexMask = (1 << IndexBits) - 1,
+        GenerationMask = (1 << (31 - IndexBits)) - 1
+    };
+
+    struct Node
+    {
+        int prev;
+        int next;
+        int expiry; // absolute tick
+        int interval; // 0 for a single shot timer
+        int generation; // bumped when the node is freed, so stale ids are ignored
+        QObject *receiver;
+        const char *member;
+    };
+
+    // Put a node in the list matching its expiry tick
+    void link(int index);
+    // Take a node out of its list
+    void unlink(int index);
+    // Get a free node, growing the pool if needed
+    int allocateNode();
+    // Give a node back to the pool
+    void freeNode(int index);
+    // Move the timers of the current outer slot to the inner level
+    void cascade();
+
+private:
+    QVector<Node> m_nodes; // list heads followed by the timer nodes
+    int m_freeList; // first free node, linked through next
+    int m_currentTick;
+    int m_count; // number of scheduled timers
+
+    QTimer *m_tickTimer;
+
+    QMutex m_mutex; // mutex locker for synchronization
+};
+
+#endif // DOWNLOADTIMERWHEEL_H
@@ -0,0 +1,137 @@
+/*!
+ * \file downloadtrace.cpp
+ * \brief timestamps of the phases of a download
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#include "downloadtrace.h"
+#include <QDateTime>
+
+DownloadTrace::DownloadTrace()
+{
+    m_downloadId = -1;
+    m_contactId = -1;
+    m_attempt = 0;
+    for (int i = 0; i < PhaseCount; i++)
+        m_timestamps[i] = -1;
+}
+
+void DownloadTrace::setIds(int downloadId, int contactId)
+{
+    m_downloadId = downloadId;
+    m_contactId = contactId;
+}
+
+int DownloadTrace::getDownloadId() const
+{
+    return m_downloadId;
+}
+
+void DownloadTrace::setAttempt(int attempt)
+{
+    m_attempt = attempt;
+}
+
+void DownloadTrace::mark(Phase phase)
+{
+    mark(phase, QDateTime::currentMSecsSinceEpoch());
+}
+
+void DownloadTrace::mark(Phase phase, qint64 timestamp)
+{
+    if (phase < 0 || phase >= PhaseCount)
+        return;
+
+    m_timestamps[phase] = timestamp;
+    for (int i = phase + 1; i < PhaseCount; i++)
+        m_timestamps[i] = -1;
+}
+
+qint64 DownloadTrace::getTimestamp(Phase phase) const
+{
+    if (phase < 0 || phase >= PhaseCount)
+        return -1;
+
+    return m_timestamps[phase];
+}
+
+QString DownloadTrace::getPhaseName(Phase phase)
+{
+    switch (phase) {
+    case Queued:
+        return "queued";
+    case Dequeued:
+        return "dequeued";
+    case RequestSent:
+        return "requestSent";
+    case FirstByte:
+        return "firstByte";
+    case LastByte:
+        return "lastByte";
+    case FileClosed:
+        return "fileClosed";
+    case StatusWritten:
+        return "statusWritten";
+    default:
+        return "";
+    }
+}
+
+QVariantMap DownloadTrace::toVariantMap() const
+{
+    QVariantMap map;
+    map.insert("downloadId", m_downloadId);
+    map.insert("contactId", m_contactId);
+    map.insert("attempt", m_attempt);
+
+    for (int i = 0; i < PhaseCount; i++) {
+        if (m_timestamps[i] >= 0)
+            map.insert(getPhaseName((Phase)i), m_timestamps[i]);
+    }
+
+    return map;
+}
+
+QByteArray DownloadTrace::toChromeTrace(const QList<DownloadTrace> &traces)
+{
+    // Spans between two consecutive phases, named after what happens in between
+    static const char *spanNames[PhaseCount - 1] = {
+        "queue wait", "startup", "server wait", "transfer", "file flush", "status write"
+    };
+
+    QByteArray json = "{\"traceEvents\":[";
+    bool first = true;
+
+    for (int t = 0; t < traces.count(); t++) {
+        const DownloadTrace &trace = traces.at(t);
+
+        // Name the row of the download
+        json += first ? "\n" : ",\n";
+        first = false;
+        json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" + QByteArray::number(trace.m_downloadId)
+                + ",\"args\":{\"name\":\"download " + QByteArray::number(trace.m_downloadId)
+                + " (contact " + QByteArray::number(trace.m_contactId) + ")\"}}";
+
+        for (int i = 0; i < PhaseCount - 1; i++) {
+            qint64 begin = trace.m_timestamps[i];
+            qint64 end = trace.m_timestamps[i + 1];
+            if (begin < 0 || end < 0)
+                continue;
+
+            // Chrome traces are calculated by microsecond
+            json += ",\n{\"name\":\"" + QByteArray(spanNames[i]) + "\",\"cat\":\"download\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                    + QByteArray::number(trace.m_downloadId)
+                    + ",\"ts\":" + QByteArray::number(begin*1000)
+                    + ",\"dur\":" + QByteArray::number((end - begin)*1000)
+                    + ",\"args\":{\"attempt\":" + QByteArray::number(trace.m_attempt) + "}}";
+        }
+    }
+
+    json += "\n]}\n";
+    return json;
+}
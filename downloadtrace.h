@@ -0,0 +1,100 @@
+/*!
+ * \file downloadtrace.h
+ * \brief timestamps of the phases of a download
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#ifndef DOWNLOADTRACE_H
+#define DOWNLOADTRACE_H
+
+#include <QString>
+#include <QList>
+#include <QVariantMap>
+#include <QByteArray>
+
+/*!
+ * \brief Wall clock time of each phase of a download, calculated by milisecond since the epoch.
+ *
+ * Marking a phase drops the phases after it, they belong to a previous attempt.
+ */
+class DownloadTrace
+{
+public:
+
+    enum Phase {
+        Queued = 0, // added to the queue, or put back by a retry
+        Dequeued, // taken from the queue by the scheduler
+        RequestSent, // first request sent by the download thread
+        FirstByte, // first byte of the body received
+        LastByte, // last byte written
+        FileClosed, // file flushed and closed
+        StatusWritten, // final status written to the database
+        PhaseCount
+    };
+
+    DownloadTrace();
+
+    /*!
+     * \brief Set the ids the trace belongs to
+     */
+    void setIds(int downloadId, int contactId);
+
+    /*!
+     * \brief Get the id of the download
+     */
+    int getDownloadId() const;
+
+    /*!
+     * \brief Set the number of the attempt, 0 for the first one
+     */
+    void setAttempt(int attempt);
+
+    /*!
+     * \brief Record the current time for a phase
+     * \param phase: the phase reached
+     */
+    void mark(Phase phase);
+
+    /*!
+     * \brief Record a past time for a phase
+     * \param phase: the phase reached
+     * \param timestamp: the time calculated by milisecond since the epoch
+     */
+    void mark(Phase phase, qint64 timestamp);
+
+    /*!
+     * \brief Get the time of a phase
+     * \returns the time calculated by milisecond since the epoch, -1 if the phase is not reached
+     */
+    qint64 getTimestamp(Phase phase) const;
+
+    /*!
+     * \brief Get the trace as a map: ids, attempt and one entry per reached phase
+     */
+    QVariantMap toVariantMap() const;
+
+    /*!
+     * \brief Get the name of a phase
+     */
+    static QString getPhaseName(Phase phase);
+
+    /*!
+     * \brief Format traces as Chrome trace event JSON, one row per download
+     * \param traces: the traces to dump
+     * \returns the JSON document, to be loaded in chrome://tracing
+     */
+    static QByteArray toChromeTrace(const QList<DownloadTrace> &traces);
+
+private:
+    int m_downloadId;
+    int m_contactId;
+    int m_attempt;
+    qint64 m_timestamps[PhaseCount]; // -1 for the phases not reached
+};
+
+#endif // DOWNLOADTRACE_H
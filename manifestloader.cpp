@@ -0,0 +1,303 @@
+/*!
+ * \file manifestloader.cpp
+ * \brief batch download of the files listed in a manifest
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#include "manifestloader.h"
+#include "downloadmanager.h"
+#include <QFileInfo>
+#include <QList>
+#include <QTimer>
+#include <QRunnable>
+#include <QDebug>
+
+/*!
+ * \brief Verifies one finished file in a thread of the pool and posts the result to the loader
+ */
+class ManifestVerifyJob : public QRunnable
+{
+public:
+    ManifestVerifyJob(ManifestLoader *loader, int contactId, const QString &filePath, const ManifestLoader::Entry &entry)
+    {
+        m_loader = loader;
+        m_contactId = contactId;
+        m_filePath = filePath;
+        m_entry = entry;
+    }
+
+    void run()
+    {
+        bool verified = ManifestLoader::verify(m_filePath, m_entry);
+        qint64 size = QFileInfo(m_filePath).size();
+        QMetaObject::invokeMethod(m_loader, "slotVerified", Qt::QueuedConnection,
+                                  Q_ARG(int, m_contactId), Q_ARG(bool, verified), Q_ARG(qint64, size));
+    }
+
+private:
+    ManifestLoader *m_loader;
+    int m_contactId;
+    QString m_filePath;
+    ManifestLoader::Entry m_entry;
+};
+
+ManifestLoader::ManifestLoader(DownloadManager *downloadManager, QObject *parent) :
+    QObject(parent)
+{
+    m_downloadManager = downloadManager;
+    Q_ASSERT(m_downloadManager != 0);
+
+    m_reading = false;
+    m_readScheduled = false;
+    m_lineNumber = 0;
+    m_submittedCount = 0;
+    m_finishedCount = 0;
+    m_failedCount = 0;
+    m_malformedCount = 0;
+    m_verifyFailedCount = 0;
+    m_bytesDownloaded = 0;
+
+    // The manager emits from its own thread, the results are queued to this thread
+    connect(m_downloadManager, SIGNAL(downloadStatusChanged(int,int,int)), this, SLOT(onDownloadStatusChanged(int,int,int)));
+    connect(m_downloadManager, SIGNAL(downloadFinished(int,int,QString,int)), this, SLOT(onDownloadFinished(int,int,QString,int)));
+    connect(m_downloadManager, SIGNAL(downloadError(int,int)), this, SLOT(onDownloadError(int,int)));
+    connect(m_downloadManager, SIGNAL(contactDownloadError(int,int)), this, SLOT(onContactDownloadError(int,int)));
+}
+
+bool ManifestLoader::start(const QString &manifestPath)
+{
+    m_manifest.setFileName(manifestPath);
+    if (!m_manifest.open(QIODevice::ReadOnly)) {
+        qDebug() << __PRETTY_FUNCTION__ << " Could not open the manifest " << manifestPath;
+        return false;
+    }
+
+    m_reading = true;
+    m_elapsedTimer.start();
+    checkProgress();
+    return true;
+}
+
+void ManifestLoader::slotReadMore()
+{
+    m_readScheduled = false;
+
+    // A bounded batch per iteration keeps the event loop responsive
+    for (int i = 0; i < MANIFEST_READ_BATCH && m_reading; i++) {
+        if (m_pendingEntries.count() >= MANIFEST_HIGH_WATERMARK)
+            return; // the results of the pending downloads resume the reading
+
+        if (m_manifest.atEnd()) {
+            m_reading = false;
+            m_manifest.close();
+            break;
+        }
+
+        QByteArray line = m_manifest.readLine().trimmed();
+        m_lineNumber++;
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+
+        QString url;
+        int contactId = -1;
+        Entry entry;
+        if (!parseLine(line, url, contactId, entry)) {
+            qDebug() << __PRETTY_FUNCTION__ << " Malformed manifest line " << m_lineNumber;
+            m_malformedCount++;
+            continue;
+        }
+
+        if (m_pendingEntries.contains(contactId)) {
+            qDebug() << __PRETTY_FUNCTION__ << " Contact " << contactId << " is already pending, line " << m_lineNumber;
+            m_failedCount++;
+            continue;
+        }
+
+        m_pendingEntries.insert(contactId, entry);
+        m_submittedCount++;
+        m_downloadManager->addUrl(url, contactId);
+    }
+
+    checkProgress();
+}
+
+bool ManifestLoader::parseLine(const QByteArray &line, QString &url, int &contactId, Entry &entry)
+{
+    QList<QByteArray> fields = line.simplified().split(' ');
+    if (fields.count() < 2 || fields.count() > 5)
+        return false;
+
+    url = QString::fromUtf8(fields.at(0));
+
+    bool ok = false;
+    contactId = fields.at(1).toInt(&ok);
+    if (!ok || contactId < 0)
+        return false;
+
+    entry.size = -1;
+    entry.algorithm = QCryptographicHash::Sha1;
+    entry.priority = 0;
+
+    if (fields.count() > 2 && fields.at(2) != "-") {
+        entry.size = fields.at(2).toLongLong(&ok);
+        if (!ok || entry.size < 0)
+            return false;
+    }
+
+    if (fields.count() > 3 && fields.at(3) != "-") {
+        QByteArray digest = fields.at(3).toLower();
+        if (digest.startsWith("sha1:")) {
+            digest = digest.mid(5);
+        } else if (digest.startsWith("md5:")) {
+            digest = digest.mid(4);
+            entry.algorithm = QCryptographicHash::Md5;
+        } else if (digest.size() == 32) {
+            entry.algorithm = QCryptographicHash::Md5;
+        }
+
+        int expectedSize = (entry.algorithm == QCryptographicHash::Md5) ? 32 : 40;
+        if (digest.size() != expectedSize)
+            return false;
+        entry.digest = digest;
+    }
+
+    if (fields.count() > 4 && fields.at(4) != "-") {
+        entry.priority = fields.at(4).toInt(&ok);
+        if (!ok)
+            return false;
+    }
+
+    return true;
+}
+
+bool ManifestLoader::verify(const QString &filePath, const Entry &entry)
+{
+    QFile file(filePath);
+    if (entry.size >= 0 && file.size() != entry.size) {
+        qDebug() << __PRETTY_FUNCTION__ << " Size mismatch " << filePath << ": " << file.size() << " != " << entry.size;
+        return false;
+    }
+
+    if (entry.digest.isEmpty())
+        return true;
+
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    QCryptographicHash hash(entry.algorithm);
+    while (!file.atEnd())
+        hash.addData(file.read(64*1024));
+
+    if (hash.result().toHex() != entry.digest) {
+        qDebug() << __PRETTY_FUNCTION__ << " Digest mismatch " << filePath;
+        return false;
+    }
+
+    return true;
+}
+
+void ManifestLoader::onDownloadStatusChanged(int contactId, int downloadId, int downloadStatus)
+{
+    Q_UNUSED(downloadStatus);
+
+    // Errors only carry the download id
+    if (m_pendingEntries.contains(contactId))
+        m_downloadContacts.insert(downloadId, contactId);
+}
+
+void ManifestLoader::onDownloadFinished(int contactId, int downloadId, const QString &filePath, int urlType)
+{
+    Q_UNUSED(urlType);
+
+    m_downloadContacts.remove(downloadId);
+    if (!m_pendingEntries.contains(contactId))
+        return;
+
+    // The entry stays pending until its file is verified
+    m_verifyPool.start(new ManifestVerifyJob(this, contactId, filePath, m_pendingEntries.value(contactId)));
+}
+
+void ManifestLoader::slotVerified(int contactId, bool verified, qint64 size)
+{
+    if (!m_pendingEntries.contains(contactId))
+        return;
+
+    if (verified)
+        m_bytesDownloaded += size;
+    else
+        m_verifyFailedCount++;
+
+    completeEntry(contactId, verified);
+}
+
+void ManifestLoader::onDownloadError(int downloadId, int errorCode)
+{
+    if (!m_downloadContacts.contains(downloadId))
+        return;
+
+    int contactId = m_downloadContacts.take(downloadId);
+    qDebug() << __PRETTY_FUNCTION__ << " Download failed, contactId = " << contactId << ", errorCode = " << errorCode;
+    completeEntry(contactId, false);
+}
+
+void ManifestLoader::onContactDownloadError(int contactId, int errorCode)
+{
+    if (!m_pendingEntries.contains(contactId))
+        return;
+
+    qDebug() << __PRETTY_FUNCTION__ << " Download rejected, contactId = " << contactId << ", errorCode = " << errorCode;
+    completeEntry(contactId, false);
+}
+
+void ManifestLoader::completeEntry(int contactId, bool succeeded)
+{
+    m_pendingEntries.remove(contactId);
+    if (succeeded)
+        m_finishedCount++;
+    else
+        m_failedCount++;
+
+    checkProgress();
+}
+
+void ManifestLoader::checkProgress()
+{
+    if (m_reading) {
+        if (!m_readScheduled && m_pendingEntries.count() <= MANIFEST_LOW_WATERMARK) {
+            m_readScheduled = true;
+            QTimer::singleShot(0, this, SLOT(slotReadMore()));
+        }
+        return;
+    }
+
+    if (m_pendingEntries.isEmpty()) {
+        qDebug() << __PRETTY_FUNCTION__ << getSummary();
+        emit finished();
+    }
+}
+
+QString ManifestLoader::getSummary() const
+{
+    qint64 elapsed = qMax(m_elapsedTimer.elapsed(), (qint64)1);
+    double throughput = m_bytesDownloaded*1000.0/elapsed;
+
+    return QString("Manifest: %1 submitted, %2 finished, %3 failed (%4 verify failures), %5 malformed lines, "
+                   "%6 bytes in %7 s, %8 KB/s")
+            .arg(m_submittedCount).arg(m_finishedCount).arg(m_failedCount).arg(m_verifyFailedCount)
+            .arg(m_malformedCount).arg(m_bytesDownloaded).arg(elapsed/1000.0, 0, 'f', 1)
+            .arg(throughput/1024.0, 0, 'f', 1);
+}
+
+ManifestLoader::~ManifestLoader()
+{
+    // The results posted meanwhile are dropped with the loader
+    m_verifyPool.waitForDone();
+
+    if (m_manifest.isOpen())
+        m_manifest.close();
+}
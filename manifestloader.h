@@ -0,0 +1,125 @@
+/*!
+ * \file manifestloader.h
+ * \brief batch download of the files listed in a manifest
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#ifndef MANIFESTLOADER_H
+#define MANIFESTLOADER_H
+
+#include <QObject>
+#include <QFile>
+#include <QHash>
+#include <QElapsedTimer>
+#include <QCryptographicHash>
+#include <QThreadPool>
+#include "common.h"
+
+class DownloadManager;
+
+/*!
+ * \brief Streams a manifest into the download manager.
+ *
+ * One download per line: url contactId [size] [digest] [priority], fields are
+ * separated by white spaces, "-" skips an optional field, empty lines and
+ * lines starting with # are ignored. The digest is the hex SHA-1 or MD5 of the
+ * file, optionally prefixed by "sha1:" or "md5:".
+ *
+ * The manifest is read a few lines at a time: reading stops when
+ * MANIFEST_HIGH_WATERMARK downloads are pending and goes on once they drop to
+ * MANIFEST_LOW_WATERMARK, so only the pending entries are kept in memory.
+ * The finished files are verified in a thread pool, the control protocol and
+ * the manager calls sharing the thread of the loader are not held by hashing.
+ */
+class ManifestLoader : public QObject
+{
+    Q_OBJECT
+public:
+    explicit ManifestLoader(DownloadManager *downloadManager, QObject *parent = 0);
+    ~ManifestLoader();
+
+    /*!
+     * \brief Start loading a manifest
+     * \param manifestPath: full path of the manifest
+     * \returns true if the manifest could be opened, otherwise returns false
+     */
+    bool start(const QString &manifestPath);
+
+    /*!
+     * \brief Get the summary of the batch: counters, bytes and throughput
+     */
+    QString getSummary() const;
+
+signals:
+    /*!
+     * \brief emitted when every entry of the manifest finished or failed
+     */
+    void finished();
+
+protected slots:
+    // Submit the next lines of the manifest
+    void slotReadMore();
+
+    void onDownloadStatusChanged(int contactId, int downloadId, int downloadStatus);
+
+    void onDownloadFinished(int contactId, int downloadId, const QString &filePath, int urlType);
+
+    void onDownloadError(int downloadId, int errorCode);
+
+    void onContactDownloadError(int contactId, int errorCode);
+
+    // Slot when a finished file has been verified
+    void slotVerified(int contactId, bool verified, qint64 size);
+
+protected:
+    friend class ManifestVerifyJob;
+
+    struct Entry
+    {
+        qint64 size; // expected size, -1 if not given
+        QByteArray digest; // expected hex digest, empty if not given
+        QCryptographicHash::Algorithm algorithm;
+        int priority; // parsed for the manifest format, not used by the scheduler yet
+    };
+
+    // Parse one line, returns false if it is malformed
+    bool parseLine(const QByteArray &line, QString &url, int &contactId, Entry &entry);
+
+    // Check the size and the digest of a downloaded file, called in the verify threads
+    static bool verify(const QString &filePath, const Entry &entry);
+
+    // Account for the end of an entry
+    void completeEntry(int contactId, bool succeeded);
+
+    // Read more lines if below the low watermark, emit finished() at the end
+    void checkProgress();
+
+private:
+    DownloadManager *m_downloadManager;
+
+    QFile m_manifest;
+    bool m_reading; // false once the end of the manifest is reached
+    bool m_readScheduled;
+    int m_lineNumber;
+
+    QHash<int, Entry> m_pendingEntries; // pending entries by contact id
+    QHash<int, int> m_downloadContacts; // contact id of the pending downloads
+
+    int m_submittedCount;
+    int m_finishedCount;
+    int m_failedCount;
+    int m_malformedCount;
+    int m_verifyFailedCount;
+    qint64 m_bytesDownloaded;
+
+    QElapsedTimer m_elapsedTimer;
+
+    QThreadPool m_verifyPool; // threads hashing the finished files
+};
+
+#endif // MANIFESTLOADER_H
@@ -0,0 +1,120 @@
+/*!
+ * \file mediatyperegistry.cpp
+ * \brief supported media types and their download policies
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#include "mediatyperegistry.h"
+#include <QSettings>
+#include <QStringList>
+#include <QFile>
+#include <QDebug>
+
+// Ini group of each UrlType, by getTypeIndex()
+static const char *TYPE_GROUPS[MediaTypeRegistry::TypeCount] = { "Unknown", "Application", "Music", "Video", "Playlist" };
+
+MediaTypePolicy::MediaTypePolicy()
+{
+    priority = 0;
+    maxConcurrentDownloads = 0;
+    streaming = false;
+    hashContent = true;
+}
+
+MediaTypeRegistry::MediaTypeRegistry()
+{
+    loadDefaults();
+}
+
+int MediaTypeRegistry::getTypeIndex(int urlType)
+{
+    if (urlType < DownloadManager::Application || urlType > DownloadManager::Playlist)
+        return 0;
+
+    return urlType + 1;
+}
+
+void MediaTypeRegistry::loadDefaults()
+{
+    m_classifier = UrlTypeClassifier();
+    m_classifier.addExtension(".mp3", DownloadManager::Music);
+    m_classifier.addExtension(".ogg", DownloadManager::Music);
+    m_classifier.addExtension(".avi", DownloadManager::Video);
+    m_classifier.addExtension(".ogv", DownloadManager::Video);
+    m_classifier.addExtension(".wgt", DownloadManager::Application);
+    m_classifier.addExtension(".pls", DownloadManager::Playlist);
+
+    for (int i = 0; i < TypeCount; i++)
+        m_policies[i] = MediaTypePolicy();
+
+    // Media can be played while it is downloaded
+    m_policies[getTypeIndex(DownloadManager::Music)].streaming = true;
+    m_policies[getTypeIndex(DownloadManager::Video)].streaming = true;
+}
+
+bool MediaTypeRegistry::load(const QString &filePath)
+{
+    if (!QFile::exists(filePath)) {
+        qDebug() << __PRETTY_FUNCTION__ << " Could not find " << filePath;
+        return false;
+    }
+
+    QSettings settings(filePath, QSettings::IniFormat);
+    QStringList groups = settings.childGroups();
+    if (settings.status() != QSettings::NoError) {
+        qDebug() << __PRETTY_FUNCTION__ << " Could not parse " << filePath;
+        return false;
+    }
+
+    // Built aside, a bad file leaves the current types in place
+    UrlTypeClassifier classifier;
+    MediaTypePolicy policies[TypeCount];
+
+    for (int i = 0; i < groups.count(); i++) {
+        int index = -1;
+        for (int j = 0; j < TypeCount; j++) {
+            if (groups.at(i).compare(TYPE_GROUPS[j], Qt::CaseInsensitive) == 0)
+                index = j;
+        }
+        if (index < 0) {
+            qDebug() << __PRETTY_FUNCTION__ << " Unknown type " << groups.at(i);
+            return false;
+        }
+
+        settings.beginGroup(groups.at(i));
+        MediaTypePolicy &policy = policies[index];
+        policy.priority = settings.value("priority", policy.priority).toInt();
+        policy.maxConcurrentDownloads = qMax(0, settings.value("maxConcurrent", policy.maxConcurrentDownloads).toInt());
+        policy.streaming = settings.value("stream", policy.streaming).toBool();
+        policy.hashContent = settings.value("hash", policy.hashContent).toBool();
+
+        // Downloads of unknown type have no extension to register
+        QStringList extensions = settings.value("extensions").toStringList();
+        for (int j = 0; j < extensions.count() && index > 0; j++) {
+            if (!classifier.addExtension(extensions.at(j).trimmed(), (DownloadManager::UrlType)(index - 1)))
+                qDebug() << __PRETTY_FUNCTION__ << " Skipped extension " << extensions.at(j);
+        }
+        settings.endGroup();
+    }
+
+    m_classifier = classifier;
+    for (int i = 0; i < TypeCount; i++)
+        m_policies[i] = policies[i];
+
+    return true;
+}
+
+DownloadManager::UrlType MediaTypeRegistry::classify(const QString &url) const
+{
+    return m_classifier.classify(url);
+}
+
+const MediaTypePolicy &MediaTypeRegistry::getPolicy(int urlType) const
+{
+    return m_policies[getTypeIndex(urlType)];
+}
@@ -0,0 +1,93 @@
+/*!
+ * \file mediatyperegistry.h
+ * \brief supported media types and their download policies
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#ifndef MEDIATYPEREGISTRY_H
+#define MEDIATYPEREGISTRY_H
+
+#include <QString>
+#include "downloadmanager.h"
+#include "urltypeclassifier.h"
+
+/*!
+ * \brief How the downloads of one type are scheduled and stored
+ */
+struct MediaTypePolicy
+{
+    MediaTypePolicy();
+
+    int priority; // queued downloads of a higher priority start first
+    int maxConcurrentDownloads; // max number of running downloads of the type, 0 for no limit of its own
+    bool streaming; // fetched in playback order when the streaming mode is enabled
+    bool hashContent; // finished files are deduplicated in the content store
+};
+
+/*!
+ * \brief Supported extensions and policies of every UrlType.
+ *
+ * The registry starts with the built-in types and can be replaced at startup
+ * by an ini file with one group per type:
+ *
+ *     [Music]
+ *     extensions=mp3, ogg
+ *     priority=1
+ *     maxConcurrent=2
+ *     stream=true
+ *     hash=true
+ *
+ * The group names are the names of UrlType, missing keys keep the defaults
+ * of MediaTypePolicy. Once loaded the registry is only read, so classifying
+ * an url or reading a policy needs no lock.
+ */
+class MediaTypeRegistry
+{
+public:
+    MediaTypeRegistry();
+
+    /*!
+     * \brief Replace the types by the ones of an ini file
+     * \param filePath: full path of the file
+     * \returns true if the file was loaded, otherwise the registry is left unchanged
+     * \note not thread safe, load the file before the registry is shared between threads
+     */
+    bool load(const QString &filePath);
+
+    /*!
+     * \brief Get the type of an url by its extension
+     * \param url: the url, may have a query string and a fragment
+     * \returns UnknownType if the extension is not registered
+     */
+    DownloadManager::UrlType classify(const QString &url) const;
+
+    /*!
+     * \brief Get the policy of a type
+     * \param urlType: a UrlType value, UnknownType gives the policy of the downloads not classified yet
+     */
+    const MediaTypePolicy &getPolicy(int urlType) const;
+
+    enum {
+        TypeCount = 5 // UrlType values, UnknownType included
+    };
+
+    /*!
+     * \brief Get a dense index of a type, from 0 to TypeCount - 1
+     */
+    static int getTypeIndex(int urlType);
+
+protected:
+    // Register the built-in types
+    void loadDefaults();
+
+private:
+    UrlTypeClassifier m_classifier;
+    MediaTypePolicy m_policies[TypeCount]; // by getTypeIndex()
+};
+
+#endif // MEDIATYPEREGISTRY_H
@@ -0,0 +1,212 @@
+/*!
+ * \file metricsregistry.cpp
+ * \brief process wide metrics with prometheus text exposition
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#include "metricsregistry.h"
+#include <QFile>
+#include <QDebug>
+#include <cstdio>
+
+MetricsRegistry::Series::Series()
+{
+    value = 0;
+    sum = 0;
+    count = 0;
+}
+
+MetricsRegistry::MetricsRegistry()
+{
+    registerDownloadMetrics();
+}
+
+MetricsRegistry *MetricsRegistry::instance()
+{
+    static MetricsRegistry registry;
+    return &registry;
+}
+
+void MetricsRegistry::registerDownloadMetrics()
+{
+    registerMetric(METRIC_BYTES_DOWNLOADED, Counter, "Bytes written to downloaded files");
+    registerMetric(METRIC_WIRE_BYTES, Counter, "Bytes received from the network, before content decoding");
+    registerMetric(METRIC_CACHE_REVALIDATED, Counter, "Downloads answered by 304 Not Modified and served from the cached copy");
+    registerMetric(METRIC_DOWNLOADS_COALESCED, Counter, "Downloads served by the transfer of another download of the same url");
+    registerMetric(METRIC_DOWNLOADS_STARTED, Counter, "Download attempts started");
+    registerMetric(METRIC_DOWNLOADS_FINISHED, Counter, "Downloads finished successfully");
+    registerMetric(METRIC_DOWNLOADS_FAILED, Counter, "Downloads failed, by DownloadErrorCode");
+    registerMetric(METRIC_DOWNLOAD_RETRIES, Counter, "Download retries scheduled after a transient error");
+    registerMetric(METRIC_QUEUE_LENGTH, Gauge, "Downloads waiting in the queue");
+    registerMetric(METRIC_ACTIVE_DOWNLOADS, Gauge, "Downloads running");
+    registerMetric(METRIC_RETRYING_DOWNLOADS, Gauge, "Downloads waiting for a retry");
+    registerMetric(METRIC_BUFFERED_BYTES, Gauge, "Bytes received but not written to file yet");
+
+    QList<double> latencyBuckets;
+    latencyBuckets << 0.05 << 0.1 << 0.25 << 0.5 << 1 << 2.5 << 5 << 10 << 30;
+    registerMetric(METRIC_TIME_TO_FIRST_BYTE, Histogram, "Time from the start of a download attempt to its first byte", latencyBuckets);
+
+    QList<double> durationBuckets;
+    durationBuckets << 1 << 5 << 15 << 30 << 60 << 300 << 900 << 3600;
+    registerMetric(METRIC_DOWNLOAD_DURATION, Histogram, "Duration of the successful download attempts", durationBuckets);
+
+    QList<double> throughputBuckets;
+    throughputBuckets << 16*1024 << 64*1024 << 256*1024 << 1024*1024 << 4*1024*1024 << 16*1024*1024 << 64*1024*1024;
+    registerMetric(METRIC_DOWNLOAD_THROUGHPUT, Histogram, "Average throughput of the successful download attempts", throughputBuckets);
+}
+
+void MetricsRegistry::registerMetric(const QString &name, MetricType type, const QString &help, const QList<double> &buckets)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_families.contains(name))
+        return;
+
+    Family family;
+    family.type = type;
+    family.help = help;
+    family.buckets = buckets;
+    m_families.insert(name, family);
+}
+
+MetricsRegistry::Series *MetricsRegistry::getSeries(const QString &name, MetricType type, const QString &labels)
+{
+    QMap<QString, Family>::iterator family = m_families.find(name);
+    if (family == m_families.end() || family.value().type != type)
+        return 0;
+
+    QMap<QString, Series>::iterator series = family.value().series.find(labels);
+    if (series == family.value().series.end()) {
+        Series newSeries;
+        if (type == Histogram)
+            newSeries.bucketCounts.fill(0, family.value().buckets.count());
+        series = family.value().series.insert(labels, newSeries);
+    }
+
+    return &series.value();
+}
+
+void MetricsRegistry::increment(const QString &name, qint64 value, const QString &labels)
+{
+    QMutexLocker locker(&m_mutex);
+    Series *series = getSeries(name, Counter, labels);
+    if (series)
+        series->value += value;
+}
+
+void MetricsRegistry::setGauge(const QString &name, qint64 value, const QString &labels)
+{
+    QMutexLocker locker(&m_mutex);
+    Series *series = getSeries(name, Gauge, labels);
+    if (series)
+        series->value = value;
+}
+
+void MetricsRegistry::addGauge(const QString &name, qint64 delta, const QString &labels)
+{
+    QMutexLocker locker(&m_mutex);
+    Series *series = getSeries(name, Gauge, labels);
+    if (series)
+        series->value += delta;
+}
+
+void MetricsRegistry::observe(const QString &name, double value, const QString &labels)
+{
+    QMutexLocker locker(&m_mutex);
+    Series *series = getSeries(name, Histogram, labels);
+    if (series == 0)
+        return;
+
+    const QList<double> &buckets = m_families[name].buckets;
+    for (int i = 0; i < buckets.count(); i++) {
+        if (value <= buckets.at(i)) {
+            series->bucketCounts[i]++;
+            break;
+        }
+    }
+    series->sum += value;
+    series->count++;
+}
+
+// Format an exported value, 17 significant digits round trip any double, the default 6 round byte counts
+static QByteArray formatValue(double value)
+{
+    return QByteArray::number(value, 'g', 17);
+}
+
+QByteArray MetricsRegistry::exportText()
+{
+    QMutexLocker locker(&m_mutex);
+
+    QByteArray text;
+    QMap<QString, Family>::const_iterator family;
+    for (family = m_families.constBegin(); family != m_families.constEnd(); ++family) {
+        QByteArray name = family.key().toAscii();
+        const char *type = "counter";
+        if (family.value().type == Gauge)
+            type = "gauge";
+        else if (family.value().type == Histogram)
+            type = "histogram";
+
+        text += "# HELP " + name + " " + family.value().help.toUtf8() + "\n";
+        text += "# TYPE " + name + " " + type + "\n";
+
+        // Series without labels are exported even before the first update
+        QMap<QString, Series> seriesMap = family.value().series;
+        if (seriesMap.isEmpty()) {
+            Series empty;
+            if (family.value().type == Histogram)
+                empty.bucketCounts.fill(0, family.value().buckets.count());
+            seriesMap.insert(QString(), empty);
+        }
+
+        QMap<QString, Series>::const_iterator series;
+        for (series = seriesMap.constBegin(); series != seriesMap.constEnd(); ++series) {
+            QByteArray labels = series.key().toUtf8();
+            const Series &s = series.value();
+
+            if (family.value().type != Histogram) {
+                QByteArray labelSet = labels.isEmpty() ? QByteArray() : "{" + labels + "}";
+                text += name + labelSet + " " + formatValue(s.value) + "\n";
+                continue;
+            }
+
+            QByteArray prefix = labels.isEmpty() ? QByteArray("{") : "{" + labels + ",";
+            quint64 cumulative = 0;
+            const QList<double> &buckets = family.value().buckets;
+            for (int i = 0; i < buckets.count(); i++) {
+                cumulative += s.bucketCounts.at(i);
+                text += name + "_bucket" + prefix + "le=\"" + formatValue(buckets.at(i)) + "\"} "
+                        + QByteArray::number(cumulative) + "\n";
+            }
+            text += name + "_bucket" + prefix + "le=\"+Inf\"} " + QByteArray::number(s.count) + "\n";
+
+            QByteArray labelSet = labels.isEmpty() ? QByteArray() : "{" + labels + "}";
+            text += name + "_sum" + labelSet + " " + formatValue(s.sum) + "\n";
+            text += name + "_count" + labelSet + " " + QByteArray::number(s.count) + "\n";
+        }
+    }
+
+    return text;
+}
+
+bool MetricsRegistry::exportToFile(const QString &filePath)
+{
+    QByteArray text = exportText();
+
+    // Scrapers must never read a half written file
+    QString tempFilePath = filePath + ".tmp";
+    QFile file(tempFilePath);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qDebug() << __PRETTY_FUNCTION__ << " Could not write " << tempFilePath;
+        return false;
+    }
+    file.write(text);
+    file.close();
+
+    return std::rename(QFile::encodeName(tempFilePath).constData(), QFile::encodeName(filePath).constData()) == 0;
+}
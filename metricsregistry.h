@@ -0,0 +1,135 @@
+/*!
+ * \file metricsregistry.h
+ * \brief process wide metrics with prometheus text exposition
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#ifndef METRICSREGISTRY_H
+#define METRICSREGISTRY_H
+
+#include <QString>
+#include <QList>
+#include <QMap>
+#include <QVector>
+#include <QMutex>
+#include <QByteArray>
+
+const QString METRIC_BYTES_DOWNLOADED = "downloadmanager_bytes_downloaded_total";
+const QString METRIC_WIRE_BYTES = "downloadmanager_wire_bytes_total";
+const QString METRIC_CACHE_REVALIDATED = "downloadmanager_cache_revalidated_total";
+const QString METRIC_DOWNLOADS_COALESCED = "downloadmanager_downloads_coalesced_total";
+const QString METRIC_DOWNLOADS_STARTED = "downloadmanager_downloads_started_total";
+const QString METRIC_DOWNLOADS_FINISHED = "downloadmanager_downloads_finished_total";
+const QString METRIC_DOWNLOADS_FAILED = "downloadmanager_downloads_failed_total";
+const QString METRIC_DOWNLOAD_RETRIES = "downloadmanager_download_retries_total";
+const QString METRIC_QUEUE_LENGTH = "downloadmanager_queue_length";
+const QString METRIC_ACTIVE_DOWNLOADS = "downloadmanager_active_downloads";
+const QString METRIC_RETRYING_DOWNLOADS = "downloadmanager_retrying_downloads";
+const QString METRIC_BUFFERED_BYTES = "downloadmanager_buffered_bytes";
+const QString METRIC_TIME_TO_FIRST_BYTE = "downloadmanager_time_to_first_byte_seconds";
+const QString METRIC_DOWNLOAD_DURATION = "downloadmanager_download_duration_seconds";
+const QString METRIC_DOWNLOAD_THROUGHPUT = "downloadmanager_download_throughput_bytes_per_second";
+
+/*!
+ * \brief Counters, gauges and histograms shared by every thread.
+ *
+ * Metrics are registered once by name, then updated from any thread; label
+ * sets are passed preformatted, e.g. code="4". Updates of a name which is not
+ * registered are ignored.
+ */
+class MetricsRegistry
+{
+public:
+
+    enum MetricType {
+        Counter,
+        Gauge,
+        Histogram
+    };
+
+    /*!
+     * \brief Get the registry of the process, the download metrics are already registered
+     */
+    static MetricsRegistry *instance();
+
+    /*!
+     * \brief Register a metric
+     * \param name: name of the metric
+     * \param type: type of the metric
+     * \param help: description exported with the metric
+     * \param buckets: sorted upper bounds of the buckets of a histogram
+     */
+    void registerMetric(const QString &name, MetricType type, const QString &help,
+                        const QList<double> &buckets = QList<double>());
+
+    /*!
+     * \brief Add to a counter
+     */
+    void increment(const QString &name, qint64 value = 1, const QString &labels = QString());
+
+    /*!
+     * \brief Set the value of a gauge
+     */
+    void setGauge(const QString &name, qint64 value, const QString &labels = QString());
+
+    /*!
+     * \brief Add a delta to a gauge
+     */
+    void addGauge(const QString &name, qint64 delta, const QString &labels = QString());
+
+    /*!
+     * \brief Add an observation to a histogram
+     */
+    void observe(const QString &name, double value, const QString &labels = QString());
+
+    /*!
+     * \brief Get every metric in the prometheus text exposition format
+     */
+    QByteArray exportText();
+
+    /*!
+     * \brief Write the metrics to a file, replacing it atomically
+     * \param filePath: full path of the file
+     * \returns true if the file was written, otherwise returns false
+     */
+    bool exportToFile(const QString &filePath);
+
+protected:
+    MetricsRegistry();
+
+    struct Series
+    {
+        Series();
+
+        qint64 value; // value of a counter or a gauge
+        QVector<quint64> bucketCounts; // observations per bucket of a histogram, not cumulative
+        double sum;
+        quint64 count;
+    };
+
+    struct Family
+    {
+        MetricType type;
+        QString help;
+        QList<double> buckets;
+        QMap<QString, Series> series; // by label set
+    };
+
+    // Get the series of a metric, 0 if the metric is not registered with this type
+    Series *getSeries(const QString &name, MetricType type, const QString &labels);
+
+    // Register the metrics of the download manager
+    void registerDownloadMetrics();
+
+private:
+    QMap<QString, Family> m_families; // sorted by name for a stable output
+
+    QMutex m_mutex; // mutex locker for synchronization
+};
+
+#endif // METRICSREGISTRY_H
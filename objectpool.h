@@ -0,0 +1,114 @@
+/*!
+ * \file objectpool.h
+ * \brief pool of reusable objects
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#ifndef OBJECTPOOL_H
+#define OBJECTPOOL_H
+
+#include <QVector>
+#include <QtAlgorithms>
+
+/*!
+ * \brief Keeps up to capacity released objects to hand them out again.
+ *
+ * Objects are created with new when the pool is empty and deleted when it is
+ * full, the pool owns the objects it keeps. The owner resets an object before
+ * releasing it, the pool does not know its state.
+ * \note not thread safe, acquire and release from the thread owning the pool
+ */
+template <class T>
+class ObjectPool
+{
+public:
+    explicit ObjectPool(int capacity)
+    {
+        m_capacity = capacity;
+        m_createdCount = 0;
+        m_reusedCount = 0;
+    }
+
+    ~ObjectPool()
+    {
+        clear();
+    }
+
+    /*!
+     * \brief Get an object, a released one if there is any
+     */
+    T *acquire()
+    {
+        if (!m_freeObjects.isEmpty()) {
+            T *object = m_freeObjects.last();
+            m_freeObjects.remove(m_freeObjects.count() - 1);
+            m_reusedCount++;
+            return object;
+        }
+
+        T *object = new T();
+        Q_ASSERT(object != 0);
+        m_createdCount++;
+        return object;
+    }
+
+    /*!
+     * \brief Give an object back to the pool
+     * \param object: an object already reset, deleted if the pool is full
+     */
+    void release(T *object)
+    {
+        if (object == 0)
+            return;
+
+        if (m_freeObjects.count() >= m_capacity) {
+            delete object;
+            return;
+        }
+
+        m_freeObjects.append(object);
+    }
+
+    /*!
+     * \brief Delete the objects kept by the pool
+     */
+    void clear()
+    {
+        qDeleteAll(m_freeObjects);
+        m_freeObjects.clear();
+    }
+
+    /*!
+     * \brief Get the number of objects waiting in the pool
+     */
+    int count() const
+    {
+        return m_freeObjects.count();
+    }
+
+    /*!
+     * \brief Get the number of objects created and reused so far
+     */
+    int getCreatedCount() const
+    {
+        return m_createdCount;
+    }
+
+    int getReusedCount() const
+    {
+        return m_reusedCount;
+    }
+
+private:
+    QVector<T *> m_freeObjects; // released objects, the last one is reused first
+    int m_capacity; // max number of objects kept
+    int m_createdCount;
+    int m_reusedCount;
+};
+
+#endif // OBJECTPOOL_H
@@ -0,0 +1,76 @@
+/*!
+ * \file playlistparser.cpp
+ * \brief streaming parser of .pls playlists
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#include "playlistparser.h"
+#include "common.h"
+#include <QIODevice>
+#include <QUrl>
+#include <QDebug>
+
+PlaylistParser::PlaylistParser(QIODevice *device, const QString &baseUrl)
+{
+    m_device = device;
+    m_baseUrl = baseUrl;
+    m_skippedCount = 0;
+}
+
+bool PlaylistParser::readEntry(PlaylistEntry &entry)
+{
+    if (m_device == 0)
+        return false;
+
+    while (!m_device->atEnd()) {
+        QByteArray line = m_device->readLine(PLAYLIST_MAX_LINE_LENGTH);
+        if (line.isEmpty())
+            return false;
+
+        // The rest of an overlong line comes with the next reads, drop it
+        if (!line.endsWith('\n') && !m_device->atEnd()) {
+            while (!m_device->atEnd() && !line.endsWith('\n'))
+                line = m_device->readLine(PLAYLIST_MAX_LINE_LENGTH);
+            m_skippedCount++;
+            continue;
+        }
+
+        line = line.trimmed();
+        if (!line.toLower().startsWith("file"))
+            continue; // section header, TitleN, LengthN, NumberOfEntries, Version
+
+        // FileN=url
+        int separator = line.indexOf('=');
+        bool ok = false;
+        int index = (separator > 4) ? line.mid(4, separator - 4).toInt(&ok) : -1;
+        QString value = QString::fromUtf8(line.mid(separator + 1).trimmed());
+        if (!ok || value.isEmpty()) {
+            m_skippedCount++;
+            continue;
+        }
+
+        QUrl url = QUrl(m_baseUrl).resolved(QUrl(value));
+        QString scheme = url.scheme().toLower();
+        if (scheme != "http" && scheme != "https" && scheme != "ftp") {
+            qDebug() << __PRETTY_FUNCTION__ << " Skipped entry " << value;
+            m_skippedCount++;
+            continue;
+        }
+
+        entry.index = index;
+        entry.url = url.toString();
+        return true;
+    }
+
+    return false;
+}
+
+int PlaylistParser::getSkippedCount() const
+{
+    return m_skippedCount;
+}
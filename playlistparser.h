@@ -0,0 +1,63 @@
+/*!
+ * \file playlistparser.h
+ * \brief streaming parser of .pls playlists
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#ifndef PLAYLISTPARSER_H
+#define PLAYLISTPARSER_H
+
+#include <QString>
+
+class QIODevice;
+
+/*!
+ * \brief Entry of a playlist
+ */
+struct PlaylistEntry
+{
+    int index; // N of the FileN key
+    QString url; // absolute url of the entry
+};
+
+/*!
+ * \brief Read the entries of a .pls playlist one line at a time.
+ *
+ * Only the FileN keys are used, titles and lengths are not needed to download
+ * the entries. The playlist is never held in memory as a whole, so large
+ * playlists can be expanded while they are parsed. Relative entries are
+ * resolved against the url of the playlist.
+ */
+class PlaylistParser
+{
+public:
+    /*!
+     * \param device: the opened playlist, not owned
+     * \param baseUrl: url of the playlist
+     */
+    PlaylistParser(QIODevice *device, const QString &baseUrl);
+
+    /*!
+     * \brief Read the next entry
+     * \param entry: receives the entry
+     * \returns false at the end of the playlist
+     */
+    bool readEntry(PlaylistEntry &entry);
+
+    /*!
+     * \brief Get the number of lines skipped because they are not valid
+     */
+    int getSkippedCount() const;
+
+private:
+    QIODevice *m_device;
+    QString m_baseUrl;
+    int m_skippedCount;
+};
+
+#endif // PLAYLISTPARSER_H
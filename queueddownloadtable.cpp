@@ -0,0 +1,274 @@
+/*!
+ * \file queueddownloadtable.cpp
+ * \brief compact table of the downloads waiting in the queue
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#include "queueddownloadtable.h"
+
+QueuedDownload::QueuedDownload()
+{
+    downloadId = -1;
+    contactId = -1;
+    parentId = -1;
+    urlType = DownloadManager::UnknownType;
+    queuedTime = -1;
+}
+
+QueuedDownloadTable::QueuedDownloadTable()
+{
+    for (int i = 0; i < MediaTypeRegistry::TypeCount; i++) {
+        m_heads[i] = -1;
+        m_tails[i] = -1;
+    }
+
+    m_freeRow = -1;
+    m_count = 0;
+    m_nextSequence = 0;
+}
+
+int QueuedDownloadTable::internUrl(const QString &url)
+{
+    QHash<QString, int>::const_iterator it = m_urlIdsByUrl.constFind(url);
+    if (it != m_urlIdsByUrl.constEnd()) {
+        m_urlReferences[it.value()]++;
+        return it.value();
+    }
+
+    int urlId;
+    if (m_freeUrlIds.isEmpty()) {
+        urlId = m_urls.count();
+        m_urls.append(url);
+        m_urlReferences.append(1);
+    } else {
+        urlId = m_freeUrlIds.last();
+        m_freeUrlIds.remove(m_freeUrlIds.count() - 1);
+        m_urls[urlId] = url;
+        m_urlReferences[urlId] = 1;
+    }
+
+    // The pool and the index share the data of the string
+    m_urlIdsByUrl.insert(m_urls.at(urlId), urlId);
+    return urlId;
+}
+
+void QueuedDownloadTable::releaseUrl(int urlId)
+{
+    if (--m_urlReferences[urlId] > 0)
+        return;
+
+    m_urlIdsByUrl.remove(m_urls.at(urlId));
+    m_urls[urlId] = QString();
+    m_freeUrlIds.append(urlId);
+}
+
+int QueuedDownloadTable::allocateRow()
+{
+    if (m_freeRow >= 0) {
+        int row = m_freeRow;
+        m_freeRow = m_next.at(row);
+        return row;
+    }
+
+    int row = m_downloadIds.count();
+    m_downloadIds.append(-1);
+    m_contactIds.append(-1);
+    m_parentIds.append(-1);
+    m_urlIds.append(-1);
+    m_sequences.append(0);
+    m_queuedTimes.append(-1);
+    m_prev.append(-1);
+    m_next.append(-1);
+    m_urlTypes.append((qint8)DownloadManager::UnknownType);
+    return row;
+}
+
+int QueuedDownloadTable::append(const QueuedDownload &entry)
+{
+    if (entry.urls.isEmpty())
+        return -1;
+
+    int row = allocateRow();
+    m_downloadIds[row] = entry.downloadId;
+    m_contactIds[row] = entry.contactId;
+    m_parentIds[row] = entry.parentId;
+    m_urlIds[row] = internUrl(entry.urls.first());
+    m_sequences[row] = m_nextSequence++;
+    m_queuedTimes[row] = entry.queuedTime;
+    m_urlTypes[row] = (qint8)entry.urlType;
+    if (entry.urls.count() > 1)
+        m_mirrorUrls.insert(row, entry.urls);
+
+    // Link at the end of the list of the type
+    int typeIndex = MediaTypeRegistry::getTypeIndex(entry.urlType);
+    m_prev[row] = m_tails[typeIndex];
+    m_next[row] = -1;
+    if (m_tails[typeIndex] >= 0)
+        m_next[m_tails[typeIndex]] = row;
+    else
+        m_heads[typeIndex] = row;
+    m_tails[typeIndex] = row;
+
+    m_downloadRows.insert(entry.downloadId, row);
+    m_contactRows.insert(entry.contactId, row);
+    m_count++;
+
+    return row;
+}
+
+void QueuedDownloadTable::unlink(int row)
+{
+    int typeIndex = MediaTypeRegistry::getTypeIndex((int)m_urlTypes.at(row));
+    int prev = m_prev.at(row);
+    int next = m_next.at(row);
+
+    if (prev >= 0)
+        m_next[prev] = next;
+    else
+        m_heads[typeIndex] = next;
+
+    if (next >= 0)
+        m_prev[next] = prev;
+    else
+        m_tails[typeIndex] = prev;
+}
+
+bool QueuedDownloadTable::take(int row, QueuedDownload &entry)
+{
+    if (!getEntry(row, entry))
+        return false;
+
+    unlink(row);
+    m_downloadRows.remove(entry.downloadId);
+    m_contactRows.remove(entry.contactId, row);
+    m_mirrorUrls.remove(row);
+    releaseUrl(m_urlIds.at(row));
+
+    m_downloadIds[row] = -1;
+    m_urlIds[row] = -1;
+    m_prev[row] = -1;
+    m_next[row] = m_freeRow;
+    m_freeRow = row;
+    m_count--;
+
+    return true;
+}
+
+int QueuedDownloadTable::getFirstRow(int typeIndex) const
+{
+    if (typeIndex < 0 || typeIndex >= MediaTypeRegistry::TypeCount)
+        return -1;
+
+    return m_heads[typeIndex];
+}
+
+bool QueuedDownloadTable::isQueuedBefore(int row, int otherRow) const
+{
+    // The difference stays right when the counter wraps around
+    return (int)(m_sequences.at(row) - m_sequences.at(otherRow)) < 0;
+}
+
+int QueuedDownloadTable::findByDownloadId(int downloadId) const
+{
+    return m_downloadRows.value(downloadId, -1);
+}
+
+int QueuedDownloadTable::findByContactId(int contactId) const
+{
+    return m_contactRows.value(contactId, -1);
+}
+
+bool QueuedDownloadTable::getEntry(int row, QueuedDownload &entry) const
+{
+    if (!isUsed(row))
+        return false;
+
+    entry.downloadId = m_downloadIds.at(row);
+    entry.contactId = m_contactIds.at(row);
+    entry.parentId = m_parentIds.at(row);
+    entry.urlType = (DownloadManager::UrlType)m_urlTypes.at(row);
+    entry.queuedTime = m_queuedTimes.at(row);
+
+    QHash<int, QStringList>::const_iterator it = m_mirrorUrls.constFind(row);
+    if (it != m_mirrorUrls.constEnd())
+        entry.urls = it.value();
+    else
+        entry.urls = QStringList() << m_urls.at(m_urlIds.at(row));
+
+    return true;
+}
+
+int QueuedDownloadTable::getDownloadId(int row) const
+{
+    return isUsed(row) ? m_downloadIds.at(row) : -1;
+}
+
+int QueuedDownloadTable::getContactId(int row) const
+{
+    return isUsed(row) ? m_contactIds.at(row) : -1;
+}
+
+DownloadManager::UrlType QueuedDownloadTable::getUrlType(int row) const
+{
+    return isUsed(row) ? (DownloadManager::UrlType)m_urlTypes.at(row) : DownloadManager::UnknownType;
+}
+
+qint64 QueuedDownloadTable::getQueuedTime(int row) const
+{
+    return isUsed(row) ? m_queuedTimes.at(row) : -1;
+}
+
+int QueuedDownloadTable::getRowCount() const
+{
+    return m_downloadIds.count();
+}
+
+bool QueuedDownloadTable::isUsed(int row) const
+{
+    return row >= 0 && row < m_downloadIds.count() && m_urlIds.at(row) >= 0;
+}
+
+int QueuedDownloadTable::count() const
+{
+    return m_count;
+}
+
+bool QueuedDownloadTable::isEmpty() const
+{
+    return m_count == 0;
+}
+
+void QueuedDownloadTable::clear()
+{
+    m_downloadIds.clear();
+    m_contactIds.clear();
+    m_parentIds.clear();
+    m_urlIds.clear();
+    m_sequences.clear();
+    m_queuedTimes.clear();
+    m_prev.clear();
+    m_next.clear();
+    m_urlTypes.clear();
+    m_mirrorUrls.clear();
+
+    for (int i = 0; i < MediaTypeRegistry::TypeCount; i++) {
+        m_heads[i] = -1;
+        m_tails[i] = -1;
+    }
+
+    m_freeRow = -1;
+    m_count = 0;
+
+    m_downloadRows.clear();
+    m_contactRows.clear();
+
+    m_urls.clear();
+    m_urlReferences.clear();
+    m_freeUrlIds.clear();
+    m_urlIdsByUrl.clear();
+}
@@ -0,0 +1,172 @@
+/*!
+ * \file queueddownloadtable.h
+ * \brief compact table of the downloads waiting in the queue
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#ifndef QUEUEDDOWNLOADTABLE_H
+#define QUEUEDDOWNLOADTABLE_H
+
+#include <QVector>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include "downloadmanager.h"
+#include "mediatyperegistry.h"
+
+/*!
+ * \brief Values of a download that did not start yet
+ */
+struct QueuedDownload
+{
+    QueuedDownload();
+
+    int downloadId; // id of the download record, -1 until it is inserted
+    int contactId;
+    int parentId; // id of the playlist download, -1 if it was added by an url
+    DownloadManager::UrlType urlType;
+    QStringList urls; // the url followed by its mirrors
+    qint64 queuedTime; // time it was queued calculated by milisecond since the epoch
+};
+
+/*!
+ * \brief Struct of arrays holding the downloads waiting in the queue.
+ *
+ * A queued download only needs its ids, url and type, so it is kept as one row
+ * of parallel arrays instead of a Download and a Contact object, and equal urls
+ * share one string. The rows of each type are linked in queue order, the next
+ * download of a type and the lookups by id are O(1).
+ * \note not thread safe, the owner guards it with its own mutex
+ */
+class QueuedDownloadTable
+{
+public:
+    QueuedDownloadTable();
+
+    /*!
+     * \brief Add a download at the end of the queue
+     * \param entry: the values of the download, downloadId must be set
+     * \returns the row of the download
+     */
+    int append(const QueuedDownload &entry);
+
+    /*!
+     * \brief Remove a download from the queue
+     * \param row: row of the download
+     * \param entry: receives the values of the download
+     * \returns true if the row holds a download, otherwise returns false
+     */
+    bool take(int row, QueuedDownload &entry);
+
+    /*!
+     * \brief Get the row of the oldest download of a type
+     * \param typeIndex: index of the type, see MediaTypeRegistry::getTypeIndex()
+     * \returns the row, -1 if no download of the type is queued
+     */
+    int getFirstRow(int typeIndex) const;
+
+    /*!
+     * \brief Check which of two rows was queued first
+     * \returns true if row was queued before otherRow
+     */
+    bool isQueuedBefore(int row, int otherRow) const;
+
+    /*!
+     * \brief Find a download by its id
+     * \returns the row, -1 if the download is not queued
+     */
+    int findByDownloadId(int downloadId) const;
+
+    /*!
+     * \brief Find a download of a contact
+     * \returns the row, -1 if no download of the contact is queued
+     */
+    int findByContactId(int contactId) const;
+
+    /*!
+     * \brief Get the values of a row
+     * \param row: row of the download
+     * \param entry: receives the values of the download
+     * \returns true if the row holds a download, otherwise returns false
+     */
+    bool getEntry(int row, QueuedDownload &entry) const;
+
+    int getDownloadId(int row) const;
+    int getContactId(int row) const;
+    DownloadManager::UrlType getUrlType(int row) const;
+    qint64 getQueuedTime(int row) const;
+
+    /*!
+     * \brief Get the number of rows, used or free, to iterate over the table
+     */
+    int getRowCount() const;
+
+    /*!
+     * \brief Check if a row holds a download
+     */
+    bool isUsed(int row) const;
+
+    /*!
+     * \brief Get the number of queued downloads
+     */
+    int count() const;
+
+    bool isEmpty() const;
+
+    /*!
+     * \brief Remove every download and free the memory of the table
+     */
+    void clear();
+
+protected:
+    // Get the id of an url in the pool, adding it if needed
+    int internUrl(const QString &url);
+    // Drop a reference to an url of the pool
+    void releaseUrl(int urlId);
+
+    // Get a free row, growing the arrays if needed
+    int allocateRow();
+
+    // Take a row out of the list of its type
+    void unlink(int row);
+
+private:
+    // One entry per row, a free row has an url id of -1 and is linked through m_next
+    QVector<int> m_downloadIds;
+    QVector<int> m_contactIds;
+    QVector<int> m_parentIds;
+    QVector<int> m_urlIds; // index of the url in the pool
+    QVector<uint> m_sequences; // queue order, compared with wrap around
+    QVector<qint64> m_queuedTimes;
+    QVector<int> m_prev; // previous row of the same type
+    QVector<int> m_next; // next row of the same type, or next free row
+    QVector<qint8> m_urlTypes;
+
+    // Mirror urls of the few downloads that have some, by row
+    QHash<int, QStringList> m_mirrorUrls;
+
+    // Oldest and newest row of each type
+    int m_heads[MediaTypeRegistry::TypeCount];
+    int m_tails[MediaTypeRegistry::TypeCount];
+
+    int m_freeRow; // first free row, linked through m_next
+    int m_count;
+    uint m_nextSequence;
+
+    // Lookups by id
+    QHash<int, int> m_downloadRows;
+    QMultiHash<int, int> m_contactRows;
+
+    // Pool of the interned urls, a freed url id is reused
+    QVector<QString> m_urls;
+    QVector<int> m_urlReferences;
+    QVector<int> m_freeUrlIds;
+    QHash<QString, int> m_urlIdsByUrl;
+};
+
+#endif // QUEUEDDOWNLOADTABLE_H
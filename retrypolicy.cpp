@@ -0,0 +1,99 @@
+/*!
+ * \file retrypolicy.cpp
+ * \brief retry policy of failed downloads
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#include "retrypolicy.h"
+#include <QDateTime>
+
+RetryPolicy::RetryPolicy()
+{
+    m_maxAttempts = DOWNLOAD_MAX_RETRIES;
+    m_baseDelay = DOWNLOAD_RETRY_BASE_DELAY;
+    m_maxDelay = DOWNLOAD_RETRY_MAX_DELAY;
+
+    // Xorshift never leaves 0, keep the seed odd
+    m_randomState = (int)((QDateTime::currentDateTime().toTime_t() ^ (uint)(quintptr)this) | 1);
+}
+
+void RetryPolicy::setMaxAttempts(int maxAttempts)
+{
+    m_maxAttempts = qMax(0, maxAttempts);
+}
+
+int RetryPolicy::getMaxAttempts()
+{
+    return m_maxAttempts;
+}
+
+void RetryPolicy::setBaseDelay(int baseDelay)
+{
+    m_baseDelay = qMax(1, baseDelay);
+}
+
+int RetryPolicy::getBaseDelay()
+{
+    return m_baseDelay;
+}
+
+void RetryPolicy::setMaxDelay(int maxDelay)
+{
+    m_maxDelay = qMax(1, maxDelay);
+}
+
+int RetryPolicy::getMaxDelay()
+{
+    return m_maxDelay;
+}
+
+bool RetryPolicy::isRetryable(DownloadManager::DownloadErrorCode error)
+{
+    switch (error) {
+    case DownloadManager::UnknownError:
+    case DownloadManager::ConnectionRefusedError:
+    case DownloadManager::RemoteHostClosedError:
+    case DownloadManager::TimeoutError:
+    case DownloadManager::TemporaryNetworkFailureError:
+    case DownloadManager::UnknownNetworkError:
+    case DownloadManager::ProxyConnectionClosedError:
+    case DownloadManager::ProxyTimeoutError:
+        return true;
+    default:
+        return false;
+    }
+}
+
+uint RetryPolicy::nextRandom()
+{
+    forever {
+        int state = m_randomState;
+        uint x = (uint)state;
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        // Threads failing together each get their own number
+        if (m_randomState.testAndSetOrdered(state, (int)x))
+            return x;
+    }
+}
+
+int RetryPolicy::getRetryDelay(int attempt)
+{
+    // Exponential growth, capped before it can overflow
+    int delay = m_baseDelay;
+    for (int i = 1; i < attempt && delay < m_maxDelay; i++)
+        delay *= 2;
+    delay = qMin(delay, m_maxDelay);
+
+    // Keep half of the delay, randomize the other half
+    int half = delay/2;
+    delay = delay - half + (half > 0 ? (int)(nextRandom() % (uint)(half + 1)) : 0);
+
+    return qMax(1, delay);
+}
@@ -0,0 +1,93 @@
+/*!
+ * \file retrypolicy.h
+ * \brief retry policy of failed downloads
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#ifndef RETRYPOLICY_H
+#define RETRYPOLICY_H
+
+#include <QAtomicInt>
+#include "common.h"
+#include "downloadmanager.h"
+
+/*!
+ * \brief Decide which download errors are retried and how long to wait before a retry.
+ *
+ * The delay grows exponentially from the base delay up to the max delay, half of
+ * it is randomized so downloads failing together do not retry together.
+ * \note getRetryDelay() may be called from any download thread, the policy keeps
+ * its own random state instead of the per thread one of qrand()
+ */
+class RetryPolicy
+{
+public:
+    RetryPolicy();
+
+    /*!
+     * \brief Set the max number of retries of a download
+     * \param maxAttempts: number of retries, 0 disables retrying
+     */
+    void setMaxAttempts(int maxAttempts);
+
+    /*!
+     * \brief Get the max number of retries of a download
+     * \returns the number of retries
+     */
+    int getMaxAttempts();
+
+    /*!
+     * \brief Set the delay before the first retry
+     * \param baseDelay: delay calculated by second
+     */
+    void setBaseDelay(int baseDelay);
+
+    /*!
+     * \brief Get the delay before the first retry
+     * \returns delay calculated by second
+     */
+    int getBaseDelay();
+
+    /*!
+     * \brief Set the upper bound of the delay between retries
+     * \param maxDelay: delay calculated by second
+     */
+    void setMaxDelay(int maxDelay);
+
+    /*!
+     * \brief Get the upper bound of the delay between retries
+     * \returns delay calculated by second
+     */
+    int getMaxDelay();
+
+    /*!
+     * \brief Check if an error is transient
+     * \param error: the error of the download
+     * \returns true if the download should be retried
+     */
+    bool isRetryable(DownloadManager::DownloadErrorCode error);
+
+    /*!
+     * \brief Get the delay before a retry
+     * \param attempt: number of the retry, starting from 1
+     * \returns delay calculated by second, at least 1
+     */
+    int getRetryDelay(int attempt);
+
+protected:
+    // Draw the next number of the xorshift generator of the policy, lock free
+    uint nextRandom();
+
+private:
+    int m_maxAttempts;
+    int m_baseDelay;
+    int m_maxDelay;
+    QAtomicInt m_randomState; // state of the xorshift generator, never 0
+};
+
+#endif // RETRYPOLICY_H
@@ -0,0 +1,87 @@
+/*!
+ * \file speedestimator.cpp
+ * \brief download speed estimation
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#include "speedestimator.h"
+#include <math.h>
+#include <limits.h>
+
+SpeedEstimator::SpeedEstimator()
+{
+    reset();
+}
+
+void SpeedEstimator::reset()
+{
+    m_lastBytes = 0;
+    m_lastTime = -1;
+    m_instantSpeed = 0;
+    m_smoothedSpeed = 0;
+    m_hasSpeed = false;
+}
+
+void SpeedEstimator::addSample(qint64 bytesReceived, qint64 elapsed)
+{
+    // First sample or the transfer restarted from a lower offset, take it as the new base
+    if (m_lastTime < 0 || bytesReceived < m_lastBytes || elapsed < m_lastTime) {
+        m_lastBytes = bytesReceived;
+        m_lastTime = elapsed;
+        return;
+    }
+
+    qint64 interval = elapsed - m_lastTime;
+    if (interval < SPEED_SAMPLE_INTERVAL)
+        return; // too short to give a meaningful rate
+
+    m_instantSpeed = (bytesReceived - m_lastBytes)*1000.0/interval;
+
+    if (!m_hasSpeed) {
+        m_smoothedSpeed = m_instantSpeed;
+        m_hasSpeed = true;
+    } else {
+        // Weight depends on the real interval so irregular samples decay at the same rate
+        double alpha = 1.0 - exp(-(double)interval/SPEED_SMOOTHING_WINDOW);
+        m_smoothedSpeed += alpha*(m_instantSpeed - m_smoothedSpeed);
+    }
+
+    m_lastBytes = bytesReceived;
+    m_lastTime = elapsed;
+}
+
+qint64 SpeedEstimator::getInstantSpeed()
+{
+    if (!m_hasSpeed)
+        return -1;
+
+    return (qint64)m_instantSpeed;
+}
+
+qint64 SpeedEstimator::getSmoothedSpeed()
+{
+    if (!m_hasSpeed)
+        return -1;
+
+    return (qint64)m_smoothedSpeed;
+}
+
+int SpeedEstimator::getRemainTime(qint64 remainBytes)
+{
+    if (!m_hasSpeed || m_smoothedSpeed < 1.0)
+        return -1;
+
+    if (remainBytes <= 0)
+        return 0;
+
+    double remainTime = remainBytes*1000.0/m_smoothedSpeed;
+    if (remainTime > INT_MAX)
+        return INT_MAX;
+
+    return (int)remainTime;
+}
@@ -0,0 +1,68 @@
+/*!
+ * \file speedestimator.h
+ * \brief download speed estimation
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#ifndef SPEEDESTIMATOR_H
+#define SPEEDESTIMATOR_H
+
+#include "common.h"
+
+/*!
+ * \brief Estimate the speed of a transfer from its progress samples.
+ *
+ * The instantaneous speed is the rate over the last sample interval, the smoothed
+ * speed is an exponentially weighted moving average of it with a time constant of
+ * SPEED_SMOOTHING_WINDOW, so it follows speed changes within a few seconds.
+ */
+class SpeedEstimator
+{
+public:
+    SpeedEstimator();
+
+    /*!
+     * \brief Forget all samples
+     */
+    void reset();
+
+    /*!
+     * \brief Add a progress sample
+     * \param bytesReceived: total bytes received so far
+     * \param elapsed: time since the transfer started calculated by milisecond
+     */
+    void addSample(qint64 bytesReceived, qint64 elapsed);
+
+    /*!
+     * \brief Get the speed over the last sample interval
+     * \returns speed calculated by byte/s, -1 if not known yet
+     */
+    qint64 getInstantSpeed();
+
+    /*!
+     * \brief Get the smoothed speed
+     * \returns speed calculated by byte/s, -1 if not known yet
+     */
+    qint64 getSmoothedSpeed();
+
+    /*!
+     * \brief Estimate the remain time from the smoothed speed
+     * \param remainBytes: bytes left to receive
+     * \returns remain time calculated by milisecond, -1 if the speed is not known or zero
+     */
+    int getRemainTime(qint64 remainBytes);
+
+private:
+    qint64 m_lastBytes; // bytes received at the last sample
+    qint64 m_lastTime; // time of the last sample, -1 before the first one
+    double m_instantSpeed; // byte/s
+    double m_smoothedSpeed; // byte/s
+    bool m_hasSpeed; // true once a full sample interval has been measured
+};
+
+#endif // SPEEDESTIMATOR_H
@@ -0,0 +1,163 @@
+/*!
+ * \file streamdecoder.cpp
+ * \brief incremental decoder of http content encodings
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#include "streamdecoder.h"
+#include <QDebug>
+#include <string.h>
+
+static const int DECODE_CHUNK_SIZE = 16*1024; // output buffer growth step calculated by byte
+
+StreamDecoder::StreamDecoder()
+{
+    memset(&m_stream, 0, sizeof(m_stream));
+    m_initialized = false;
+    m_finished = false;
+    m_raw = false;
+    m_encoding = Identity;
+    m_wireBytes = 0;
+    m_decodedBytes = 0;
+}
+
+StreamDecoder::Encoding StreamDecoder::getEncoding(const QByteArray &contentEncoding)
+{
+    QByteArray encoding = contentEncoding.trimmed().toLower();
+    if (encoding.isEmpty() || encoding == "identity")
+        return Identity;
+    if (encoding == "gzip" || encoding == "x-gzip")
+        return Gzip;
+    if (encoding == "deflate")
+        return Deflate;
+
+    return Unsupported;
+}
+
+bool StreamDecoder::begin(Encoding encoding)
+{
+    end();
+
+    m_finished = false;
+    m_raw = false;
+    m_encoding = encoding;
+    m_pending.clear();
+    m_wireBytes = 0;
+    m_decodedBytes = 0;
+
+    if (encoding != Gzip && encoding != Deflate)
+        return false;
+
+    // 15 + 32 detects the gzip and the zlib header by itself
+    memset(&m_stream, 0, sizeof(m_stream));
+    if (inflateInit2(&m_stream, 15 + 32) != Z_OK) {
+        qDebug() << __PRETTY_FUNCTION__ << "inflateInit2 failed";
+        return false;
+    }
+
+    m_initialized = true;
+    return true;
+}
+
+bool StreamDecoder::restartRaw()
+{
+    end();
+
+    memset(&m_stream, 0, sizeof(m_stream));
+    if (inflateInit2(&m_stream, -15) != Z_OK)
+        return false;
+
+    m_initialized = true;
+    m_raw = true;
+    return true;
+}
+
+bool StreamDecoder::decode(const QByteArray &input, QByteArray &output)
+{
+    output.clear();
+    if (!m_initialized)
+        return false;
+
+    m_wireBytes += input.size();
+
+    // Data following the end of the stream is ignored, like browsers do
+    if (m_finished)
+        return true;
+
+    // Until the first byte is decoded a deflate body may still turn out to be raw
+    bool undecided = (m_encoding == Deflate && !m_raw && m_decodedBytes == 0);
+    if (undecided)
+        m_pending.append(input);
+
+    // zlib does not write to its input
+    m_stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(input.constData()));
+    m_stream.avail_in = input.size();
+
+    int result = Z_OK;
+    do {
+        int offset = output.size();
+        output.resize(offset + DECODE_CHUNK_SIZE);
+        m_stream.next_out = reinterpret_cast<Bytef *>(output.data() + offset);
+        m_stream.avail_out = DECODE_CHUNK_SIZE;
+
+        result = inflate(&m_stream, Z_NO_FLUSH);
+        output.resize(offset + DECODE_CHUNK_SIZE - m_stream.avail_out);
+
+        if (result == Z_DATA_ERROR && undecided && output.isEmpty()) {
+            // No zlib header, decode everything received so far as raw deflate
+            if (!restartRaw())
+                return false;
+            QByteArray pending = m_pending;
+            m_pending.clear();
+            m_wireBytes -= pending.size();
+            return decode(pending, output);
+        }
+
+        if (result == Z_BUF_ERROR)
+            break; // nothing left to decode until more input arrives
+        if (result != Z_OK && result != Z_STREAM_END) {
+            qDebug() << __PRETTY_FUNCTION__ << "inflate failed: " << (m_stream.msg ? m_stream.msg : "");
+            return false;
+        }
+    } while (result != Z_STREAM_END && (m_stream.avail_in > 0 || m_stream.avail_out == 0));
+
+    if (result == Z_STREAM_END)
+        m_finished = true;
+
+    m_decodedBytes += output.size();
+    if (m_decodedBytes > 0)
+        m_pending.clear();
+    return true;
+}
+
+bool StreamDecoder::isFinished() const
+{
+    return m_finished;
+}
+
+qint64 StreamDecoder::getWireBytes() const
+{
+    return m_wireBytes;
+}
+
+qint64 StreamDecoder::getDecodedBytes() const
+{
+    return m_decodedBytes;
+}
+
+void StreamDecoder::end()
+{
+    if (m_initialized)
+        inflateEnd(&m_stream);
+    m_initialized = false;
+}
+
+StreamDecoder::~StreamDecoder()
+{
+    end();
+}
@@ -0,0 +1,93 @@
+/*!
+ * \file streamdecoder.h
+ * \brief incremental decoder of http content encodings
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#ifndef STREAMDECODER_H
+#define STREAMDECODER_H
+
+#include <QByteArray>
+#include <zlib.h>
+
+/*!
+ * \brief Decode a gzip or deflate response body chunk by chunk.
+ *
+ * The body is decoded as it arrives, so a compressed download never needs to
+ * be held in memory. Servers answering "deflate" disagree on the framing, the
+ * decoder accepts both the zlib wrapped and the raw form.
+ */
+class StreamDecoder
+{
+public:
+
+    enum Encoding {
+        Identity = 0,
+        Gzip = 1,
+        Deflate = 2,
+        Unsupported = 3
+    };
+
+    StreamDecoder();
+    ~StreamDecoder();
+
+    /*!
+     * \brief Get the encoding named by a Content-Encoding header
+     * \param contentEncoding: value of the header, may be empty
+     */
+    static Encoding getEncoding(const QByteArray &contentEncoding);
+
+    /*!
+     * \brief Prepare to decode a new body
+     * \param encoding: Gzip or Deflate
+     * \returns true if successful, otherwise returns false
+     */
+    bool begin(Encoding encoding);
+
+    /*!
+     * \brief Decode the next chunk of the body
+     * \param input: bytes received from the network
+     * \param output: receives the decoded bytes
+     * \returns false if the data is corrupted
+     */
+    bool decode(const QByteArray &input, QByteArray &output);
+
+    /*!
+     * \brief Check whether the end of the compressed stream has been reached
+     */
+    bool isFinished() const;
+
+    /*!
+     * \brief Get the number of encoded bytes consumed
+     */
+    qint64 getWireBytes() const;
+
+    /*!
+     * \brief Get the number of decoded bytes produced
+     */
+    qint64 getDecodedBytes() const;
+
+protected:
+    // Release the zlib state
+    void end();
+
+    // Start over with a raw deflate stream, for servers sending deflate without the zlib header
+    bool restartRaw();
+
+private:
+    z_stream m_stream;
+    bool m_initialized; // true while m_stream holds a zlib state
+    bool m_finished; // true once the end of the stream is decoded
+    bool m_raw; // true when decoding a raw deflate stream
+    Encoding m_encoding;
+    QByteArray m_pending; // input kept while the framing of a deflate stream is not known
+    qint64 m_wireBytes;
+    qint64 m_decodedBytes;
+};
+
+#endif // STREAMDECODER_H
@@ -0,0 +1,142 @@
+/*!
+ * \file urltypeclassifier.cpp
+ * \brief perfect hash table of the supported file extensions
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#include "urltypeclassifier.h"
+#include <string.h>
+
+UrlTypeClassifier::UrlTypeClassifier()
+{
+    m_mask = 0;
+    m_seed = 0;
+    m_table.fill(-1, 1);
+}
+
+uint UrlTypeClassifier::hash(const char *extension, int length, uint seed)
+{
+    uint h = 2166136261u ^ seed;
+    for (int i = 0; i < length; i++) {
+        h ^= (uchar)extension[i];
+        h *= 16777619u;
+    }
+
+    return h;
+}
+
+bool UrlTypeClassifier::addExtension(const QString &extension, DownloadManager::UrlType urlType)
+{
+    QString name = extension.startsWith('.') ? extension.mid(1) : extension;
+    if (name.isEmpty() || name.size() > MaxExtensionLength)
+        return false;
+
+    Entry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.length = name.size();
+    entry.urlType = urlType;
+    for (int i = 0; i < entry.length; i++) {
+        ushort c = name.at(i).toLower().unicode();
+        if (c == 0 || c > 0x7F || c == '.' || c == '/')
+            return false;
+        entry.extension[i] = (char)c;
+    }
+
+    // A registered extension changes its type
+    for (int i = 0; i < m_entries.count(); i++) {
+        if (m_entries.at(i).length == entry.length && memcmp(m_entries.at(i).extension, entry.extension, entry.length) == 0) {
+            m_entries[i].urlType = urlType;
+            return true;
+        }
+    }
+
+    m_entries.append(entry);
+    rebuild();
+    return true;
+}
+
+void UrlTypeClassifier::rebuild()
+{
+    // Twice as many slots as extensions keeps a collision free seed easy to find
+    uint size = 8;
+    while (size < (uint)m_entries.count()*2)
+        size <<= 1;
+
+    forever {
+        for (uint seed = 0; seed < MaxSeedAttempts; seed++) {
+            QVector<int> table(size, -1);
+            bool collision = false;
+            for (int i = 0; i < m_entries.count() && !collision; i++) {
+                const Entry &entry = m_entries.at(i);
+                uint slot = hash(entry.extension, entry.length, seed) & (size - 1);
+                if (table.at(slot) >= 0)
+                    collision = true;
+                else
+                    table[slot] = i;
+            }
+
+            if (!collision) {
+                m_table = table;
+                m_mask = size - 1;
+                m_seed = seed;
+                return;
+            }
+        }
+
+        size <<= 1;
+    }
+}
+
+DownloadManager::UrlType UrlTypeClassifier::classify(const QString &url) const
+{
+    const QChar *data = url.constData();
+    int length = url.size();
+
+    // The query string and the fragment are not part of the file name
+    int end = 0;
+    while (end < length && data[end] != '?' && data[end] != '#')
+        end++;
+
+    // Find the last dot of the file name
+    int dot = -1;
+    int start = end - 1;
+    for (; start >= 0 && data[start] != '/'; start--) {
+        if (dot < 0 && data[start] == '.')
+            dot = start;
+    }
+
+    // No extension, a hidden file or the host name of an url without a path
+    if (dot < 0 || dot == start + 1)
+        return DownloadManager::UnknownType;
+    if (start >= 2 && data[start - 1] == '/' && data[start - 2] == ':')
+        return DownloadManager::UnknownType;
+
+    int extensionLength = end - dot - 1;
+    if (extensionLength < 1 || extensionLength > MaxExtensionLength)
+        return DownloadManager::UnknownType;
+
+    char extension[MaxExtensionLength];
+    for (int i = 0; i < extensionLength; i++) {
+        ushort c = data[dot + 1 + i].unicode();
+        if (c > 0x7F)
+            return DownloadManager::UnknownType;
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+        extension[i] = (char)c;
+    }
+
+    int index = m_table.at(hash(extension, extensionLength, m_seed) & m_mask);
+    if (index < 0)
+        return DownloadManager::UnknownType;
+
+    const Entry &entry = m_entries.at(index);
+    if (entry.length != extensionLength || memcmp(entry.extension, extension, extensionLength) != 0)
+        return DownloadManager::UnknownType;
+
+    return entry.urlType;
+}
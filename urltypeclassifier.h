@@ -0,0 +1,77 @@
+/*!
+ * \file urltypeclassifier.h
+ * \brief perfect hash table of the supported file extensions
+ *
+ * Copyright of Nomovok Ltd. All rights reserved.
+ *
+ * Contact: nguyentruong.duong@nomovok.com
+ *
+ * \author Nguyen Truong Duong <nguyentruong.duong@nomovok.com>
+ *
+ */
+#ifndef URLTYPECLASSIFIER_H
+#define URLTYPECLASSIFIER_H
+
+#include <QString>
+#include <QVector>
+#include "downloadmanager.h"
+
+/*!
+ * \brief Map the extension of an url to its UrlType.
+ *
+ * The extensions are registered at startup and kept in a perfect hash table:
+ * a seed is searched so that no two extensions share a slot, a lookup then
+ * hashes the extension once and compares a single entry. classify() reads the
+ * characters of the url in place, it never allocates, and ignores the case of
+ * the extension, the query string and the fragment.
+ */
+class UrlTypeClassifier
+{
+public:
+    UrlTypeClassifier();
+
+    /*!
+     * \brief Register a supported extension
+     * \param extension: the extension, with or without its dot
+     * \param urlType: type of the files with this extension
+     * \returns false if the extension is empty, too long or not ascii
+     * \note rebuilds the table, register every extension before the classifier is shared between threads
+     */
+    bool addExtension(const QString &extension, DownloadManager::UrlType urlType);
+
+    /*!
+     * \brief Get the type of an url by the extension of its file name
+     * \param url: the url, may have a query string and a fragment
+     * \returns UnknownType if the extension is not registered
+     * \note can be called from any thread
+     */
+    DownloadManager::UrlType classify(const QString &url) const;
+
+protected:
+
+    enum {
+        MaxExtensionLength = 15,
+        MaxSeedAttempts = 256 // seeds tried before the table is made larger
+    };
+
+    struct Entry
+    {
+        char extension[MaxExtensionLength + 1]; // lower case, without the dot
+        int length;
+        DownloadManager::UrlType urlType;
+    };
+
+    // FNV-1a of a lower case extension, mixed with a seed
+    static uint hash(const char *extension, int length, uint seed);
+
+    // Find a seed and a size without collisions
+    void rebuild();
+
+private:
+    QVector<Entry> m_entries; // registered extensions
+    QVector<int> m_table; // index in m_entries per slot, -1 if the slot is empty
+    uint m_mask; // number of slots minus one
+    uint m_seed;
+};
+
+#endif // URLTYPECLASSIFIER_H